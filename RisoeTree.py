@@ -12,26 +12,19 @@ f = open("/Users/healpa/Documents/git/GEL_tree_geometries/data/point_clouds/Wint
 #f = open("/Users/healpa/Documents/git/GEL_tree_geometries/data/point_clouds/Quercus_rubra.txt")
 
 lns = f.readlines()
+pts = array([ [ float(num) for num in l.split() ] for l in lns[2:] ])
 g = graph.Graph()
-pts = []
-for l in lns[2:]:
-    p = array([ float(num) for num in l.split() ])
-    pts += [p]
-    g.add_node(p)
+g.add_nodes(pts)
 print(f"Tree has {len(g.nodes())} nodes")
 print(f"Time elapsed: {time()-t0:.5} seconds\n")
  
 t0 = time()
-pts = array(pts)
 T = KDTree(pts)
 print("Made KDTree")
 print(f"Time elapsed: {time()-t0:.5} seconds\n")
  
 t0 = time()
-conn = 0
-for i,j in T.query_pairs(r=0.025):
-    g.connect_nodes(i,j)
-    conn += 1
+conn = g.connect_node_pairs(T.query_pairs(r=0.025, output_type='ndarray'))
 print(f"Connected {conn} nodes")
 print(f"Time elapsed: {time()-t0:.5} seconds\n")
  
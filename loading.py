@@ -30,6 +30,13 @@ t0 = time()
 m = graph.color_detached_parts(s)
 print("Colored detached parts of the skeleton")
 print(f"Time elapsed: {time()-t0:.5} seconds")
+
+#Testing the rooted tree analysis
+t0 = time()
+tree = graph.rooted_tree(s)
+print("Root", tree["root"], "Strahler order", tree["strahler"][tree["root"]],
+      "branch segments", tree["segment"].max()+1, "height", tree["path_length"].max())
+print(f"Time elapsed: {time()-t0:.5} seconds")
 V = gl.Viewer()
 V.display(m)
 
@@ -0,0 +1,373 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <GEL/Util/Parallel.h>
+#include <GEL/Geometry/BVH.h>
+
+using namespace std;
+using namespace CGLA;
+
+namespace Geometry {
+
+    namespace {
+        const int BINS = 16;
+        const size_t MAX_LEAF_SIZE = 4;
+
+        struct Bounds {
+            Vec3f lo = Vec3f(FLT_MAX);
+            Vec3f hi = Vec3f(-FLT_MAX);
+
+            void add(const Vec3f& p) { lo = v_min(lo, p); hi = v_max(hi, p); }
+            void add(const Bounds& b) { lo = v_min(lo, b.lo); hi = v_max(hi, b.hi); }
+            float area() const {
+                if (lo[0] > hi[0])
+                    return 0.0f;
+                const Vec3f d = hi - lo;
+                return 2.0f * (d[0]*d[1] + d[1]*d[2] + d[2]*d[0]);
+            }
+        };
+
+        /// Node of the binary tree that is built first. A node with left == -1 is a leaf.
+        struct BinaryNode {
+            Bounds box;
+            int left = -1, right = -1;
+            size_t first = 0, count = 0;
+        };
+
+        /// Top down construction of a binary tree using the surface area heuristic over centroid bins.
+        class BinaryBuilder {
+            vector<Bounds> tri_box;
+            vector<Vec3f> centre;
+
+        public:
+            vector<size_t> idx;
+            vector<BinaryNode> bnodes;
+
+            BinaryBuilder(const vector<Triangle>& triangles) {
+                const size_t N = triangles.size();
+                tri_box.resize(N);
+                centre.resize(N);
+                idx.resize(N);
+                for (size_t i = 0; i < N; ++i) {
+                    tri_box[i].add(triangles[i].get_pmin());
+                    tri_box[i].add(triangles[i].get_pmax());
+                    centre[i] = 0.5f * (tri_box[i].lo + tri_box[i].hi);
+                    idx[i] = i;
+                }
+                bnodes.reserve(2 * N);
+            }
+
+            int build(size_t first, size_t count) {
+                Bounds box, cbox;
+                for (size_t i = first; i < first + count; ++i) {
+                    box.add(tri_box[idx[i]]);
+                    cbox.add(centre[idx[i]]);
+                }
+                const int b = static_cast<int>(bnodes.size());
+                bnodes.emplace_back();
+                bnodes[b].box = box;
+                bnodes[b].first = first;
+                bnodes[b].count = count;
+                if (count == 1)
+                    return b;
+
+                // Evaluate the split after each bin along each axis.
+                float best_cost = FLT_MAX;
+                int best_axis = -1, best_bin = 0;
+                const Vec3f ext = cbox.hi - cbox.lo;
+                auto bin_of = [&](size_t t, int k) {
+                    return min(BINS - 1, int(BINS * (centre[t][k] - cbox.lo[k]) / ext[k]));
+                };
+                for (int k = 0; k < 3; ++k) {
+                    if (!(ext[k] > 0.0f))
+                        continue;
+                    Bounds bin_box[BINS];
+                    size_t bin_cnt[BINS] = {0};
+                    for (size_t i = first; i < first + count; ++i) {
+                        const int j = bin_of(idx[i], k);
+                        bin_box[j].add(tri_box[idx[i]]);
+                        ++bin_cnt[j];
+                    }
+                    float right_area[BINS];
+                    size_t right_cnt[BINS];
+                    Bounds acc;
+                    size_t cnt = 0;
+                    for (int j = BINS - 1; j > 0; --j) {
+                        acc.add(bin_box[j]);
+                        cnt += bin_cnt[j];
+                        right_area[j] = acc.area();
+                        right_cnt[j] = cnt;
+                    }
+                    acc = Bounds();
+                    cnt = 0;
+                    for (int j = 0; j < BINS - 1; ++j) {
+                        acc.add(bin_box[j]);
+                        cnt += bin_cnt[j];
+                        if (cnt == 0 || right_cnt[j+1] == 0)
+                            continue;
+                        const float cost = acc.area() * cnt + right_area[j+1] * right_cnt[j+1];
+                        if (cost < best_cost) {
+                            best_cost = cost;
+                            best_axis = k;
+                            best_bin = j;
+                        }
+                    }
+                }
+
+                // With unit costs for a box test and a triangle test, a leaf is better if count <= 1 + cost/area.
+                const float area = box.area();
+                if (count <= MAX_LEAF_SIZE && (best_axis < 0 || area * (count - 1) <= best_cost))
+                    return b;
+
+                size_t mid = first + count / 2;
+                if (best_axis >= 0) {
+                    auto it = partition(idx.begin() + first, idx.begin() + first + count,
+                                        [&](size_t t) { return bin_of(t, best_axis) <= best_bin; });
+                    mid = it - idx.begin();
+                }
+                const int l = build(first, mid - first);
+                const int r = build(mid, first + count - mid);
+                bnodes[b].left = l;
+                bnodes[b].right = r;
+                return b;
+            }
+        };
+
+        /// Squared distance from p to each of the four child boxes of n.
+        inline void box_sq_dist(const BVH::Node& n, const Vec3f& p, float d[4]) {
+            for (int l = 0; l < 4; ++l)
+                d[l] = 0.0f;
+            for (int k = 0; k < 3; ++k)
+                for (int l = 0; l < 4; ++l) {
+                    const float e = max(max(n.lo[k][l] - p[k], p[k] - n.hi[k][l]), 0.0f);
+                    d[l] += e * e;
+                }
+        }
+
+        /// Whether the ray p + t dir with 0 <= t <= tmax hits each of the four child boxes of n.
+        inline void box_ray(const BVH::Node& n, const Vec3f& p, const Vec3f& inv_dir, float tmax, bool hit[4]) {
+            float t_near[4], t_far[4];
+            for (int l = 0; l < 4; ++l) {
+                t_near[l] = 0.0f;
+                t_far[l] = tmax;
+            }
+            for (int k = 0; k < 3; ++k)
+                for (int l = 0; l < 4; ++l) {
+                    const float t0 = (n.lo[k][l] - p[k]) * inv_dir[k];
+                    const float t1 = (n.hi[k][l] - p[k]) * inv_dir[k];
+                    t_near[l] = max(t_near[l], min(t0, t1));
+                    t_far[l] = min(t_far[l], max(t0, t1));
+                }
+            for (int l = 0; l < 4; ++l)
+                hit[l] = (n.child[l] >= 0) && !(t_near[l] > t_far[l]);
+        }
+
+        /** Visit the triangles whose leaf boxes are hit by the ray p + t dir with 0 <= t <= tmax. f is called with
+         the index of each triangle and may lower tmax to prune the remaining traversal. */
+        template<typename F>
+        void traverse_ray(const vector<BVH::Node>& nodes, const Vec3f& p, const Vec3f& dir, float& tmax, F&& f) {
+            if (nodes.empty())
+                return;
+            const Vec3f inv_dir(1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2]);
+            vector<int32_t> stack;
+            stack.reserve(64);
+            stack.push_back(0);
+            while (!stack.empty()) {
+                const BVH::Node& n = nodes[stack.back()];
+                stack.pop_back();
+                bool hit[4];
+                box_ray(n, p, inv_dir, tmax, hit);
+                for (int l = 0; l < 4; ++l)
+                    if (hit[l]) {
+                        if (n.count[l] > 0) {
+                            for (uint32_t i = 0; i < n.count[l]; ++i)
+                                f(n.child[l] + i);
+                        }
+                        else
+                            stack.push_back(n.child[l]);
+                    }
+            }
+        }
+    }
+
+    void BVH::build(std::vector<Triangle>& triangles) {
+        nodes.clear();
+        tris.clear();
+        if (triangles.empty())
+            return;
+
+        BinaryBuilder bb(triangles);
+        const int root = bb.build(0, triangles.size());
+        const float eps = 1e-6f * length(bb.bnodes[root].box.hi - bb.bnodes[root].box.lo);
+
+        // Collapse the binary tree. The children of a node are gathered by repeatedly opening the inner child
+        // with the largest surface area until there are four.
+        auto collapse = [&](int b, auto&& collapse_ref) -> int32_t {
+            const int32_t ni = static_cast<int32_t>(nodes.size());
+            nodes.emplace_back();
+            for (int l = 0; l < 4; ++l) {
+                for (int k = 0; k < 3; ++k) {
+                    nodes[ni].lo[k][l] = FLT_MAX;
+                    nodes[ni].hi[k][l] = -FLT_MAX;
+                }
+                nodes[ni].child[l] = -1;
+                nodes[ni].count[l] = 0;
+            }
+            vector<int> kids;
+            if (bb.bnodes[b].left < 0)
+                kids.push_back(b);
+            else
+                kids = {bb.bnodes[b].left, bb.bnodes[b].right};
+            while (kids.size() < 4) {
+                int open = -1;
+                float open_area = -1.0f;
+                for (size_t i = 0; i < kids.size(); ++i)
+                    if (bb.bnodes[kids[i]].left >= 0 && bb.bnodes[kids[i]].box.area() > open_area) {
+                        open = static_cast<int>(i);
+                        open_area = bb.bnodes[kids[i]].box.area();
+                    }
+                if (open < 0)
+                    break;
+                const BinaryNode& o = bb.bnodes[kids[open]];
+                kids[open] = o.left;
+                kids.push_back(o.right);
+            }
+            for (size_t l = 0; l < kids.size(); ++l) {
+                const BinaryNode& k = bb.bnodes[kids[l]];
+                for (int c = 0; c < 3; ++c) {
+                    nodes[ni].lo[c][l] = k.box.lo[c] - eps;
+                    nodes[ni].hi[c][l] = k.box.hi[c] + eps;
+                }
+                if (k.left < 0) {
+                    nodes[ni].child[l] = static_cast<int32_t>(k.first);
+                    nodes[ni].count[l] = static_cast<uint32_t>(k.count);
+                }
+                else {
+                    const int32_t c = collapse_ref(kids[l], collapse_ref);
+                    nodes[ni].child[l] = c;
+                }
+            }
+            return ni;
+        };
+        collapse(root, collapse);
+
+        tris.reserve(triangles.size());
+        for (auto i: bb.idx)
+            tris.push_back(triangles[i]);
+    }
+
+    bool BVH::intersect(const CGLA::Vec3f& p, const CGLA::Vec3f& dir, float& tmin) const {
+        float t_best = FLT_MAX;
+        bool found = false;
+        traverse_ray(nodes, p, dir, t_best, [&](size_t i) {
+            float t;
+            if (tris[i].intersect(p, dir, t) && t > 0 && t < t_best) {
+                t_best = t;
+                found = true;
+            }
+        });
+        if (found)
+            tmin = t_best;
+        return found;
+    }
+
+    void BVH::intersect(Ray& r) const {
+        float t_best = static_cast<float>(min(r.dist, double(FLT_MAX)));
+        size_t hit = tris.size();
+        traverse_ray(nodes, r.origin, r.direction, t_best, [&](size_t i) {
+            float t;
+            if (tris[i].intersect(r.origin, r.direction, t) && t > 0 && t < t_best) {
+                t_best = t;
+                hit = i;
+            }
+        });
+        if (hit < tris.size()) {
+            r.has_hit = true;
+            r.dist = t_best;
+            r.hit_pos = r.origin + t_best * r.direction;
+            r.hit_normal = tris[hit].get_face_norm();
+        }
+    }
+
+    int BVH::intersect_cnt(const CGLA::Vec3f& p, const CGLA::Vec3f& dir) const {
+        float t_max = FLT_MAX;
+        int cnt = 0;
+        traverse_ray(nodes, p, dir, t_max, [&](size_t i) {
+            float t;
+            if (tris[i].intersect(p, dir, t) && t > 0)
+                ++cnt;
+        });
+        return cnt;
+    }
+
+    float BVH::compute_signed_distance(const CGLA::Vec3f& p, float upper) const {
+        float best = upper < sqrt(FLT_MAX) ? upper * upper : FLT_MAX;
+        float sgn = 1.0f;
+        bool found = false;
+        if (nodes.empty())
+            return upper;
+
+        // Nearest first traversal. Leaves are processed when their parent is, closest first, and inner children
+        // are pushed farthest first so that the closest is popped next.
+        vector<pair<float, int32_t>> stack;
+        stack.reserve(64);
+        stack.emplace_back(0.0f, 0);
+        while (!stack.empty()) {
+            const auto [d_node, ni] = stack.back();
+            stack.pop_back();
+            if (d_node >= best)
+                continue;
+            const Node& n = nodes[ni];
+            float d[4];
+            box_sq_dist(n, p, d);
+            int order[4] = {0, 1, 2, 3};
+            sort(order, order + 4, [&](int a, int b) { return d[a] < d[b]; });
+            for (int l: order)
+                if (n.count[l] > 0 && d[l] < best)
+                    for (uint32_t i = 0; i < n.count[l]; ++i) {
+                        float sq_dist, s;
+                        tris[n.child[l] + i].signed_distance(p, sq_dist, s);
+                        if (sq_dist < best) {
+                            best = sq_dist;
+                            sgn = s;
+                            found = true;
+                        }
+                    }
+            for (int j = 3; j >= 0; --j) {
+                const int l = order[j];
+                if (n.count[l] == 0 && n.child[l] >= 0 && d[l] < best)
+                    stack.emplace_back(d[l], n.child[l]);
+            }
+        }
+        return found ? sgn * sqrt(best) : upper;
+    }
+
+    std::vector<float> BVH::compute_signed_distance(const std::vector<CGLA::Vec3f>& pts, float upper) const {
+        vector<float> d(pts.size());
+        Util::parallel_for(pts.size(), [&](size_t i, unsigned int) {
+            d[i] = compute_signed_distance(pts[i], upper);
+        }, 64);
+        return d;
+    }
+
+    std::vector<int> BVH::intersect_cnt(const std::vector<CGLA::Vec3f>& pts,
+                                        const std::vector<CGLA::Vec3f>& dirs) const {
+        vector<int> cnt(pts.size());
+        Util::parallel_for(pts.size(), [&](size_t i, unsigned int) {
+            cnt[i] = intersect_cnt(pts[i], dirs[i]);
+        }, 64);
+        return cnt;
+    }
+
+    void BVH::intersect(std::vector<Ray>& rays) const {
+        Util::parallel_for(rays.size(), [&](size_t i, unsigned int) {
+            intersect(rays[i]);
+        }, 64);
+    }
+}
@@ -0,0 +1,87 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#ifndef BVH_h
+#define BVH_h
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+#include <GEL/CGLA/Vec3f.h>
+#include <GEL/Geometry/Ray.h>
+#include <GEL/Geometry/Triangle.h>
+
+namespace Geometry {
+
+    /** @brief Bounding volume hierarchy over triangles stored in a single array.
+
+     The hierarchy is built top down with the surface area heuristic evaluated over binned triangle centroids. The
+     resulting binary tree is collapsed into a tree where each node holds the axis aligned boxes of up to four
+     children. The boxes are stored coordinate by coordinate, so a node tests all four children in a few loops
+     that the compiler turns into SIMD instructions. Leaves hold up to four triangles, which are stored in leaf order.
+
+     The interface mirrors BoundingTree, so a BVH can be used wherever an AABBTree or OBBTree was. In addition,
+     there are batch queries which process many points in parallel. All queries are const and may be called
+     from several threads at a time. */
+    class BVH {
+    public:
+        /// A node with up to four children. Unused slots have empty boxes and child -1.
+        struct Node {
+            float lo[3][4];
+            float hi[3][4];
+
+            /// Index of a child node or, if count is non-zero, of the first triangle of a leaf.
+            int32_t child[4];
+
+            /// Number of triangles in a leaf child. Zero for inner children and unused slots.
+            uint32_t count[4];
+        };
+
+    private:
+        std::vector<Node> nodes;
+        std::vector<Triangle> tris;
+
+    public:
+        /// Return whether the hierarchy contains no triangles.
+        bool empty() const { return tris.empty(); }
+
+        /// Return the number of triangles.
+        size_t no_triangles() const { return tris.size(); }
+
+        /// Return the number of nodes.
+        size_t no_nodes() const { return nodes.size(); }
+
+        /// Build the hierarchy. The triangles are copied in leaf order, and the vector is left unchanged.
+        void build(std::vector<Triangle>& triangles);
+
+        /** Find the closest intersection in front of p along dir. Returns true if there is one, and tmin is then
+         set to its parameter along dir. */
+        bool intersect(const CGLA::Vec3f& p, const CGLA::Vec3f& dir, float& tmin) const;
+
+        /// Intersect r with the triangles. If a hit closer than r.dist is found, the hit members of r are updated.
+        void intersect(Ray& r) const;
+
+        /// Count the intersections in front of p along dir.
+        int intersect_cnt(const CGLA::Vec3f& p, const CGLA::Vec3f& dir) const;
+
+        /** Compute the signed distance from p to the triangles. The distance is negative inside. The sign is that
+         of the dot product with the angle weighted pseudo normal at the closest point. If no triangle is closer than
+         upper, upper is returned. */
+        float compute_signed_distance(const CGLA::Vec3f& p, float upper = FLT_MAX) const;
+
+        /// Compute the signed distance for each of the points in pts in parallel.
+        std::vector<float> compute_signed_distance(const std::vector<CGLA::Vec3f>& pts, float upper = FLT_MAX) const;
+
+        /// Count the intersections along dirs[i] in front of pts[i] for each i in parallel.
+        std::vector<int> intersect_cnt(const std::vector<CGLA::Vec3f>& pts,
+                                       const std::vector<CGLA::Vec3f>& dirs) const;
+
+        /// Intersect each ray in rays with the triangles in parallel.
+        void intersect(std::vector<Ray>& rays) const;
+    };
+}
+
+#endif /* BVH_h */
@@ -0,0 +1,83 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <GEL/Geometry/CSRGraph.h>
+
+namespace Geometry {
+
+    using namespace std;
+    using namespace CGLA;
+
+    CSRGraph3D::CSRGraph3D(const AMGraph3D& g): no_edges_created(g.no_edges()) {
+        const size_t N = g.no_nodes();
+        offsets.resize(N+1);
+        offsets[0] = 0;
+        for(auto n: g.node_ids())
+            offsets[n+1] = offsets[n] + g.valence(n);
+
+        nbrs.resize(offsets[N]);
+        edge_ids_vec.resize(offsets[N]);
+        pos = Util::AttribVec<NodeID, Vec3d>(N);
+        for(auto n: g.node_ids()) {
+            pos[n] = g.pos[n];
+            size_t i = offsets[n];
+            for(const auto& [m, e]: g.edges(n)) {
+                nbrs[i] = m;
+                edge_ids_vec[i] = e;
+                ++i;
+            }
+        }
+    }
+
+    CSRGraph3D::CSRGraph3D(size_t N, const Vec3d* _pos, const size_t* _offsets, const NodeID* _nbrs) {
+        pos = Util::AttribVec<NodeID, Vec3d>(N);
+        offsets.resize(N+1);
+        offsets[0] = 0;
+        nbrs.reserve(_offsets[N]);
+        for(size_t n = 0; n < N; ++n) {
+            pos[n] = _pos[n];
+            const size_t first = nbrs.size();
+            nbrs.insert(nbrs.end(), _nbrs + _offsets[n], _nbrs + _offsets[n+1]);
+            sort(nbrs.begin() + first, nbrs.end());
+            nbrs.erase(unique(nbrs.begin() + first, nbrs.end()), nbrs.end());
+            offsets[n+1] = nbrs.size();
+        }
+
+        // An edge gets its id when we meet it from the lower numbered end point. From the other end point we
+        // look up the id which has already been assigned.
+        edge_ids_vec.resize(nbrs.size());
+        for(NodeID n = 0; n < N; ++n)
+            for(size_t i = offsets[n]; i < offsets[n+1]; ++i) {
+                const NodeID m = nbrs[i];
+                if(m >= n)
+                    edge_ids_vec[i] = no_edges_created++;
+                else
+                    edge_ids_vec[i] = find_edge(m, n);
+            }
+    }
+
+    AMGraph3D CSRGraph3D::thaw() const {
+        AMGraph3D g;
+        for(auto n: node_ids())
+            g.add_node(pos[n]);
+        for(NodeID n: node_ids())
+            for(auto m: neighbors(n))
+                if(n < m)
+                    g.connect_nodes(n, m);
+        return g;
+    }
+
+    CSRGraph3D::EdgeID CSRGraph3D::find_edge(NodeID n0, NodeID n1) const {
+        if(valid_node_id(n0) && valid_node_id(n1)) {
+            auto N = neighbors(n0);
+            auto it = lower_bound(N.begin(), N.end(), n1);
+            if(it != N.end() && *it == n1)
+                return edge_ids_vec[offsets[n0] + (it - N.begin())];
+        }
+        return InvalidEdgeID;
+    }
+}
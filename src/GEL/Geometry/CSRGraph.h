@@ -0,0 +1,138 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#ifndef CSRGraph_h
+#define CSRGraph_h
+
+#include <vector>
+#include <GEL/CGLA/Vec3d.h>
+#include <GEL/Util/Range.h>
+#include <GEL/Util/AttribVec.h>
+#include <GEL/Geometry/Graph.h>
+
+namespace Geometry {
+
+    /** IDRange is a light weight view of a contiguous sequence of ids. It is what CSRGraph3D returns
+     instead of a freshly allocated vector when we ask for neighbors or incident edges. The view is only
+     valid as long as the graph it was obtained from is alive. */
+    template<typename IDType>
+    class IDRange {
+        const IDType* b = nullptr;
+        const IDType* e = nullptr;
+    public:
+        IDRange() {}
+        IDRange(const IDType* _b, const IDType* _e): b(_b), e(_e) {}
+
+        const IDType* begin() const { return b; }
+        const IDType* end() const { return e; }
+        size_t size() const { return e-b; }
+        bool empty() const { return b==e; }
+        const IDType& operator[](size_t i) const { return b[i]; }
+
+        /// Copy the range into a vector. Mostly for compatibility with code that wants AMGraph style neighbors.
+        std::vector<IDType> to_vector() const { return std::vector<IDType>(b, e); }
+    };
+
+    /** CSRGraph3D is a compressed sparse row representation of an AMGraph3D. The adjacency of all nodes is
+     stored in three flat arrays: offsets into the neighbor array, the neighbor array itself, and a parallel array
+     of edge ids. Neighbors of each node are sorted just like the keys of the AMGraph adjacency maps.
+
+     The graph is read-only: it is obtained by freezing an AMGraph3D once construction and simplification is done,
+     and it is meant for the algorithms that visit the adjacency many times - in particular skeletonization.
+     Node and edge ids are identical to those of the AMGraph3D it was frozen from. */
+    class CSRGraph3D {
+    public:
+        using NodeID = AMGraph::NodeID;
+        using EdgeID = AMGraph::EdgeID;
+        using NodeRange = IDRange<NodeID>;
+        using EdgeRange = IDRange<EdgeID>;
+
+        static constexpr NodeID InvalidNodeID = std::numeric_limits<size_t>::max();
+        static constexpr EdgeID InvalidEdgeID = std::numeric_limits<size_t>::max();
+
+    private:
+        /// offsets[n] is the index of the first neighbor of n, offsets[n+1] one past the last.
+        std::vector<size_t> offsets = std::vector<size_t>(1, 0);
+
+        /// Neighbor ids of all nodes stored consecutively
+        std::vector<NodeID> nbrs;
+
+        /// Edge ids of all incident edges. Parallel to nbrs.
+        std::vector<EdgeID> edge_ids_vec;
+
+        /// Number of edges created in the graph we froze.
+        size_t no_edges_created = 0;
+
+    public:
+
+        /// position attribute for each node
+        Util::AttribVec<NodeID, CGLA::Vec3d> pos;
+
+        CSRGraph3D() {}
+
+        /// Freeze an AMGraph3D into compressed sparse row form.
+        explicit CSRGraph3D(const AMGraph3D& g);
+
+        /** Build the graph directly from flat arrays without going through an AMGraph3D. offsets has N+1 entries,
+         and the neighbors of node n are nbrs[offsets[n]] up to (but excluding) nbrs[offsets[n+1]]. Each edge must be
+         listed for both of its end points. The neighbor lists are sorted, duplicates are removed, and edge ids are
+         assigned in order of the lowest numbered end point. */
+        CSRGraph3D(size_t N, const CGLA::Vec3d* pos, const size_t* offsets, const NodeID* nbrs);
+
+        /// Create an AMGraph3D with the same nodes, positions and edges. Edge ids are assigned anew.
+        AMGraph3D thaw() const;
+
+        /// Return number of nodes.
+        size_t no_nodes() const { return offsets.size()-1; }
+
+        /// Return number of edges created in the graph this was frozen from. Edge ids are less than this number.
+        size_t no_edges() const { return no_edges_created; }
+
+        /// Return whether the node is valid (i.e. in the graph)
+        bool valid_node_id(NodeID n) const { return n < no_nodes(); }
+
+        /// Return whether an edge is valid (i.e. in the graph)
+        bool valid_edge_id(EdgeID e) const { return e < no_edges_created; }
+
+        /// Returns true if the graph contains no nodes, false otherwise
+        bool empty() const { return no_nodes() == 0; }
+
+        /// The range returned can be used in range based for loops over all node ids
+        const Util::Range node_ids() const { return Util::Range(0, no_nodes()); }
+
+        /// Return the sorted NodeIDs of nodes adjacent to a given node without allocating.
+        NodeRange neighbors(NodeID n) const {
+            const NodeID* p = nbrs.data();
+            return NodeRange(p + offsets[n], p + offsets[n+1]);
+        }
+
+        /// Return the ids of the edges incident on n. The i'th edge connects n to neighbors(n)[i].
+        EdgeRange incident_edges(NodeID n) const {
+            const EdgeID* p = edge_ids_vec.data();
+            return EdgeRange(p + offsets[n], p + offsets[n+1]);
+        }
+
+        /// Return the number of edges incident on a given node.
+        size_t valence(NodeID n) const { return offsets[n+1]-offsets[n]; }
+
+        /// Find an edge given two nodes. Returns InvalidEdgeID if no such edge found. Uses binary search.
+        EdgeID find_edge(NodeID n0, NodeID n1) const;
+
+        /// Compute sqr distance between two nodes - not necessarily connected.
+        double sqr_dist(NodeID n0, NodeID n1) const {
+            if(valid_node_id(n0) && valid_node_id(n1))
+                return CGLA::sqr_length(pos[n0]-pos[n1]);
+            return CGLA::CGLA_NAN;
+        }
+
+        /// Returns true if the ID is valid and the node was in use in the graph we froze.
+        bool in_use(NodeID n) const {
+            return valid_node_id(n) && !std::isnan(pos[n][0]);
+        }
+    };
+}
+
+#endif /* CSRGraph_h */
@@ -644,7 +644,8 @@ namespace Geometry {
 
         // Batch removes every edge adjacent to given vertex
         // Returns false if neighbourhood was not reconnected
-        void remove(T v, const std::vector<T>& adj){
+        template<typename Container>
+        void remove(T v, const Container& adj){
             std::vector<T> adj_tree;
             t_sizes.erase(t_sizes.find(get_size(v)));
             for(auto w: adj){
@@ -653,18 +654,30 @@ namespace Geometry {
                     adj_tree.push_back(w);
                 }
             }
-            for(std::vector<size_t> remaining; adj_tree.size() > 1; remaining.clear()){
+            // Grow the component of the first tree by reconnecting it to the others. A tree may only have a
+            // replacement edge to a tree which is merged later, so we keep trying until no more trees are merged.
+            // Only then is the component final, and we proceed with the trees that remain.
+            for(std::vector<T> remaining; adj_tree.size() > 1; remaining.clear()){
                 size_t size = get_size(adj_tree[0]);
                 t_sizes.erase(t_sizes.find(size));
-                for(int i = 1; i<adj_tree.size();++i){
-                    size_t temp = get_size(adj_tree[i]);
-                    if(!is_connected(adj_tree[0],adj_tree[i]) && reconnect(adj_tree[0],adj_tree[i])){
-                        size += temp;
-                        t_sizes.erase(t_sizes.find(temp));
+                bool merged = true;
+                while(merged && adj_tree.size() > 1) {
+                    merged = false;
+                    std::vector<T> not_merged;
+                    for(int i = 1; i<adj_tree.size();++i){
+                        size_t temp = get_size(adj_tree[i]);
+                        if(!is_connected(adj_tree[0],adj_tree[i]) && reconnect(adj_tree[0],adj_tree[i])){
+                            size += temp;
+                            t_sizes.erase(t_sizes.find(temp));
+                            merged = true;
+                        }
+                        else not_merged.push_back(adj_tree[i]);
                     }
-                    else remaining.push_back(adj_tree[i]);
+                    adj_tree.resize(1);
+                    adj_tree.insert(adj_tree.end(), not_merged.begin(), not_merged.end());
                 }
                 t_sizes.insert(size);
+                remaining.assign(adj_tree.begin()+1, adj_tree.end());
                 adj_tree = remaining;
             }
         }
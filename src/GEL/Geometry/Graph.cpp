@@ -10,6 +10,7 @@
 #include <map>
 #include <queue>
 #include <GEL/Geometry/Graph.h>
+#include <GEL/Util/Parallel.h>
 
 namespace Geometry {
     
@@ -25,14 +26,21 @@ namespace Geometry {
             if(avg_pos) {
                 p_new += pos[n0];
                 p_new *= 0.5;
+                node_radius[n1] = 0.5 * (node_radius[n0] + node_radius[n1]);
+                for(auto& [name, attr]: node_attributes)
+                    attr[n1] = 0.5 * (attr[n0] + attr[n1]);
             }
             pos[n0] = Vec3d(CGLA_NAN);
             pos[n1] = p_new;
             
-            for(auto n:  neighbors(n0)) {
+            AdjMap edges_n0 = edge_map[n0];
+            for(auto [n, e_old]:  edges_n0) {
                 edge_map[n].erase(n0);
-                if(n != n1 && n != n0)
-                    connect_nodes(n, n1);
+                if(n != n1 && n != n0) {
+                    EdgeID e = connect_nodes(n, n1);
+                    if(valid_edge_id(e))
+                        copy_edge_attributes(e, *this, e_old);
+                }
             }
             edge_map[n0].clear();
         }
@@ -40,15 +48,16 @@ namespace Geometry {
     }
 
     AMGraph3D::NodeID AMGraph3D::merge_nodes(const vector<NodeID>& nodes) {
-        NodeID n_new = AMGraph::add_node();
-        node_color[n_new] = CGLA::Vec3f(0);
-        pos[n_new] = Vec3d(0);
+        NodeID n_new = add_node(Vec3d(0));
         
         NodeSet ns(begin(nodes), end(nodes));
         NodeSet nsn;
         
         for(auto n: ns) {
             pos[n_new] += pos[n];
+            node_radius[n_new] += node_radius[n];
+            for(auto& [name, attr]: node_attributes)
+                attr[n_new] += attr[n];
             for(auto nn : neighbors(n))
                 if (ns.count(nn) == 0)
                     nsn.insert(nn);
@@ -63,11 +72,35 @@ namespace Geometry {
         }
         
         pos[n_new] /= ns.size();
+        node_radius[n_new] /= ns.size();
+        for(auto& [name, attr]: node_attributes)
+            attr[n_new] /= ns.size();
         return n_new;
     }
 
     
     /// Special ID value for invalid node
+    void AMGraph::connect_nodes_bulk(const vector<size_t>& offsets,
+                                     const vector<pair<NodeID, EdgeID>>& adj,
+                                     size_t no_new_edges) {
+        Util::parallel_for(no_nodes(), [&](size_t n, unsigned int) {
+            edge_map[n].insert(adj.begin() + offsets[n], adj.begin() + offsets[n+1]);
+        }, 1024);
+        no_edges_created += no_new_edges;
+    }
+
+    void AMGraph3D::connect_nodes_bulk(const vector<size_t>& offsets,
+                                       const vector<pair<NodeID, EdgeID>>& adj,
+                                       size_t no_new_edges) {
+        const EdgeID first = no_edges();
+        AMGraph::connect_nodes_bulk(offsets, adj, no_new_edges);
+        for(EdgeID e = first; e < no_edges(); ++e) {
+            edge_color[e] = CGLA::Vec3f(0);
+            for(auto& [name, attr]: edge_attributes)
+                attr[e] = 0.0;
+        }
+    }
+
     const AMGraph3D::NodeID AMGraph::InvalidNodeID = std::numeric_limits<size_t>::max();
     
     /// Special ID value for invalid edge
@@ -76,6 +109,7 @@ namespace Geometry {
     AMGraph3D clean_graph(const AMGraph3D& g)
     {
         AMGraph3D gn; // new graph
+        gn.add_attributes_of(g);
         map<AMGraph::NodeID, AMGraph::NodeID> node_map;
         
         // For all nodes that are not too close to previously visited nodes
@@ -86,7 +120,7 @@ namespace Geometry {
                 node_map[n] = AMGraph::InvalidNodeID;
             } else {
                 node_map[n] = gn.add_node(g.pos[n]);
-                gn.node_color[node_map[n]] = g.node_color[n];
+                gn.copy_node_attributes(node_map[n], g, n);
             }
         }
         
@@ -98,9 +132,7 @@ namespace Geometry {
                     if(gn.valid_edge_id(e)) {
                         AMGraph::EdgeID e_old = g.find_edge(n, nn);
                         if(g.valid_edge_id(e_old))
-                            gn.edge_color[e] = g.edge_color[e_old];
-                        else
-                            gn.edge_color[e] = Vec3f(0);
+                            gn.copy_edge_attributes(e, g, e_old);
                     }
                 }
         
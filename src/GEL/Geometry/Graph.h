@@ -15,6 +15,7 @@
 #include <unordered_set>
 #include <vector>
 #include <limits>
+#include <string>
 #include <GEL/CGLA/Vec3d.h>
 #include <GEL/Util/Range.h>
 #include <GEL/Util/AttribVec.h>
@@ -120,6 +121,14 @@ namespace Geometry {
             }
             return InvalidEdgeID;
         }
+
+        /** Connect nodes in bulk. The new edges of node n are given by adj[offsets[n]] up to adj[offsets[n+1]]
+         as pairs of a neighbor and an edge id, sorted by neighbor. Every edge must be listed at both of its nodes
+         and must not exist already, and the edge ids must be no_edges() up to no_edges()+no_new_edges-1. The
+         adjacency maps of the nodes are filled in parallel. */
+        void connect_nodes_bulk(const std::vector<size_t>& offsets,
+                                const std::vector<std::pair<NodeID, EdgeID>>& adj,
+                                size_t no_new_edges);
         
         /// Return the NodeIDs of nodes adjacent to a given node
         std::vector<NodeID> neighbors(NodeID n) const {
@@ -150,39 +159,108 @@ namespace Geometry {
     };
     
     
-    /** AMGraph3D extends the AMGraph class by providing attributes for position, edge and node
+    /** AMGraph3D extends the AMGraph class by providing attributes for position, radius, edge and node
      colors. This is mostly for convenience as these attributes could be stored outside the class,
-     but it gives us a concrete 3D graph structure that has many applications. */
+     but it gives us a concrete 3D graph structure that has many applications. Further scalar
+     attributes can be registered by name for nodes and edges. All attributes are carried through
+     cleanup, merging of nodes, and file I/O. */
     class AMGraph3D: public AMGraph
     {
-    public:        
+    public:
+        /// Named scalar attribute with a value per node or per edge.
+        using NodeAttribute = Util::AttribVec<AMGraph::NodeID, double>;
+        using EdgeAttribute = Util::AttribVec<AMGraph::EdgeID, double>;
+
         /// position attribute for each node
         Util::AttribVec<AMGraph::NodeID, CGLA::Vec3d> pos;
         
+        /// Radius of each node. Skeletons store the local thickness of the shape here. Zero if unknown.
+        NodeAttribute node_radius;
+
         /// Edge color for each edge
         Util::AttribVec<AMGraph::EdgeID, CGLA::Vec3f> edge_color;
         
         /// Node colors for each node
         Util::AttribVec<AMGraph::NodeID, CGLA::Vec3f> node_color;
+
+        /** Attributes registered by name. Use add_node_attribute and add_edge_attribute to register an
+         attribute, since that ensures it has a value for every node or edge. */
+        std::map<std::string, NodeAttribute> node_attributes;
+        std::map<std::string, EdgeAttribute> edge_attributes;
         
-        /// Clear the graph
+        /// Clear the graph. Registered attributes remain registered but are emptied.
         void clear()
         {
             AMGraph::clear();
             pos.clear();
+            node_radius.clear();
             edge_color.clear();
             node_color.clear();
+            for(auto& [name, attr]: node_attributes)
+                attr.clear();
+            for(auto& [name, attr]: edge_attributes)
+                attr.clear();
         }
         
         /// Clean the graph, removing unused nodes and vertices.
         void cleanup();
+
+        /** Register a named node attribute with the value init for all existing nodes and return it.
+         If the attribute exists, it is returned unchanged. */
+        NodeAttribute& add_node_attribute(const std::string& name, double init = 0.0) {
+            auto it = node_attributes.find(name);
+            if(it == node_attributes.end())
+                it = node_attributes.emplace(name, NodeAttribute(no_nodes(), init)).first;
+            return it->second;
+        }
+
+        /// Register a named edge attribute in the same way as add_node_attribute.
+        EdgeAttribute& add_edge_attribute(const std::string& name, double init = 0.0) {
+            auto it = edge_attributes.find(name);
+            if(it == edge_attributes.end())
+                it = edge_attributes.emplace(name, EdgeAttribute(no_edges(), init)).first;
+            return it->second;
+        }
+
+        /// Register the named attributes of g that are not already registered in this graph.
+        void add_attributes_of(const AMGraph3D& g) {
+            for(const auto& [name, attr]: g.node_attributes)
+                add_node_attribute(name);
+            for(const auto& [name, attr]: g.edge_attributes)
+                add_edge_attribute(name);
+        }
+
+        /** Copy color, radius and named attributes of node n of g to node n_new of this graph. Named attributes
+         of g that are not registered in this graph are ignored. */
+        void copy_node_attributes(NodeID n_new, const AMGraph3D& g, NodeID n) {
+            node_color[n_new] = g.node_color[n];
+            node_radius[n_new] = g.node_radius[n];
+            for(auto& [name, attr]: node_attributes) {
+                auto it = g.node_attributes.find(name);
+                if(it != g.node_attributes.end())
+                    attr[n_new] = it->second[n];
+            }
+        }
+
+        /// Copy color and named attributes of edge e of g to edge e_new of this graph.
+        void copy_edge_attributes(EdgeID e_new, const AMGraph3D& g, EdgeID e) {
+            edge_color[e_new] = g.edge_color[e];
+            for(auto& [name, attr]: edge_attributes) {
+                auto it = g.edge_attributes.find(name);
+                if(it != g.edge_attributes.end())
+                    attr[e_new] = it->second[e];
+            }
+        }
         
         /// Add a node at arbitrary 3D position
         NodeID add_node(const CGLA::Vec3d& p)
         {
             NodeID n = AMGraph::add_node();
             pos[n] = p;
+            node_radius[n] = 0.0;
             node_color[n] = CGLA::Vec3f(0);
+            for(auto& [name, attr]: node_attributes)
+                attr[n] = 0.0;
             return n;
         }
         
@@ -211,10 +289,18 @@ namespace Geometry {
         EdgeID connect_nodes(NodeID n0, NodeID n1)
         {
             EdgeID e = AMGraph::connect_nodes(n0,n1);
-            if(valid_edge_id(e))
+            if(valid_edge_id(e)) {
                 edge_color[e] = CGLA::Vec3f(0);
+                for(auto& [name, attr]: edge_attributes)
+                    attr[e] = 0.0;
+            }
             return e;
         }
+
+        /// Connect nodes in bulk as AMGraph::connect_nodes_bulk. The new edges get default attributes.
+        void connect_nodes_bulk(const std::vector<size_t>& offsets,
+                                const std::vector<std::pair<NodeID, EdgeID>>& adj,
+                                size_t no_new_edges);
         
         /** Disconnect nodes. This operation removes the edge from the edge maps of the two formerly connected
          vertices, but the number of edges reported by the super class AMGraph is not decremented, so the edge is only
@@ -227,13 +313,14 @@ namespace Geometry {
         }
      
         /** Merge two nodes, the first is removed and the second inherits all connections,
-            the new position becomes the average. The return value is the node id of the second
+            the new position becomes the average. So do the radius and the named node attributes.
+         Edges moved from the first node keep their attributes. The return value is the node id of the second
          node. */
         NodeID merge_nodes(NodeID n0, NodeID n1, bool avg_pos=true);
 
         /** Merge all nodes in the vector passed as argument.  The nodes are invalidated, and a
-         new node is created at the average position of the nodes given as argument. The NodeID of
-         the created node is returned. */
+         new node is created at the average position of the nodes given as argument. The radius and named
+         node attributes are also averaged. The NodeID of the created node is returned. */
         NodeID merge_nodes(const std::vector<NodeID>& nodes);
 
         /// Compute sqr distance between two nodes - not necessarily connected.
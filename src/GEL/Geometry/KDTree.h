@@ -12,12 +12,14 @@
 #ifndef __GEOMETRY_KDTREE_H
 #define __GEOMETRY_KDTREE_H
 
+#include <array>
 #include <cmath>
 #include <queue>
 #include <vector>
 #include <algorithm>
 #include <GEL/CGLA/CGLA-util.h>
 #include <GEL/CGLA/ArithVec.h>
+#include <GEL/Util/Parallel.h>
 
 #if (_MSC_VER >= 1200)
 #pragma warning (push)
@@ -157,23 +159,31 @@ namespace Geometry
         };
         
         
+        /** Place the median of the keys in [kvec_beg, kvec_end) at cur and compute the sizes of the two
+         subtrees. Returns the index of the median. */
+        unsigned place_median(unsigned cur, unsigned kvec_beg, unsigned kvec_end,
+                              unsigned& left_size, unsigned& right_size);
+
         /** Passed a vector of keys, this function will construct an optimal tree.
          It is called recursively */
         void optimize(unsigned, unsigned, unsigned);
-        
-        /** Finde nearest neighbour. */
-        unsigned closest_point_priv(unsigned, const KeyType&, ScalarType&) const;
-        
-        
-        void in_sphere_priv(unsigned n,
-                            const KeyType& p,
-                            const ScalarType& dist,
-                            std::vector<int>& records) const;
-        
-        void m_closest_priv(unsigned n,
-                            const KeyType& p,
-                            ScalarType& max_dist,
-                            NQueue<KDTreeRecord<KeyT, ValT>>& nq) const;
+
+        /** Like optimize, but instead of descending more than levels levels, the remaining subtrees are
+         appended to tasks, so they can be built in parallel. */
+        void optimize_top(unsigned cur, unsigned kvec_beg, unsigned kvec_end, unsigned levels,
+                          std::vector<std::array<unsigned,3>>& tasks);
+
+        /** Visit the nodes that may lie within the square distance max_sq_dist of p in the order of a
+         depth first search. visit(n, sq_dist) is called for each of them and may lower max_sq_dist, which prunes
+         the rest of the search. An explicit stack is used instead of recursion. */
+        template<typename Visit>
+        void traverse(const KeyType& p, ScalarType& max_sq_dist, Visit&& visit) const;
+
+        /** Run query(p, records) for each p in pts in parallel and gather the records in CSR form. */
+        template<typename Query>
+        void batch_query(const std::vector<KeyT>& pts, Query&& query,
+                         std::vector<size_t>& offsets,
+                         std::vector<KDTreeRecord<KeyT, ValT>>& records) const;
         
         /** Finds the optimal discriminator. There are more ways, but this
          function traverses the vector and finds out what dimension has
@@ -206,7 +216,20 @@ namespace Geometry
             assert(!is_built);
             nodes.resize(init_nodes.size());
             if(init_nodes.size() > 1)
-                optimize(1,1,init_nodes.size());
+            {
+                // The top levels are built serially, and the subtrees below them in parallel. The subtrees
+                // occupy disjoint parts of both vectors, and the tree is the same as if it was built serially.
+                const unsigned threads = Util::thread_count();
+                unsigned levels = 0;
+                if(threads > 1 && init_nodes.size() > (1u << 14))
+                    while((1u << levels) < 8 * threads)
+                        ++levels;
+                std::vector<std::array<unsigned,3>> tasks;
+                optimize_top(1, 1, init_nodes.size(), levels, tasks);
+                Util::parallel_for(tasks.size(), [&](size_t i, unsigned int) {
+                    optimize(tasks[i][0], tasks[i][1], tasks[i][2]);
+                });
+            }
             NodeVecType v(1);
             init_nodes.swap(v);
             is_built = true;
@@ -226,7 +249,15 @@ namespace Geometry
             if(nodes.size()>1)
             {
                 ScalarType max_sq_dist = CGLA::sqr(dist);
-                if(unsigned n = closest_point_priv(1, p, max_sq_dist))
+                unsigned n = 0;
+                traverse(p, max_sq_dist, [&](unsigned m, ScalarType d) {
+                    if(d < max_sq_dist)
+                    {
+                        max_sq_dist = d;
+                        n = m;
+                    }
+                });
+                if(n)
                 {
                     k = nodes[n].key;
                     v = nodes[n].val;
@@ -254,7 +285,10 @@ namespace Geometry
             {
                 ScalarType max_sq_dist = CGLA::sqr(dist);
                 std::vector<int> records;
-                in_sphere_priv(1,p,max_sq_dist,records);
+                traverse(p, max_sq_dist, [&](unsigned n, ScalarType d) {
+                    if(d < max_sq_dist)
+                        records.push_back(n);
+                });
                 size_t N = records.size();
                 keys.resize(N);
                 vals.resize(N);
@@ -278,11 +312,94 @@ namespace Geometry
             {
                 ScalarType max_sq_dist = CGLA::sqr(dist);
                 NQueue<KDTreeRecord<KeyT, ValT>> nq(m);
-                m_closest_priv(1, p, max_sq_dist, nq);
+                traverse(p, max_sq_dist, [&](unsigned n, ScalarType d) {
+                    if(d < max_sq_dist)
+                    {
+                        nq.push(KDTreeRecord<KeyT, ValT>(d, nodes[n].key, nodes[n].val));
+                        if(nq.at_capacity())
+                            max_sq_dist = std::min(max_sq_dist, nq.top().d);
+                    }
+                });
                 nq.to_vector(nv);
             }
             return nv;
         }
+
+        /** Batch version of closest_point. The results for pts[i] are records[offsets[i]] up to (but excluding)
+         records[offsets[i+1]]. There is one record if a key was found within dist of pts[i] and none otherwise.
+         The d member of a record is the squared distance. The queries run in parallel. */
+        void closest_point(const std::vector<KeyT>& pts, ScalarType dist,
+                           std::vector<size_t>& offsets,
+                           std::vector<KDTreeRecord<KeyT, ValT>>& records) const
+        {
+            batch_query(pts, [&](const KeyT& p, std::vector<KDTreeRecord<KeyT, ValT>>& recs) {
+                KeyT k;
+                ValT v;
+                ScalarType d = dist;
+                if(closest_point(p, d, k, v))
+                    recs.push_back(KDTreeRecord<KeyT, ValT>(d * d, k, v));
+            }, offsets, records);
+        }
+
+        /** Batch version of in_sphere. The results are stored as for the batch version of closest_point and are
+         in the order in which in_sphere would return them. */
+        void in_sphere(const std::vector<KeyT>& pts, ScalarType dist,
+                       std::vector<size_t>& offsets,
+                       std::vector<KDTreeRecord<KeyT, ValT>>& records) const
+        {
+            batch_query(pts, [&](const KeyT& p, std::vector<KDTreeRecord<KeyT, ValT>>& recs) {
+                if(nodes.size()>1)
+                {
+                    ScalarType max_sq_dist = CGLA::sqr(dist);
+                    traverse(p, max_sq_dist, [&](unsigned n, ScalarType d) {
+                        if(d < max_sq_dist)
+                            recs.push_back(KDTreeRecord<KeyT, ValT>(d, nodes[n].key, nodes[n].val));
+                    });
+                }
+            }, offsets, records);
+        }
+
+        /** Batch version of m_closest. The results are stored as for the batch version of closest_point, and
+         the records of each point are sorted in ascending distance order. */
+        void m_closest(unsigned m, const std::vector<KeyT>& pts, ScalarType dist,
+                       std::vector<size_t>& offsets,
+                       std::vector<KDTreeRecord<KeyT, ValT>>& records) const
+        {
+            batch_query(pts, [&](const KeyT& p, std::vector<KDTreeRecord<KeyT, ValT>>& recs) {
+                auto nv = m_closest(m, p, dist);
+                recs.insert(recs.end(), nv.begin(), nv.end());
+            }, offsets, records);
+        }
+
+        /** Batch version of m_closest which only returns values. The values found for pts[i] are vals[offsets[i]] up
+         to (but excluding) vals[offsets[i+1]] in ascending distance order. Each point is given m slots of vals which
+         are filled in parallel and compacted afterwards, so no records are kept and vals never holds more than m
+         values per point. */
+        void m_closest_values(unsigned m, const std::vector<KeyT>& pts, ScalarType dist,
+                              std::vector<size_t>& offsets,
+                              std::vector<ValT>& vals) const
+        {
+            assert(is_built);
+            const size_t N = pts.size();
+            offsets.assign(N+1, 0);
+            vals.clear();
+            if(m == 0)
+                return;
+            vals.resize(N * m);
+            Util::parallel_for(N, [&](size_t i, unsigned int) {
+                auto nv = m_closest(m, pts[i], dist);
+                for(size_t j = 0; j < nv.size(); ++j)
+                    vals[i*m + j] = nv[j].v;
+                offsets[i+1] = nv.size();
+            }, 256);
+            for(size_t i = 0; i < N; ++i) {
+                // The values are moved down, so the ranges only overlap when they are already in place.
+                if(offsets[i] != i*m)
+                    std::copy(vals.begin() + i*m, vals.begin() + i*m + offsets[i+1], vals.begin() + offsets[i]);
+                offsets[i+1] += offsets[i];
+            }
+            vals.resize(offsets[N]);
+        }
         
     };
     
@@ -305,21 +422,12 @@ namespace Geometry
     }
     
     template<class KeyT, class ValT>
-    void KDTree<KeyT,ValT>::optimize(unsigned cur,
-                                     unsigned kvec_beg,
-                                     unsigned kvec_end)
+    unsigned KDTree<KeyT,ValT>::place_median(unsigned cur,
+                                             unsigned kvec_beg,
+                                             unsigned kvec_end,
+                                             unsigned& left_size,
+                                             unsigned& right_size)
     {
-        // Assert that we are not inserting beyond capacity.
-        assert(cur < nodes.size());
-        
-        // If there is just a single element, we simply insert.
-        if(kvec_beg+1==kvec_end)
-        {
-            nodes[cur] = init_nodes[kvec_beg];
-            nodes[cur].dsc = -1;
-            return;
-        }
-        
         // Find the axis that best separates the data.
         short disc = opt_disc(kvec_beg, kvec_end);
         
@@ -328,8 +436,8 @@ namespace Geometry
         unsigned N = kvec_end-kvec_beg;
         unsigned M = 1<< (CGLA::two_to_what_power(N));
         unsigned R = N-(M-1);
-        unsigned left_size  = (M-2)/2;
-        unsigned right_size = (M-2)/2;
+        left_size  = (M-2)/2;
+        right_size = (M-2)/2;
         if(R < M/2)
         {
             left_size += R;
@@ -355,6 +463,27 @@ namespace Geometry
         // Insert the node in the final data structure.
         nodes[cur] = init_nodes[median];
         nodes[cur].dsc = disc;
+        return median;
+    }
+
+    template<class KeyT, class ValT>
+    void KDTree<KeyT,ValT>::optimize(unsigned cur,
+                                     unsigned kvec_beg,
+                                     unsigned kvec_end)
+    {
+        // Assert that we are not inserting beyond capacity.
+        assert(cur < nodes.size());
+        
+        // If there is just a single element, we simply insert.
+        if(kvec_beg+1==kvec_end)
+        {
+            nodes[cur] = init_nodes[kvec_beg];
+            nodes[cur].dsc = -1;
+            return;
+        }
+        
+        unsigned left_size, right_size;
+        unsigned median = place_median(cur, kvec_beg, kvec_end, left_size, right_size);
         
         // Recursively build left and right tree.
         if(left_size>0)
@@ -363,109 +492,98 @@ namespace Geometry
         if(right_size>0)
             optimize(2*cur+1, median+1, kvec_end);
     }
-    
+
     template<class KeyT, class ValT>
-    unsigned KDTree<KeyT,ValT>::closest_point_priv(unsigned n, const KeyType& p,
-                                              ScalarType& dist) const
+    void KDTree<KeyT,ValT>::optimize_top(unsigned cur,
+                                         unsigned kvec_beg,
+                                         unsigned kvec_end,
+                                         unsigned levels,
+                                         std::vector<std::array<unsigned,3>>& tasks)
     {
-        unsigned ret_node = 0;
-        ScalarType this_dist = nodes[n].dist(p);
-        
-        if(this_dist<dist)
-        {
-            dist = this_dist;
-            ret_node = n;
-        }
-        if(nodes[n].dsc != -1)
+        if(levels == 0 || kvec_beg+1==kvec_end)
         {
-            short dsc         = nodes[n].dsc;
-            ScalarType dsc_dist  = CGLA::sqr(nodes[n].key[dsc]-p[dsc]);
-            bool left_son   = Comp(dsc)(p,nodes[n].key);
-            
-            if(left_son||dsc_dist<dist)
-            {
-                unsigned left_child = 2*n;
-                if(left_child < nodes.size())
-                    if(unsigned nl=closest_point_priv(left_child, p, dist))
-                        ret_node = nl;
-            }
-            if(!left_son||dsc_dist<dist)
-            {
-                unsigned right_child = 2*n+1;
-                if(right_child < nodes.size())
-                    if(unsigned nr = closest_point_priv(right_child, p, dist))
-                        ret_node = nr;
-            }
+            tasks.push_back({cur, kvec_beg, kvec_end});
+            return;
         }
-        return ret_node;
+        
+        unsigned left_size, right_size;
+        unsigned median = place_median(cur, kvec_beg, kvec_end, left_size, right_size);
+        
+        if(left_size>0)
+            optimize_top(2*cur, kvec_beg, median, levels-1, tasks);
+        
+        if(right_size>0)
+            optimize_top(2*cur+1, median+1, kvec_end, levels-1, tasks);
     }
     
     template<class KeyT, class ValT>
-    void KDTree<KeyT,ValT>::in_sphere_priv(unsigned n,
-                                           const KeyType& p,
-                                           const ScalarType& dist,
-                                           std::vector<int>& records) const
+    template<typename Visit>
+    void KDTree<KeyT,ValT>::traverse(const KeyType& p, ScalarType& max_sq_dist, Visit&& visit) const
     {
-        ScalarType this_dist = nodes[n].dist(p);
-        assert(n<nodes.size());
-        if(this_dist<dist)
-            records.push_back(n);
-        if(nodes[n].dsc != -1)
+        // A stack entry is a node together with the condition under which it is visited: always, or if its
+        // parent's splitting plane is closer than max_sq_dist when the entry is popped. Since the tree is
+        // balanced, its depth is at most 32, and the stack never holds more than two entries per level.
+        struct Entry {
+            unsigned n;
+            ScalarType dsc_dist;
+            bool always;
+        };
+        std::array<Entry, 66> stack;
+        size_t top = 0;
+        stack[top++] = {1, ScalarType(0), true};
+        while(top > 0)
         {
-            const short dsc = nodes[n].dsc;
-            const ScalarType dsc_dist = CGLA::sqr(nodes[n].key[dsc]-p[dsc]);
-            
-            bool left_son = Comp(dsc)(p,nodes[n].key);
-            
-            if(left_son||dsc_dist<dist)
-            {
-                unsigned left_child = 2*n;
-                if(left_child < nodes.size())
-                    in_sphere_priv(left_child, p, dist, records);
-            }
-            if(!left_son||dsc_dist<dist)
+            const Entry e = stack[--top];
+            if(!e.always && !(e.dsc_dist < max_sq_dist))
+                continue;
+            const unsigned n = e.n;
+            visit(n, nodes[n].dist(p));
+            if(nodes[n].dsc != -1)
             {
-                unsigned right_child = 2*n+1;
+                const short dsc = nodes[n].dsc;
+                const ScalarType dsc_dist = CGLA::sqr(nodes[n].key[dsc]-p[dsc]);
+                const bool left_son = Comp(dsc)(p,nodes[n].key);
+                
+                // The right child is pushed first so that the left subtree is searched first.
+                const unsigned right_child = 2*n+1;
                 if(right_child < nodes.size())
-                    in_sphere_priv(right_child, p, dist, records);
+                    stack[top++] = {right_child, dsc_dist, !left_son};
+                const unsigned left_child = 2*n;
+                if(left_child < nodes.size())
+                    stack[top++] = {left_child, dsc_dist, left_son};
             }
         }
     }
-    
+
     template<class KeyT, class ValT>
-    void KDTree<KeyT,ValT>::m_closest_priv(unsigned n,
-                                           const KeyType& p,
-                                           ScalarType& max_dist,
-                                           NQueue<KDTreeRecord<KeyT, ValT>>& nq) const
+    template<typename Query>
+    void KDTree<KeyT,ValT>::batch_query(const std::vector<KeyT>& pts, Query&& query,
+                                        std::vector<size_t>& offsets,
+                                        std::vector<KDTreeRecord<KeyT, ValT>>& records) const
     {
-        ScalarType dist = nodes[n].dist(p);
-        assert(n<nodes.size());
-        if(dist<max_dist)
-        {
-            nq.push(KDTreeRecord<KeyT, ValT>(dist,nodes[n].key,nodes[n].val));
-            if(nq.at_capacity())
-                max_dist = std::min(max_dist, nq.top().d);
-        }
-        if(nodes[n].dsc != -1)
-        {
-            const short dsc = nodes[n].dsc;
-            const ScalarType dsc_dist  = CGLA::sqr(nodes[n].key[dsc]-p[dsc]);
-            
-            bool left_son = Comp(dsc)(p,nodes[n].key);
-            
-            if(left_son||dsc_dist<max_dist)
+        assert(is_built);
+        // Blocks of points are processed in parallel, each into its own vector of records.
+        const size_t N = pts.size();
+        const size_t B = 256;
+        const size_t no_blocks = (N + B - 1) / B;
+        std::vector<std::vector<KDTreeRecord<KeyT, ValT>>> block_records(no_blocks);
+        offsets.assign(N+1, 0);
+        Util::parallel_for(no_blocks, [&](size_t b, unsigned int) {
+            auto& recs = block_records[b];
+            for(size_t i = b*B; i < std::min(N, (b+1)*B); ++i)
             {
-                unsigned left_child = 2*n;
-                if(left_child < nodes.size())
-                    m_closest_priv(left_child, p, max_dist, nq);
+                const size_t before = recs.size();
+                query(pts[i], recs);
+                offsets[i+1] = recs.size() - before;
             }
-            if(!left_son||dsc_dist<max_dist)
-            {
-                unsigned right_child = 2*n+1;
-                if(right_child < nodes.size())
-                    m_closest_priv(right_child, p, max_dist, nq);
-            }
-        }
+        });
+        for(size_t i = 0; i < N; ++i)
+            offsets[i+1] += offsets[i];
+        records.resize(offsets[N]);
+        Util::parallel_for(no_blocks, [&](size_t b, unsigned int) {
+            std::copy(block_records[b].begin(), block_records[b].end(), records.begin() + offsets[b*B]);
+            block_records[b] = std::vector<KDTreeRecord<KeyT, ValT>>();
+        });
     }
 }
 namespace GEO = Geometry;
@@ -0,0 +1,236 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#ifndef ShortestPaths_h
+#define ShortestPaths_h
+
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <GEL/Geometry/Graph.h>
+
+namespace Geometry {
+
+    /** A monotone priority queue of nodes keyed by non-negative distances. The bit pattern of a non-negative double
+     orders like the double, so the keys are stored as integers in 65 buckets according to the highest bit in which
+     they differ from the last key popped. Each key moves to a lower bucket at most 64 times, so push and pop are
+     amortized constant time. Keys pushed must not be smaller than the last key popped, which holds for Dijkstra. */
+    class RadixHeap {
+        using NodeID = AMGraph::NodeID;
+        using Entry = std::pair<uint64_t, NodeID>;
+        std::vector<Entry> buckets[65];
+        uint64_t last = 0;
+        size_t count = 0;
+
+        static uint64_t key(double d) {
+            uint64_t k;
+            std::memcpy(&k, &d, sizeof(k));
+            return k;
+        }
+        static double distance(uint64_t k) {
+            double d;
+            std::memcpy(&d, &k, sizeof(d));
+            return d;
+        }
+        int bucket(uint64_t k) const {
+            return k == last ? 0 : 64 - std::countl_zero(k ^ last);
+        }
+
+    public:
+        bool empty() const { return count == 0; }
+
+        void clear() {
+            for (auto& b: buckets)
+                b.clear();
+            last = 0;
+            count = 0;
+        }
+
+        void push(double d, NodeID n) {
+            const uint64_t k = key(d + 0.0); // Adding zero turns -0 into +0.
+            buckets[bucket(k)].emplace_back(k, n);
+            ++count;
+        }
+
+        /// Remove an entry with the smallest distance and return it.
+        std::pair<double, NodeID> pop() {
+            if (buckets[0].empty()) {
+                int i = 1;
+                while (buckets[i].empty())
+                    ++i;
+                uint64_t k_min = buckets[i][0].first;
+                for (const auto& e: buckets[i])
+                    k_min = std::min(k_min, e.first);
+                last = k_min;
+                for (const auto& e: buckets[i])
+                    buckets[bucket(e.first)].push_back(e);
+                buckets[i].clear();
+            }
+            const Entry e = buckets[0].back();
+            buckets[0].pop_back();
+            --count;
+            return {distance(e.first), e.second};
+        }
+    };
+
+    /** Shortest paths in a graph from one or more sources. Edges are weighted by their length. Distances, predecessors,
+     and the source each node was reached from are stored in flat arrays which are reused between searches. They are
+     reset in constant time, so an instance can be kept (e.g. per thread) and used for many small searches on a large
+     graph. For searches that are restricted to a small part of the graph, reset_sparse stores the same information
+     in a hash map instead, so memory use grows with the number of nodes reached rather than with the size of the
+     graph. The graph type can be AMGraph3D or CSRGraph3D. */
+    class ShortestPaths {
+        using NodeID = AMGraph::NodeID;
+        struct State {
+            double dist;
+            NodeID pred;
+            NodeID source;
+        };
+        std::vector<double> dist_vec;
+        std::vector<NodeID> pred_vec;
+        std::vector<NodeID> source_vec;
+        std::vector<unsigned> stamp;
+        std::unordered_map<NodeID, State> sparse_state;
+        bool sparse = false;
+        std::vector<NodeID> settled;
+        unsigned epoch = 1;
+        RadixHeap heap;
+
+        bool reached(NodeID n) const {
+            if (sparse)
+                return sparse_state.count(n) > 0;
+            return n < stamp.size() && stamp[n] == epoch;
+        }
+
+        void reach(NodeID n, double d, NodeID p, NodeID s) {
+            if (sparse) {
+                sparse_state[n] = {d, p, s};
+                return;
+            }
+            stamp[n] = epoch;
+            dist_vec[n] = d;
+            pred_vec[n] = p;
+            source_vec[n] = s;
+        }
+
+        // The stored values of a node that has been reached.
+        double reached_dist(NodeID n) const { return sparse ? sparse_state.find(n)->second.dist : dist_vec[n]; }
+        NodeID reached_source(NodeID n) const { return sparse ? sparse_state.find(n)->second.source : source_vec[n]; }
+        NodeID reached_pred(NodeID n) const { return sparse ? sparse_state.find(n)->second.pred : pred_vec[n]; }
+
+    public:
+        /// Clear the result of the previous search and make room for node ids up to N-1.
+        void reset(size_t N) {
+            sparse = false;
+            sparse_state.clear();
+            if (stamp.size() < N) {
+                stamp.resize(N, 0);
+                dist_vec.resize(N);
+                pred_vec.resize(N);
+                source_vec.resize(N);
+            }
+            if (++epoch == 0) {
+                std::fill(stamp.begin(), stamp.end(), 0);
+                epoch = 1;
+            }
+            settled.clear();
+            heap.clear();
+        }
+
+        /** Clear the result of the previous search and store the next search in a hash map. Any node id can be used,
+         and expected_size is the number of nodes the search is expected to reach. */
+        void reset_sparse(size_t expected_size = 0) {
+            sparse = true;
+            sparse_state.clear();
+            sparse_state.reserve(expected_size);
+            settled.clear();
+            heap.clear();
+        }
+
+        /** Add a source at distance d. label is what source() returns for the nodes closest to this source, by
+         default the node itself. Adding a node twice keeps the smaller distance and, for equal distances, the
+         last label. */
+        void add_source(NodeID n, double d = 0.0, NodeID label = AMGraph::InvalidNodeID) {
+            if (label == AMGraph::InvalidNodeID)
+                label = n;
+            if (!reached(n) || d < reached_dist(n)) {
+                reach(n, d, AMGraph::InvalidNodeID, label);
+                heap.push(d, n);
+            }
+            else if (d == reached_dist(n))
+                reach(n, d, reached_pred(n), label);
+        }
+
+        /** Run Dijkstra's algorithm from the sources until all reachable nodes are settled. Only nodes for which
+         allowed(n) is true are entered, and the search stops early if a node farther away than max_dist would be
+         settled. */
+        template<typename GraphT, typename Filter>
+        void run(const GraphT& g, Filter&& allowed, double max_dist = DBL_MAX) {
+            while (!heap.empty()) {
+                const auto [d, n] = heap.pop();
+                if (d != reached_dist(n))
+                    continue;
+                if (d > max_dist)
+                    break;
+                settled.push_back(n);
+                const CGLA::Vec3d& p = g.pos[n];
+                const NodeID s = reached_source(n);
+                for (auto m: g.neighbors(n))
+                    if (allowed(m)) {
+                        const double dm = d + CGLA::length(g.pos[m] - p);
+                        if (!reached(m) || dm < reached_dist(m)) {
+                            reach(m, dm, n, s);
+                            heap.push(dm, m);
+                        }
+                    }
+            }
+        }
+
+        template<typename GraphT>
+        void run(const GraphT& g) {
+            run(g, [](NodeID) { return true; });
+        }
+
+        /// Distance to the closest source, DBL_MAX if the node was not reached.
+        double dist(NodeID n) const { return reached(n) ? reached_dist(n) : DBL_MAX; }
+
+        /// Predecessor on the shortest path, InvalidNodeID for sources and nodes not reached.
+        NodeID pred(NodeID n) const { return reached(n) ? reached_pred(n) : AMGraph::InvalidNodeID; }
+
+        /// Label of the closest source, InvalidNodeID for nodes not reached.
+        NodeID source(NodeID n) const { return reached(n) ? reached_source(n) : AMGraph::InvalidNodeID; }
+
+        /// The settled nodes in order of increasing distance.
+        const std::vector<NodeID>& order() const { return settled; }
+
+        /// The distances as an attribute vector with N entries. Nodes not reached get DBL_MAX.
+        Util::AttribVec<NodeID, double> dist_attrib(size_t N) const {
+            Util::AttribVec<NodeID, double> d(N, DBL_MAX);
+            for (NodeID n = 0; n < N; ++n)
+                d[n] = dist(n);
+            return d;
+        }
+    };
+
+    /// Distances from the given sources to all nodes of g. Nodes which cannot be reached get DBL_MAX.
+    template<typename GraphT>
+    Util::AttribVec<AMGraph::NodeID, double> shortest_path_distances(const GraphT& g,
+                                                                     const std::vector<AMGraph::NodeID>& sources) {
+        ShortestPaths sp;
+        sp.reset(g.no_nodes());
+        for (auto n: sources)
+            sp.add_source(n);
+        sp.run(g);
+        return sp.dist_attrib(g.no_nodes());
+    }
+}
+
+#endif /* ShortestPaths_h */
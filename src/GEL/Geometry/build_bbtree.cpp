@@ -95,4 +95,9 @@ namespace Geometry
         build_tree_robust<AABBTree>(m, tree);
     }
 
+    void build_BVH(HMesh::Manifold& m, BVH& bvh)
+    {
+        build_tree_robust<BVH>(m, bvh);
+    }
+
 }
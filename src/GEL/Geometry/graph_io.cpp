@@ -6,9 +6,20 @@
 //  Copyright © 2020 J. Andreas Bærentzen. All rights reserved.
 //
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <GEL/CGLA/CGLA.h>
 #include <GEL/Geometry/KDTree.h>
@@ -18,6 +29,7 @@
 #include <GEL/Geometry/graph_util.h>
 #include <GEL/Geometry/graph_io.h>
 #include <GEL/Geometry/rply.h>
+#include <GEL/Util/Parallel.h>
 
 using namespace CGLA;
 using namespace HMesh;
@@ -27,89 +39,734 @@ namespace Geometry {
     using NodeID = AMGraph::NodeID;
     using NodeSet = AMGraph::NodeSet;
 
+    namespace {
+
+        const char BINARY_GRAPH_MAGIC[8] = {'G','E','L','G','R','A','P','H'};
+
+        struct BinaryGraphHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t flags;
+            uint64_t no_nodes;
+            uint64_t no_adjacencies;
+        };
+        static_assert(sizeof(BinaryGraphHeader) == 32, "The binary graph header must be 32 bytes.");
+        static_assert(sizeof(Vec3d) == 3*sizeof(double), "Vec3d must be three packed doubles.");
+        static_assert(sizeof(NodeID) == 8 && sizeof(size_t) == 8, "Binary graphs need 64 bit ids.");
+
+        /** Call line_fun(b, e) for each line of the file where [b, e) is the line without the newline. The file is
+         read in large chunks, so that we neither create a stream per line nor need the whole file in memory. */
+        template<typename LineFun>
+        bool for_each_line(const string& file_name, LineFun&& line_fun) {
+            ifstream ifs(file_name, ios::binary);
+            if(!ifs)
+                return false;
+            const size_t CHUNK_SIZE = 1 << 24;
+            vector<char> buf;
+            size_t carry = 0;
+            for(;;) {
+                buf.resize(carry + CHUNK_SIZE + 1);
+                ifs.read(buf.data() + carry, CHUNK_SIZE);
+                const size_t n_read = ifs.gcount();
+                const bool at_end = n_read < CHUNK_SIZE;
+                const char* c = buf.data();
+                const char* end = c + carry + n_read;
+                buf[carry + n_read] = '\0';
+                while(c < end) {
+                    const char* eol = static_cast<const char*>(memchr(c, '\n', end-c));
+                    if(eol == nullptr) {
+                        if(!at_end)
+                            break;
+                        eol = end;
+                    }
+                    // Null terminate the line, so strtod and friends cannot run past it.
+                    *const_cast<char*>(eol) = '\0';
+                    line_fun(c, eol);
+                    c = eol+1;
+                }
+                if(at_end)
+                    return true;
+                // Move the incomplete last line to the front of the buffer.
+                carry = end - c;
+                memmove(buf.data(), c, carry);
+            }
+        }
+
+        /** Parse up to max_n numbers from the line starting at c. Returns the number of numbers parsed. */
+        int parse_numbers(const char* c, double* v, int max_n) {
+            int i = 0;
+            for(; i<max_n; ++i) {
+                char* next;
+                v[i] = strtod(c, &next);
+                if(next == c)
+                    break;
+                c = next;
+            }
+            return i;
+        }
+
+        /// A named attribute as it is read from or written to a file.
+        struct AttributeArray {
+            string name;
+            bool per_edge = false;
+            vector<double> values;
+        };
+
+        /** Read the text graph format calling node_fun(p, r) for each node, where r points to the radius or is null,
+         edge_fun(n0, n1) for each connection, and attrib_fun(a) for each named attribute. */
+        template<typename NodeFun, typename EdgeFun, typename AttribFun>
+        bool parse_text_graph(const string& file_name, NodeFun&& node_fun, EdgeFun&& edge_fun, AttribFun&& attrib_fun) {
+            return for_each_line(file_name, [&](const char* c, const char* eol) {
+                if(c[0] == 'a' && (c[1] == 'n' || c[1] == 'e')) {
+                    AttributeArray a;
+                    a.per_edge = c[1] == 'e';
+                    const char* b = c+2;
+                    while(b < eol && isspace(*b))
+                        ++b;
+                    const char* e = b;
+                    while(e < eol && !isspace(*e))
+                        ++e;
+                    a.name.assign(b, e);
+                    for(;;) {
+                        char* next;
+                        double v = strtod(e, &next);
+                        if(next == e)
+                            break;
+                        a.values.push_back(v);
+                        e = next;
+                    }
+                    if(!a.name.empty())
+                        attrib_fun(std::move(a));
+                }
+                else if(*c == 'n') {
+                    double v[4];
+                    int i = parse_numbers(c+1, v, 4);
+                    if(i>=3)
+                        node_fun(Vec3d(v[0],v[1],v[2]), i==4 ? &v[3] : nullptr);
+                }
+                else if(*c == 'c') {
+                    char* next;
+                    long n0 = strtol(c+1, &next, 10);
+                    long n1 = strtol(next, &next, 10);
+                    edge_fun(NodeID(n0), NodeID(n1));
+                }
+            });
+        }
+
+        int point_cb(p_ply_argument argument) {
+            void* pdata;
+            int coord;
+            ply_get_argument_user_data(argument, &pdata, &coord);
+            auto& pts = *static_cast<vector<Vec3d>*>(pdata);
+            if(coord == 0)
+                pts.push_back(Vec3d(0));
+            pts.back()[coord] = ply_get_argument_value(argument);
+            return 1;
+        }
+
+        /// Write zeros until the file position is a multiple of 8.
+        void pad_to_8(ofstream& ofs, size_t written) {
+            const char zeros[8] = {};
+            ofs.write(zeros, (8 - written % 8) % 8);
+        }
+
+        /** Write the binary graph format. The arrays are written as they are. radius and color may be null.
+         The values of edge attributes must be stored per adjacency. */
+        bool write_binary_graph(const string& file_name, const vector<Vec3d>& pos, const vector<size_t>& offsets,
+                                const vector<NodeID>& nbrs, const vector<double>* radius, const vector<float>* color,
+                                const vector<AttributeArray>& attribs) {
+            ofstream ofs(file_name, ios::binary);
+            if(!ofs)
+                return false;
+            BinaryGraphHeader header;
+            memcpy(header.magic, BINARY_GRAPH_MAGIC, 8);
+            header.version = MappedGraph::VERSION;
+            header.flags = (radius ? MappedGraph::HAS_RADIUS : 0) | (color ? MappedGraph::HAS_COLOR : 0) |
+                           (attribs.empty() ? 0 : MappedGraph::HAS_ATTRIBUTES);
+            header.no_nodes = pos.size();
+            header.no_adjacencies = nbrs.size();
+
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            ofs.write(reinterpret_cast<const char*>(pos.data()), pos.size() * sizeof(Vec3d));
+            ofs.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(size_t));
+            ofs.write(reinterpret_cast<const char*>(nbrs.data()), nbrs.size() * sizeof(NodeID));
+            if(radius)
+                ofs.write(reinterpret_cast<const char*>(radius->data()), radius->size() * sizeof(double));
+            if(color)
+                ofs.write(reinterpret_cast<const char*>(color->data()), color->size() * sizeof(float));
+            if(!attribs.empty()) {
+                // Only the colors can leave the position unaligned.
+                pad_to_8(ofs, color ? color->size() * sizeof(float) : 0);
+                const uint64_t count = attribs.size();
+                ofs.write(reinterpret_cast<const char*>(&count), sizeof(count));
+                for(const auto& a: attribs) {
+                    const uint32_t kind = a.per_edge ? 1 : 0;
+                    const uint32_t len = a.name.size();
+                    ofs.write(reinterpret_cast<const char*>(&kind), sizeof(kind));
+                    ofs.write(reinterpret_cast<const char*>(&len), sizeof(len));
+                    ofs.write(a.name.data(), len);
+                    pad_to_8(ofs, len);
+                    ofs.write(reinterpret_cast<const char*>(a.values.data()), a.values.size() * sizeof(double));
+                }
+            }
+            return bool(ofs);
+        }
+
+        /// In the text format an attribute name is a single token, so it can neither be empty nor contain white space.
+        bool is_text_attribute_name(const string& name) {
+            return !name.empty() && none_of(name.begin(), name.end(), [](unsigned char c) { return isspace(c); });
+        }
+
+        /** Write the named attributes of g in the text format. edge_order lists the edges in the
+         order of the 'c' lines. */
+        void write_text_attributes(ostream& os, const AMGraph3D& g, const vector<AMGraph::EdgeID>& edge_order) {
+            for(const auto& [name, attr]: g.node_attributes) {
+                os << "an " << name;
+                for(auto n: g.node_ids())
+                    os << " " << attr[n];
+                os << '\n';
+            }
+            for(const auto& [name, attr]: g.edge_attributes) {
+                os << "ae " << name;
+                for(auto e: edge_order)
+                    os << " " << attr[e];
+                os << '\n';
+            }
+        }
+
+        /** Connect each node n of g to the nodes nbrs[offsets[n]] up to nbrs[offsets[n+1]]. The edges and their ids
+         are the same as if connect_nodes was called for each node and neighbor in order, but the edges are inserted
+         in bulk. */
+        void connect_neighbor_lists(AMGraph3D& g, const vector<size_t>& offsets, const vector<NodeID>& nbrs) {
+            const size_t N = g.no_nodes();
+            auto listed = [&](NodeID n, NodeID m, size_t end) {
+                return find(nbrs.begin() + offsets[n], nbrs.begin() + end, m) != nbrs.begin() + end;
+            };
+
+            // The serial algorithm would create the edge between n and m at the first of the two nodes whose
+            // list contains the other. Mark the entries that create an edge.
+            vector<uint8_t> creates(nbrs.size());
+            Util::parallel_for(N, [&](size_t n, unsigned int) {
+                for(size_t k = offsets[n]; k < offsets[n+1]; ++k) {
+                    const NodeID m = nbrs[k];
+                    creates[k] = m != n && !listed(n, m, k) && (m > n || !listed(m, n, offsets[m+1]));
+                }
+            }, 1024);
+
+            // Store each new edge at both of its nodes with ids in creation order, and sort the lists of the
+            // nodes by neighbor.
+            size_t E = 0;
+            vector<size_t> adj_offsets(N+1, 0);
+            for(size_t n = 0; n < N; ++n)
+                for(size_t k = offsets[n]; k < offsets[n+1]; ++k)
+                    if(creates[k]) {
+                        ++adj_offsets[n+1];
+                        ++adj_offsets[nbrs[k]+1];
+                        ++E;
+                    }
+            for(size_t n = 0; n < N; ++n)
+                adj_offsets[n+1] += adj_offsets[n];
+            vector<pair<NodeID, AMGraph::EdgeID>> adj(2*E);
+            vector<size_t> fill(adj_offsets.begin(), adj_offsets.end() - 1);
+            AMGraph::EdgeID e = g.no_edges();
+            for(size_t n = 0; n < N; ++n)
+                for(size_t k = offsets[n]; k < offsets[n+1]; ++k)
+                    if(creates[k]) {
+                        const NodeID m = nbrs[k];
+                        adj[fill[n]++] = {m, e};
+                        adj[fill[m]++] = {NodeID(n), e};
+                        ++e;
+                    }
+            Util::parallel_for(N, [&](size_t n, unsigned int) {
+                sort(adj.begin() + adj_offsets[n], adj.begin() + adj_offsets[n+1]);
+            }, 1024);
+
+            g.connect_nodes_bulk(adj_offsets, adj, E);
+        }
+
+        bool ends_with(const string& str, const string& suffix) {
+            return str.size() >= suffix.size() && str.compare(str.size()-suffix.size(), suffix.size(), suffix) == 0;
+        }
+    }
+
+    MappedGraph::MappedGraph(const string& file_name) {
+#ifdef _WIN32
+        ifstream ifs(file_name, ios::binary | ios::ate);
+        if(!ifs)
+            return;
+        buffer.resize(ifs.tellg());
+        ifs.seekg(0);
+        ifs.read(buffer.data(), buffer.size());
+        data = buffer.data();
+        data_size = buffer.size();
+#else
+        int fd = open(file_name.c_str(), O_RDONLY);
+        if(fd < 0)
+            return;
+        struct stat st;
+        if(fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(addr != MAP_FAILED) {
+                data = static_cast<const char*>(addr);
+                data_size = st.st_size;
+                mapped = true;
+            }
+        }
+        close(fd);
+#endif
+        if(data && !parse()) {
+            N = 0;
+            flags = 0;
+            pos_ptr = nullptr;
+            offsets_ptr = nullptr;
+            nbrs_ptr = nullptr;
+            radius_ptr = nullptr;
+            color_ptr = nullptr;
+            attribs.clear();
+        }
+    }
+
+    MappedGraph::~MappedGraph() {
+#ifndef _WIN32
+        if(mapped)
+            munmap(const_cast<char*>(data), data_size);
+#endif
+    }
+
+    bool MappedGraph::parse() {
+        if(data_size < sizeof(BinaryGraphHeader))
+            return false;
+        BinaryGraphHeader header;
+        memcpy(&header, data, sizeof(header));
+        if(memcmp(header.magic, BINARY_GRAPH_MAGIC, 8) != 0 || header.version > VERSION)
+            return false;
+
+        // Bound the counts by the file size first, so that computing the required size cannot overflow.
+        if(header.no_nodes > data_size / (sizeof(Vec3d) + sizeof(size_t)) ||
+           header.no_adjacencies > data_size / sizeof(NodeID))
+            return false;
+        N = header.no_nodes;
+        flags = header.flags;
+        const size_t A = header.no_adjacencies;
+        size_t required = sizeof(header) + N*sizeof(Vec3d) + (N+1)*sizeof(size_t) + A*sizeof(NodeID);
+        if(flags & HAS_RADIUS)
+            required += N*sizeof(double);
+        if(flags & HAS_COLOR)
+            required += 3*N*sizeof(float);
+        if(data_size < required)
+            return false;
+
+        const char* p = data + sizeof(header);
+        pos_ptr = reinterpret_cast<const Vec3d*>(p);
+        p += N*sizeof(Vec3d);
+        offsets_ptr = reinterpret_cast<const size_t*>(p);
+        p += (N+1)*sizeof(size_t);
+        nbrs_ptr = reinterpret_cast<const NodeID*>(p);
+        p += A*sizeof(NodeID);
+        if(flags & HAS_RADIUS) {
+            radius_ptr = reinterpret_cast<const double*>(p);
+            p += N*sizeof(double);
+        }
+        if(flags & HAS_COLOR) {
+            color_ptr = reinterpret_cast<const float*>(p);
+            p += 3*N*sizeof(float);
+        }
+
+        // The offsets must be increasing and stay within the neighbor array, and the neighbors must be valid
+        // node ids. Otherwise neighbor lookups and the graphs built from the mapping could go out of bounds.
+        if(offsets_ptr[0] != 0 || offsets_ptr[N] != A)
+            return false;
+        for(size_t n = 0; n < N; ++n)
+            if(offsets_ptr[n] > offsets_ptr[n+1])
+                return false;
+        for(size_t k = 0; k < A; ++k)
+            if(nbrs_ptr[k] >= N)
+                return false;
+
+        if(flags & HAS_ATTRIBUTES) {
+            const char* end = data + data_size;
+            auto align = [&](size_t k) { return (k + 7) / 8 * 8; };
+            p = data + align(p - data);
+            uint64_t count;
+            if(end - p < 8)
+                return false;
+            memcpy(&count, p, 8);
+            p += 8;
+            for(uint64_t i = 0; i < count; ++i) {
+                uint32_t kind, len;
+                if(end - p < 8)
+                    return false;
+                memcpy(&kind, p, 4);
+                memcpy(&len, p+4, 4);
+                p += 8;
+                const size_t no_values = kind == 1 ? A : N;
+                if(kind > 1 || size_t(end - p) < align(len) + no_values*sizeof(double))
+                    return false;
+                Attribute a;
+                a.name.assign(p, len);
+                a.per_edge = kind == 1;
+                p += align(len);
+                a.values = reinterpret_cast<const double*>(p);
+                p += no_values*sizeof(double);
+                attribs.push_back(std::move(a));
+            }
+        }
+        return true;
+    }
+
+    AMGraph3D MappedGraph::to_graph() const {
+        AMGraph3D g;
+        if(!is_valid())
+            return g;
+        for(const auto& a: attribs)
+            if(a.per_edge)
+                g.add_edge_attribute(a.name);
+            else
+                g.add_node_attribute(a.name);
+        for(NodeID n = 0; n < N; ++n) {
+            g.add_node(pos(n));
+            if(has_color())
+                g.node_color[n] = color(n);
+            if(has_radius())
+                g.node_radius[n] = radius(n);
+        }
+        for(const auto& a: attribs)
+            if(!a.per_edge) {
+                auto& attr = g.node_attributes[a.name];
+                for(NodeID n = 0; n < N; ++n)
+                    attr[n] = a.values[n];
+            }
+        for(NodeID n = 0; n < N; ++n)
+            for(size_t k = offsets_ptr[n]; k < offsets_ptr[n+1]; ++k)
+                if(n <= nbrs_ptr[k]) {
+                    auto e = g.connect_nodes(n, nbrs_ptr[k]);
+                    if(g.valid_edge_id(e))
+                        for(const auto& a: attribs)
+                            if(a.per_edge)
+                                g.edge_attributes[a.name][e] = a.values[k];
+                }
+        return g;
+    }
+
+    CSRGraph3D MappedGraph::to_csr_graph() const {
+        if(!is_valid())
+            return CSRGraph3D();
+        return CSRGraph3D(N, pos_ptr, offsets_ptr, nbrs_ptr);
+    }
+
+    bool is_binary_graph_file(const string& file_name) {
+        ifstream ifs(file_name, ios::binary);
+        char magic[8];
+        return ifs.read(magic, 8) && memcmp(magic, BINARY_GRAPH_MAGIC, 8) == 0;
+    }
+
     AMGraph3D graph_load(const string& file_name) {
-        ifstream ifs(file_name);
+        if(is_binary_graph_file(file_name)) {
+            MappedGraph mg(file_name);
+            if(!mg.is_valid())
+                return AMGraph3D();
+            return mg.to_graph();
+        }
         AMGraph3D g;
-        while(ifs) {
-            string str;
-            getline(ifs, str);
-            istringstream istr(str);
-            char c;
-            if(str[0] == 'n') {
-                double x,y,z;
-                istr >> c >> x >> y >> z;
-                NodeID n = g.add_node(Vec3d(x,y,z));
-                if(double r; istr >> r)
-                    g.node_color[n][1] = r;
+        vector<AMGraph::EdgeID> line_edges;
+        vector<AttributeArray> attribs;
+        parse_text_graph(file_name,
+                         [&](const Vec3d& p, const double* r) {
+                             NodeID n = g.add_node(p);
+                             if(r)
+                                 g.node_radius[n] = *r;
+                         },
+                         [&](NodeID n0, NodeID n1) { line_edges.push_back(g.connect_nodes(n0, n1)); },
+                         [&](AttributeArray&& a) { attribs.push_back(std::move(a)); });
+
+        // The attributes are applied last, since edge attributes refer to the edges of all 'c' lines.
+        for(const auto& a: attribs)
+            if(a.per_edge) {
+                auto& attr = g.add_edge_attribute(a.name);
+                for(size_t k = 0; k < min(a.values.size(), line_edges.size()); ++k)
+                    if(g.valid_edge_id(line_edges[k]))
+                        attr[line_edges[k]] = a.values[k];
             }
-            else if(str[0] == 'c') {
-                int n0, n1;
-                istr >> c >> n0 >> n1;
-                g.connect_nodes(n0, n1);
+            else {
+                auto& attr = g.add_node_attribute(a.name);
+                for(NodeID n = 0; n < min(a.values.size(), g.no_nodes()); ++n)
+                    attr[n] = a.values[n];
             }
-        }
         return g;
     }
 
     bool graph_save(const string& file_name, const Geometry::AMGraph3D& g) {
+        if(ends_with(file_name, ".bgraph"))
+            return graph_save_binary(file_name, g);
+
+        for(const auto& [name, attr]: g.node_attributes)
+            if(!is_text_attribute_name(name))
+                return false;
+        for(const auto& [name, attr]: g.edge_attributes)
+            if(!is_text_attribute_name(name))
+                return false;
+
         ofstream ofs(file_name);
         
         if(ofs) {
+            ofs.precision(numeric_limits<double>::max_digits10);
+            bool has_radius = false;
             for(auto n: g.node_ids())
-                ofs << "n " << g.pos[n][0] << " " << g.pos[n][1] << " "<< g.pos[n][2] << " "<< endl;
+                has_radius = has_radius || g.node_radius[n] != 0.0;
+            for(auto n: g.node_ids()) {
+                ofs << "n " << g.pos[n][0] << " " << g.pos[n][1] << " "<< g.pos[n][2] << " ";
+                if(has_radius)
+                    ofs << g.node_radius[n];
+                ofs << '\n';
+            }
             
-            for(auto n: g.node_ids())
-                for(auto m: g.neighbors(n))
-                    if (n < m)
-                        ofs << "c " << n << " " << m << endl;
+            vector<AMGraph::EdgeID> edge_order;
+            for(NodeID n: g.node_ids())
+                for(const auto& [m, e]: g.edges(n))
+                    if (n < m) {
+                        ofs << "c " << n << " " << m << '\n';
+                        edge_order.push_back(e);
+                    }
+            write_text_attributes(ofs, g, edge_order);
             return true;
         }
         return false;
     }
 
-    AMGraph3D graph_from_points(const string& file_name, double rad, int N_closest)
-    {
-        AMGraph3D g;
-        srand(0);
-        ifstream f(file_name.c_str());
-        string str;
-        getline(f, str);
-        getline(f, str);
-
-    //    ofstream ptsout("/Users/andreas/3DModels/TreeScan/wto.txt");
-        while(f) {
-            string str;
-            getline(f, str);
-            istringstream istr(str);
-            double x,y,z;
-            istr >> x >> y >> z;
-            if(1) {
-                Vec3d p = Vec3d(x,y,z);
-                if(!std::isnan(p[0])) {
-                    g.add_node(p);
+    bool graph_save_binary(const string& file_name, const AMGraph3D& g) {
+        const size_t N = g.no_nodes();
+        vector<Vec3d> pos(N);
+        vector<size_t> offsets(N+1, 0);
+        vector<NodeID> nbrs;
+        vector<double> radius(N);
+        vector<float> color;
+        bool has_radius = false;
+        bool has_color = false;
+        for(auto n: g.node_ids()) {
+            pos[n] = g.pos[n];
+            radius[n] = g.node_radius[n];
+            offsets[n+1] = offsets[n] + g.valence(n);
+            has_radius = has_radius || radius[n] != 0.0;
+            has_color = has_color || g.node_color[n] != Vec3f(0);
+        }
+        nbrs.reserve(offsets[N]);
+        for(auto n: g.node_ids())
+            for(const auto& [m, e]: g.edges(n))
+                nbrs.push_back(m);
+        if(has_color) {
+            color.reserve(3*N);
+            for(auto n: g.node_ids())
+                for(int i=0;i<3;++i)
+                    color.push_back(g.node_color[n][i]);
+        }
+        vector<AttributeArray> attribs;
+        for(const auto& [name, attr]: g.node_attributes) {
+            attribs.push_back({name, false, vector<double>(N)});
+            for(auto n: g.node_ids())
+                attribs.back().values[n] = attr[n];
+        }
+        for(const auto& [name, attr]: g.edge_attributes) {
+            attribs.push_back({name, true, {}});
+            attribs.back().values.reserve(offsets[N]);
+            for(auto n: g.node_ids())
+                for(const auto& [m, e]: g.edges(n))
+                    attribs.back().values.push_back(attr[e]);
+        }
+        return write_binary_graph(file_name, pos, offsets, nbrs, has_radius ? &radius : nullptr,
+                                  has_color ? &color : nullptr, attribs);
+    }
+
+    bool graph_text_to_binary(const string& text_file_name, const string& binary_file_name) {
+        vector<Vec3d> pos;
+        vector<double> radius;
+        vector<pair<NodeID, NodeID>> edges;
+        vector<AttributeArray> attribs;
+        bool has_radius = false;
+        bool ok = parse_text_graph(text_file_name,
+                                   [&](const Vec3d& p, const double* r) {
+                                       pos.push_back(p);
+                                       radius.push_back(r ? *r : 0.0);
+                                       has_radius = has_radius || r;
+                                   },
+                                   [&](NodeID n0, NodeID n1) { edges.push_back({n0, n1}); },
+                                   [&](AttributeArray&& a) { attribs.push_back(std::move(a)); });
+        if(!ok)
+            return false;
+
+        // Bucket the edges by node, counting first and then filling. Invalid edges are dropped.
+        // Each adjacency remembers the line of its edge, so edge attributes can be looked up.
+        const size_t N = pos.size();
+        vector<size_t> offsets(N+1, 0);
+        for(const auto& [n0, n1]: edges)
+            if(n0 < N && n1 < N) {
+                ++offsets[n0+1];
+                if(n0 != n1)
+                    ++offsets[n1+1];
+            }
+        for(size_t n = 0; n < N; ++n)
+            offsets[n+1] += offsets[n];
+        vector<pair<NodeID, size_t>> adj(offsets[N]);
+        vector<size_t> fill(offsets.begin(), offsets.end()-1);
+        for(size_t k = 0; k < edges.size(); ++k) {
+            const auto [n0, n1] = edges[k];
+            if(n0 < N && n1 < N) {
+                adj[fill[n0]++] = {n1, k};
+                if(n0 != n1)
+                    adj[fill[n1]++] = {n0, k};
+            }
+        }
+
+        // Sort the neighbors of each node and remove duplicate edges while compacting the array. As when
+        // loading a graph, the first line of a duplicated edge is the one that counts.
+        size_t dst = 0;
+        for(size_t n = 0; n < N; ++n) {
+            auto b = adj.begin() + offsets[n];
+            auto e = adj.begin() + offsets[n+1];
+            sort(b, e);
+            e = unique(b, e, [](const auto& a0, const auto& a1) { return a0.first == a1.first; });
+            offsets[n] = dst;
+            dst = copy(b, e, adj.begin() + dst) - adj.begin();
+        }
+        offsets[N] = dst;
+        adj.resize(dst);
+        vector<NodeID> nbrs(dst);
+        for(size_t k = 0; k < dst; ++k)
+            nbrs[k] = adj[k].first;
+
+        for(auto& a: attribs) {
+            vector<double> values(a.per_edge ? dst : N, 0.0);
+            for(size_t k = 0; k < values.size(); ++k) {
+                const size_t src = a.per_edge ? adj[k].second : k;
+                if(src < a.values.size())
+                    values[k] = a.values[src];
+            }
+            a.values = std::move(values);
+        }
+
+        return write_binary_graph(binary_file_name, pos, offsets, nbrs, has_radius ? &radius : nullptr, nullptr,
+                                  attribs);
+    }
+
+    bool graph_binary_to_text(const string& binary_file_name, const string& text_file_name) {
+        MappedGraph mg(binary_file_name);
+        if(!mg.is_valid())
+            return false;
+        for(const auto& a: mg.attributes())
+            if(!is_text_attribute_name(a.name))
+                return false;
+        ofstream ofs(text_file_name);
+        if(!ofs)
+            return false;
+        ofs.precision(numeric_limits<double>::max_digits10);
+        for(NodeID n = 0; n < mg.no_nodes(); ++n) {
+            const Vec3d& p = mg.pos(n);
+            ofs << "n " << p[0] << " " << p[1] << " " << p[2] << " ";
+            if(mg.has_radius())
+                ofs << mg.radius(n);
+            ofs << '\n';
+        }
+        // The adjacencies of the 'c' lines in order, so we can write the edge attributes.
+        vector<size_t> edge_adjacencies;
+        size_t adj_idx = 0;
+        for(NodeID n = 0; n < mg.no_nodes(); ++n)
+            for(auto m: mg.neighbors(n)) {
+                if(n < m) {
+                    ofs << "c " << n << " " << m << '\n';
+                    edge_adjacencies.push_back(adj_idx);
                 }
-                else
-                    cout << "nan node not inserted in graph: "  << endl;
+                ++adj_idx;
             }
+        for(const auto& a: mg.attributes()) {
+            ofs << (a.per_edge ? "ae " : "an ") << a.name;
+            if(a.per_edge)
+                for(auto k: edge_adjacencies)
+                    ofs << " " << a.values[k];
+            else
+                for(NodeID n = 0; n < mg.no_nodes(); ++n)
+                    ofs << " " << a.values[n];
+            ofs << '\n';
         }
-        
-        KDTree<Vec3d, AMGraph3D::NodeID> tree;
-        for(auto n : g.node_ids()) {
-            Vec3d p = g.pos[n];
-            if(std::isnan(p[0]))
-                cout << "nan node inserted in tree: " << n << endl;
-            tree.insert(g.pos[n], n);
+        return bool(ofs);
+    }
+
+    vector<Vec3d> load_points(const string& file_name) {
+        vector<Vec3d> pts;
+        const string ext = file_name.size() >= 4 ? file_name.substr(file_name.size()-4) : "";
+        if(ext == ".ply") {
+            p_ply ply = ply_open(file_name.c_str(), NULL);
+            if(!ply)
+                return pts;
+            if(ply_read_header(ply)) {
+                long N = ply_set_read_cb(ply, "vertex", "x", point_cb, &pts, 0);
+                ply_set_read_cb(ply, "vertex", "y", point_cb, &pts, 1);
+                ply_set_read_cb(ply, "vertex", "z", point_cb, &pts, 2);
+                pts.reserve(N);
+                ply_read(ply);
+            }
+            ply_close(ply);
         }
-        
+        else if(ext == ".off") {
+            // The OFF keyword is followed by the counts - sometimes on the same line - and then the vertices.
+            enum { HEADER, COUNTS, VERTICES } state = HEADER;
+            size_t no_vertices = 0;
+            for_each_line(file_name, [&](const char* c, const char*) {
+                if(*c == '#')
+                    return;
+                double v[3];
+                switch(state) {
+                    case HEADER:
+                        c += strcspn(c, " \t\r");
+                        state = COUNTS;
+                        [[fallthrough]];
+                    case COUNTS:
+                        if(parse_numbers(c, v, 1) == 1) {
+                            no_vertices = size_t(v[0]);
+                            pts.reserve(no_vertices);
+                            state = VERTICES;
+                        }
+                        break;
+                    case VERTICES:
+                        if(pts.size() < no_vertices && parse_numbers(c, v, 3) == 3)
+                            pts.push_back(Vec3d(v[0],v[1],v[2]));
+                        break;
+                }
+            });
+        }
+        else {
+            for_each_line(file_name, [&](const char* c, const char*) {
+                double v[3];
+                if(parse_numbers(c, v, 3) == 3)
+                    pts.push_back(Vec3d(v[0],v[1],v[2]));
+            });
+        }
+        return pts;
+    }
+
+    AMGraph3D graph_from_points(const string& file_name, double rad, int N_closest)
+    {
+        return graph_from_points(load_points(file_name), rad, N_closest);
+    }
+
+    AMGraph3D graph_from_points(const vector<Vec3d>& pts, double rad, int N_closest)
+    {
+        AMGraph3D g;
+        KDTree<Vec3d, AMGraph3D::NodeID> tree;
+        for(const auto& p: pts)
+            if(!std::isnan(p[0]))
+                tree.insert(p, g.add_node(p));
         tree.build();
-        cout << "Connecting nodes ..." << endl;
+
+        // The neighbors of all points are found in one batch query which runs in parallel.
+        vector<Vec3d> query_pts(g.no_nodes());
         for(auto n : g.node_ids())
-        {
-            auto nbors = tree.m_closest(N_closest, g.pos[n], rad);
-            for(const auto& nn: nbors)
-                if(nn.v != n)
-                    g.connect_nodes(n, nn.v);
-        }
+            query_pts[n] = g.pos[n];
+        // Only the neighbor ids are kept, so this takes no more memory than N_closest ids per point.
+        vector<size_t> offsets;
+        vector<NodeID> nbr_ids;
+        tree.m_closest_values(max(N_closest, 0), query_pts, rad, offsets, nbr_ids);
+        query_pts = vector<Vec3d>();
+
+        connect_neighbor_lists(g, offsets, nbr_ids);
         
 //        int cnt = 0;
 //        cout << "Disconnecting nodes ..." << endl;
@@ -212,7 +869,7 @@ namespace Geometry {
         for(auto n: g.node_ids())
             if(g.valid_node_id(n)) {
                 Vec3d p = g.pos[n];
-                double r = g.node_color[n][1];
+                double r = g.node_radius[n];
                 rad_max = max(r, rad_max);
                 if(!std::isnan(p[0])) {
                     pmin = v_min(p, pmin);
@@ -226,30 +883,77 @@ namespace Geometry {
         double long_side = ratios.max_coord();
         ratios /= long_side;
         Vec3i dim = Vec3i(double(grid_res)*ratios);
-        RGrid<float> grid(dim,1e32);
+        HGrid<float> grid(dim,1e32);
         XForm xform(pmin, pmax, dim, 0.05);
 
-        for(auto n : g.node_ids()) if (g.in_use(n)) {
+        // The voxel box around each edge. Only voxels within such a box receive a distance.
+        struct EdgeBox {
+            NodeID n, m;
+            float rad_n, rad_m;
+            Vec3i lo, hi;
+        };
+        vector<EdgeBox> boxes;
+        for(NodeID n : g.node_ids()) if (g.in_use(n)) {
             for(auto m : g.neighbors(n))
                 if(n<m) {
-                    LineSegment ls(g.pos[n], g.pos[m]);
-                    float rad_n = g.node_color[n][1] + fudge;
-                    float rad_m = g.node_color[m][1] + fudge;
+                    float rad_n = g.node_radius[n] + fudge;
+                    float rad_m = g.node_radius[m] + fudge;
                     float rad_upper = 1.5*max(rad_n,rad_m);
                     Vec3d bbmin = v_min(g.pos[n],g.pos[m])-Vec3d(rad_upper);
                     Vec3d bbmax = v_max(g.pos[n],g.pos[m])+Vec3d(rad_upper);
                     Vec3i bbmin_i = v_min(dim - Vec3i(1), v_max(Vec3i(0), Vec3i(xform.apply(bbmin))));
                     Vec3i bbmax_i = v_min(dim - Vec3i(1), v_max(Vec3i(0), Vec3i(xform.apply(bbmax))));
-
-                    for(Vec3i pi: Range3D(bbmin_i,bbmax_i))  {
-                        Vec3d p = xform.inverse(Vec3d(pi));
-                        auto lp = ls.sqr_distance(p);
-                        auto t = smooth_step(0.0, 1.0, lp.t);
-                        float rad = rad_n * (1.0 - t) + rad_m * t;
-                        grid[pi] = min(grid[pi],float(sqrt(lp.sqr_dist)-rad));
-                    }
+                    boxes.push_back({NodeID(n), m, rad_n, rad_m, bbmin_i, bbmax_i});
                 }
         }
+
+        // Bin the edges by the cells of the grid that their boxes overlap.
+        const int B = grid.get_bottom_dim();
+        const Vec3i top_dims = grid.get_top_dims();
+        auto cell_index = [&](const Vec3i& ti) { return (size_t(ti[2])*top_dims[1]+ti[1])*top_dims[0]+ti[0]; };
+        vector<size_t> offsets(size_t(top_dims[0])*top_dims[1]*top_dims[2]+1, 0);
+        auto for_each_cell_of = [&](const EdgeBox& eb, auto&& f) {
+            for(Vec3i ti: Range3D(eb.lo/B, (eb.hi-Vec3i(1))/B+Vec3i(1)))
+                f(cell_index(ti));
+        };
+        auto nonempty = [](const Vec3i& lo, const Vec3i& hi) { return lo[0]<hi[0] && lo[1]<hi[1] && lo[2]<hi[2]; };
+        for(const auto& eb: boxes)
+            if(nonempty(eb.lo, eb.hi))
+                for_each_cell_of(eb, [&](size_t c) { ++offsets[c+1]; });
+        vector<size_t> active;
+        for(size_t c=0; c+1<offsets.size(); ++c) {
+            if(offsets[c+1] > 0)
+                active.push_back(c);
+            offsets[c+1] += offsets[c];
+        }
+        vector<size_t> cell_edges(offsets.back());
+        vector<size_t> fill(offsets.begin(), offsets.end()-1);
+        for(size_t i=0; i<boxes.size(); ++i)
+            if(nonempty(boxes[i].lo, boxes[i].hi))
+                for_each_cell_of(boxes[i], [&](size_t c) { cell_edges[fill[c]++] = i; });
+
+        // Each cell is split and filled by a single task, so no two tasks write to the same memory.
+        Util::parallel_for(active.size(), [&](size_t i, unsigned int) {
+            const size_t c = active[i];
+            const Vec3i ti(c % top_dims[0], (c / top_dims[0]) % top_dims[1], c / (size_t(top_dims[0])*top_dims[1]));
+            const Vec3i origin = ti * B;
+            auto& cell = grid.get_cell(ti);
+            cell.split();
+            float* data = cell.get();
+            for(size_t k=offsets[c]; k<offsets[c+1]; ++k) {
+                const EdgeBox& eb = boxes[cell_edges[k]];
+                LineSegment ls(g.pos[eb.n], g.pos[eb.m]);
+                for(Vec3i pi: Range3D(v_max(eb.lo, origin), v_min(eb.hi, origin+Vec3i(B))))  {
+                    Vec3d p = xform.inverse(Vec3d(pi));
+                    auto lp = ls.sqr_distance(p);
+                    auto t = smooth_step(0.0, 1.0, lp.t);
+                    float rad = eb.rad_n * (1.0 - t) + eb.rad_m * t;
+                    const Vec3i li = pi - origin;
+                    float& d = data[(li[2]*B+li[1])*B+li[0]];
+                    d = min(d,float(sqrt(lp.sqr_dist)-rad));
+                }
+            }
+        });
         
 //        GraphDist gd(g);
 //
@@ -269,13 +973,13 @@ namespace Geometry {
 
     void graph_to_mesh_cyl(const AMGraph3D& g, HMesh::Manifold& m, float fudge) {
         m.clear();
-        for(auto n: g.node_ids())
+        for(NodeID n: g.node_ids())
             for(auto nn: g.neighbors(n))
                 if(n<nn)
                 {
                     Vec3d p_n = g.pos[n];
-                    double w0 = g.node_color[n][1] + fudge;
-                    double w1 = g.node_color[nn][1] + fudge;
+                    double w0 = g.node_radius[n] + fudge;
+                    double w1 = g.node_radius[nn] + fudge;
                     Vec3d edge_vec = (g.pos[nn] - g.pos[n]);
                     Vec3d X,Y;
                     orthogonal(normalize(edge_vec), X, Y);
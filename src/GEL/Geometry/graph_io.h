@@ -10,7 +10,9 @@
 #define graph_io_hpp
 
 #include <string>
+#include <vector>
 #include <GEL/Geometry/Graph.h>
+#include <GEL/Geometry/CSRGraph.h>
 #include <GEL/HMesh/HMesh.h>
 
 namespace  Geometry {
@@ -25,6 +27,13 @@ namespace  Geometry {
      - each edge (aka connection) is stored on a line starting with the character 'c' followed by
      two numbers which are interpreted as the indices of the nodes connected by the edge.
      node numbers are assumed to start from 0.
+     - a node line may have a fourth number which is the radius of the node.
+     - a named node attribute is stored on a line starting with "an" followed by the name and a value for
+     each node. Similarly, a named edge attribute is stored on a line starting with "ae" followed by the name
+     and a value for each 'c' line in the order of the 'c' lines.
+
+     If the file starts with the magic string of the binary graph format (see MappedGraph), it is
+     loaded as a binary graph instead.
      */
     AMGraph3D graph_load(const std::string& file_name);
 
@@ -32,20 +41,141 @@ namespace  Geometry {
      @brief Save a graph to a file.
      @param file_name
      
-     The graphs are saved to the same format as described above for the graph_load function.
+     The graphs are saved to the same format as described above for the graph_load function unless
+     the file name ends with ".bgraph" in which case the binary format is used. Since the text format separates
+     the values of a line by white space, attribute names may not be empty or contain white space. If they do, nothing
+     is written to a text file and false is returned.
      */
     bool graph_save(const std::string& file_name, const AMGraph3D& g);
 
+    /**
+     @brief A read-only view of a graph stored in the binary graph format.
+
+     The binary format starts with a 32 byte header: the magic string "GELGRAPH", a 32 bit version number,
+     32 bits of flags, the 64 bit number of nodes, N, and the 64 bit number of adjacencies, A (twice the
+     number of edges). The header is followed by these arrays:
+     - N node positions stored as three doubles each.
+     - N+1 64 bit offsets into the neighbor array. The neighbors of node n are stored from offsets[n] up to offsets[n+1].
+     - A 64 bit neighbor ids, sorted for each node. Every edge is stored for both end points.
+     - N doubles with node radii if the radius flag is set.
+     - N node colors stored as three floats each if the color flag is set.
+     - Named attributes if the attribute flag is set. These start at the next multiple of 8 bytes with a
+     64 bit count. Each attribute then has a 32 bit kind (0 for nodes, 1 for edges), the 32 bit length of
+     the name, the name padded with zeros to a multiple of 8 bytes, and the values as doubles: N values for a
+     node attribute and A values for an edge attribute, where the value of an edge is stored at both of its
+     adjacencies.
+     All numbers are little endian. Since the arrays are stored exactly as they are kept in memory, the file is
+     memory mapped and the accessors read directly from the mapping. Nothing is parsed or copied.
+     */
+    class MappedGraph {
+    public:
+        using NodeID = AMGraph::NodeID;
+
+        static constexpr uint32_t VERSION = 1;
+        static constexpr uint32_t HAS_RADIUS = 1;
+        static constexpr uint32_t HAS_COLOR = 2;
+        static constexpr uint32_t HAS_ATTRIBUTES = 4;
+
+        /// A named attribute stored in the file. values points into the mapping.
+        struct Attribute {
+            std::string name;
+            bool per_edge = false;
+            const double* values = nullptr;
+        };
+
+    private:
+        const char* data = nullptr;
+        size_t data_size = 0;
+        std::vector<char> buffer; // only used where memory mapping is unavailable
+        bool mapped = false;
+
+        size_t N = 0;
+        uint32_t flags = 0;
+        const CGLA::Vec3d* pos_ptr = nullptr;
+        const size_t* offsets_ptr = nullptr;
+        const NodeID* nbrs_ptr = nullptr;
+        const double* radius_ptr = nullptr;
+        const float* color_ptr = nullptr;
+        std::vector<Attribute> attribs;
+
+        bool parse();
+
+    public:
+        /// Map the file. If the file is not a valid binary graph, is_valid returns false afterwards.
+        explicit MappedGraph(const std::string& file_name);
+        ~MappedGraph();
+
+        MappedGraph(const MappedGraph&) = delete;
+        MappedGraph& operator=(const MappedGraph&) = delete;
+
+        /// Returns true if the file was successfully mapped and the contents are consistent.
+        bool is_valid() const { return pos_ptr != nullptr; }
+
+        size_t no_nodes() const { return N; }
+
+        /// Returns the number of adjacencies, i.e. twice the number of edges.
+        size_t no_adjacencies() const { return N > 0 ? offsets_ptr[N] : 0; }
+
+        const CGLA::Vec3d& pos(NodeID n) const { return pos_ptr[n]; }
+
+        /// Sorted ids of the nodes adjacent to n.
+        IDRange<NodeID> neighbors(NodeID n) const {
+            return IDRange<NodeID>(nbrs_ptr + offsets_ptr[n], nbrs_ptr + offsets_ptr[n+1]);
+        }
+
+        bool has_radius() const { return radius_ptr != nullptr; }
+        double radius(NodeID n) const { return radius_ptr[n]; }
+
+        bool has_color() const { return color_ptr != nullptr; }
+        CGLA::Vec3f color(NodeID n) const { return CGLA::Vec3f(color_ptr[3*n], color_ptr[3*n+1], color_ptr[3*n+2]); }
+
+        /** The named attributes. The values of a node attribute are indexed by node id, and the values of an
+         edge attribute are indexed like the neighbor array. */
+        const std::vector<Attribute>& attributes() const { return attribs; }
+
+        /// Create an AMGraph3D from the mapped data including radii, colors and named attributes.
+        AMGraph3D to_graph() const;
+
+        /// Create a CSRGraph3D from the mapped data. This only copies the arrays.
+        CSRGraph3D to_csr_graph() const;
+    };
+
+    /// Returns true if the file begins with the magic string of the binary graph format.
+    bool is_binary_graph_file(const std::string& file_name);
+
+    /// Save a graph in the binary graph format described for MappedGraph.
+    bool graph_save_binary(const std::string& file_name, const AMGraph3D& g);
+
+    /** Convert a graph in the text format to the binary format without constructing an AMGraph3D.
+     Radii given on node lines are stored in the radius array, and named attributes are kept. */
+    bool graph_text_to_binary(const std::string& text_file_name, const std::string& binary_file_name);
+
+    /// Convert a graph in the binary format to the text format. Fails if an attribute name cannot be stored as text.
+    bool graph_binary_to_text(const std::string& binary_file_name, const std::string& text_file_name);
+
+    /**
+     @brief Load a point set from a file.
+     @param file_name
+
+     Files ending in .ply are read with rply (ascii or binary), and only the vertices are used. Files ending in .off are
+     read as OFF files ignoring faces. Any other file is assumed to store a point per line as three numbers possibly followed
+     by more columns; lines that do not start with three numbers are skipped. Text files are read in large chunks, so
+     only the points are held in memory.*/
+    std::vector<CGLA::Vec3d> load_points(const std::string& file_name);
+
     /**
      @brief Load a point set from a file and convert to a graph.
      @param file_name
      @param rad the radius within which we connect two points with an edge
      @param N_closest the maximum number of points which we connect to.
 
-     The points are assumed to be stored in a  very simple text format where each
-     point is stored as three numbers on a separate line.*/
+     The points are loaded using load_points.*/
     AMGraph3D graph_from_points(const std::string& file_name, double rad, int N_closest);
 
+    /** Create a graph from the points in pts. Each point is connected to (at most) its N_closest nearest neighbors within
+     distance rad. The neighbor queries are performed in parallel using a kD-tree. Points with NaN coordinates are skipped. */
+    AMGraph3D graph_from_points(const std::vector<CGLA::Vec3d>& pts, double rad, int N_closest);
+
     /**
      @brief Convert a graph to a mesh using convolution surfaces.
      @param g the input graph
@@ -55,8 +185,10 @@ namespace  Geometry {
      @param tau is the threshold for isosurface extraction
      
      This function converts a graph to a skeleton by way of a convolution surface sampled on a voxel grid.
-     So where do we get the radius of each node. Well, this is currently stored as the green color in the color associated with each node.
-     That is an unfortunate hack, but there you are.
+     The radius of each node is taken from node_radius. The grid is a hierarchical grid where only the cells
+     that overlap the bounding box of an edge are allocated, and the cells are filled in parallel. Thus, memory
+     use grows with the total volume of the edge bounding boxes, which for thick branches is roughly the volume
+     of the tubes, rather than with the cube of grid_res.
      */
     void graph_to_mesh_iso(const AMGraph3D& g, HMesh::Manifold& m, size_t grid_res, float fudge, float tau);
 
@@ -67,8 +199,7 @@ namespace  Geometry {
     @param fudge is the number added to node size
 
     This function converts a graph to a skeleton by representing each edge as a cone stub.
-    So where do we get the radius of each node. Well, this is currently stored as the green color in the color associated with each node.
-    That is an unfortunate hack, but there you are.
+    The radius of each node is taken from node_radius.
     */
     void graph_to_mesh_cyl(const AMGraph3D& g, HMesh::Manifold& m, float fudge);
 
@@ -6,22 +6,35 @@
 //  Copyright © 2020 J. Andreas Bærentzen. All rights reserved.
 //
 
-#include <future>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <numeric>
 #include <thread>
 #include <unordered_set>
 #include <queue>
 #include <list>
 #include <vector>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <chrono>
+#include <fstream>
+#include <tuple>
 #include <GEL/Util/AttribVec.h>
+#include <GEL/Util/Parallel.h>
 #include <GEL/Geometry/Graph.h>
 #include <GEL/Geometry/graph_util.h>
 #include <GEL/Geometry/DynCon.h>
+#include <GEL/Geometry/ShortestPaths.h>
 #include <GEL/Geometry/graph_skeletonize.h>
+#include <GEL/Geometry/graph_tree.h>
 #include <GEL/Geometry/graph_io.h>
-#include <forward_list>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 using namespace std;
 using namespace CGLA;
@@ -44,25 +57,148 @@ namespace Geometry {
     using NodeSetUnordered = unordered_set<NodeID>;
     using NodeQueue = queue<NodeID>;
     using SepVec = vector<Separator>;
+    using hrc = chrono::high_resolution_clock;
 
-    void greedy_weighted_packing(const AMGraph3D &g, NodeSetVec &node_set_vec, bool normalize) {
+    namespace {
+        atomic<bool> logging_enabled{false};
+        atomic<uint64_t> sampling_seed{1};
 
-        vector<pair<double, int>> node_set_index;
+        uint64_t mix_bits(uint64_t x) {
+            x += 0x9e3779b97f4a7c15ull;
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+            return x ^ (x >> 31);
+        }
 
-        if (normalize) {
-            vector<double> opportunity_cost(node_set_vec.size(), 0.0);
+        /// A uniform random number in [0,1) for a task. It only depends on the seed, the stream and the task.
+        double task_uniform(uint64_t stream, uint64_t task) {
+            const uint64_t h = mix_bits(mix_bits(sampling_seed ^ mix_bits(stream)) ^ task);
+            return (h >> 11) * 0x1.0p-53;
+        }
 
-            for (int i = 0; i < node_set_vec.size(); ++i) {
-                const auto&[w_i, ns_i] = node_set_vec[i];
-                for (int j = i + 1; j < node_set_vec.size(); ++j) {
-                    const auto&[w_j, ns_j] = node_set_vec[j];
-                    int matches = test_intersection(ns_i, ns_j);
-                    if (matches > 0) {
-                        opportunity_cost[i] += w_j;
-                        opportunity_cost[j] += w_i;
+        /** Stream for progress messages. Everything written to it is discarded unless logging is on. Writing to the
+         discarding stream sets its error state, so each thread has its own. */
+        ostream& skel_log() {
+            thread_local ostream null_stream(nullptr);
+            return logging_enabled ? cout : null_stream;
+        }
+
+        double seconds(hrc::duration d) {
+            return chrono::duration<double>(d).count();
+        }
+
+        size_t peak_memory_usage() {
+#ifdef _WIN32
+            return 0;
+#else
+            rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) != 0)
+                return 0;
+#ifdef __APPLE__
+            return usage.ru_maxrss;
+#else
+            return usage.ru_maxrss * size_t(1024);
+#endif
+#endif
+        }
+
+        /// Finish the statistics of a run, print them if logging is on, and hand them to the caller if asked.
+        void report(SkeletonizationStats& st, SkeletonizationStats* stats) {
+            st.peak_memory = peak_memory_usage();
+            skel_log() << st;
+            if (stats)
+                *stats = st;
+        }
+    }
+
+    void set_skeletonization_logging(bool on) {
+        logging_enabled = on;
+    }
+
+    void set_skeletonization_seed(uint64_t seed) {
+        sampling_seed = seed;
+    }
+
+    ostream& operator<<(ostream& os, const SkeletonizationStats& st) {
+        os << "Computed " << st.separators_computed << " separators\n";
+        os << "Found " << st.separators_found << " separators\n";
+        os << "Packed " << st.separators_packed << " separators\n";
+        os << "Sampling: " << st.time_sampling << "\n";
+        os << "Building multi-scale graph: " << st.time_multiscale << "\n";
+        os << "Searching for separators: " << st.time_searching << "\n";
+        os << "Filtering separators: " << st.time_filtering << "\n";
+        os << "Packing separators: " << st.time_packing << "\n";
+        os << "Expanding and shrinking separators: " << st.time_expanding;
+        if (!st.time_expanding_per_level.empty()) {
+            os << " (per level:";
+            for (double t: st.time_expanding_per_level)
+                os << " " << t;
+            os << ")";
+        }
+        os << "\n";
+        os << "Thread busy time:";
+        for (double t: st.thread_busy_time)
+            os << " " << t;
+        os << "\n";
+        os << "Peak memory: " << st.peak_memory / (1024.0 * 1024.0) << " MB" << endl;
+        return os;
+    }
+
+    /** Computes the opportunity cost of each of S node sets: the summed weight of the other sets that it
+     shares at least one node with. set_at(i) and weight_at(i) return the nodes and the weight of set i.
+     Rather than testing all pairs, we build an inverted index from nodes to the sets that contain them,
+     so only sets which actually overlap are visited. The overlapping sets are summed in index order,
+     so the costs are exactly the same as those of the pairwise loop. */
+    template<typename SetAt, typename WeightAt>
+    vector<double> opportunity_costs(size_t no_nodes, size_t S, SetAt set_at, WeightAt weight_at) {
+        vector<size_t> offsets(no_nodes + 1, 0);
+        for (size_t i = 0; i < S; ++i)
+            for (auto n: set_at(i))
+                ++offsets[n + 1];
+        for (size_t n = 0; n < no_nodes; ++n)
+            offsets[n + 1] += offsets[n];
+        vector<size_t> sets_of_node(offsets[no_nodes]);
+        vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < S; ++i)
+            for (auto n: set_at(i))
+                sets_of_node[fill[n]++] = i;
+
+        vector<double> opportunity_cost(S, 0.0);
+        Util::parallel_for(S, [&](size_t i, unsigned int) {
+            thread_local NodeMarks seen;
+            thread_local vector<size_t> overlapping;
+            seen.clear(S);
+            overlapping.clear();
+            seen.insert(i);
+            for (auto n: set_at(i))
+                for (size_t k = offsets[n]; k < offsets[n + 1]; ++k) {
+                    size_t j = sets_of_node[k];
+                    if (!seen.contains(j)) {
+                        seen.insert(j);
+                        overlapping.push_back(j);
                     }
                 }
-                double weight = w_i / opportunity_cost[i];
+            sort(overlapping.begin(), overlapping.end());
+            double cost = 0.0;
+            for (auto j: overlapping)
+                cost += weight_at(j);
+            opportunity_cost[i] = cost;
+        }, 64);
+        return opportunity_cost;
+    }
+
+    template<typename GraphT>
+    void greedy_weighted_packing(const GraphT &g, NodeSetVec &node_set_vec, bool normalize) {
+
+        vector<pair<double, int>> node_set_index;
+
+        if (normalize) {
+            vector<double> opportunity_cost = opportunity_costs(
+                    g.no_nodes(), node_set_vec.size(),
+                    [&](size_t i) -> const NodeSet& { return node_set_vec[i].second; },
+                    [&](size_t i) { return node_set_vec[i].first; });
+            for (int i = 0; i < node_set_vec.size(); ++i) {
+                double weight = node_set_vec[i].first / opportunity_cost[i];
                 node_set_index.push_back(make_pair(weight, i));
             }
         } else
@@ -91,6 +227,71 @@ namespace Geometry {
         swap(node_set_vec_new, node_set_vec);
     }
 
+    /** Collects the weighted node sets produced by several tasks and packs them exactly like greedy_weighted_packing
+     with normalization would pack their concatenation in task order. Packing cannot start before every task has
+     finished: a set is ranked by its weight divided by its opportunity cost, which sums the weights of all the sets
+     it overlaps, and those may come from any task. Hence, the sets are only collected until pack is called. They are
+     appended to flat arrays as soon as they are submitted, so a task's NodeSets can be released right away, and only
+     the packed sets are turned into NodeSets again. Tasks may be submitted in any order from any thread. */
+    class NodeSetCollector {
+        vector<size_t> offsets = vector<size_t>(1, 0);
+        vector<NodeID> nodes;
+        vector<double> weights;
+        vector<pair<size_t, size_t>> origin; // task and position within the task of each set
+        mutex mtx;
+
+        IDRange<NodeID> set_at(size_t i) const {
+            return IDRange<NodeID>(nodes.data() + offsets[i], nodes.data() + offsets[i + 1]);
+        }
+
+    public:
+        /// Hand over the node sets of a task. Tasks are identified by their number, which gives their order.
+        void submit(size_t task, const NodeSetVec &nsv) {
+            lock_guard<mutex> lock(mtx);
+            for (size_t k = 0; k < nsv.size(); ++k) {
+                const auto&[w, ns] = nsv[k];
+                nodes.insert(nodes.end(), ns.begin(), ns.end());
+                offsets.push_back(nodes.size());
+                weights.push_back(w);
+                origin.emplace_back(task, k);
+            }
+        }
+
+        /// Number of node sets submitted so far.
+        size_t size() const { return weights.size(); }
+
+        /// Greedily pack the sets by weight normalized by opportunity cost and return the packed sets.
+        NodeSetVec pack(size_t no_nodes) const {
+            const size_t S = size();
+
+            // Visit the sets in task order, so the result does not depend on the order in which the tasks finished.
+            vector<size_t> order(S);
+            iota(order.begin(), order.end(), 0);
+            sort(order.begin(), order.end(), [&](size_t a, size_t b) { return origin[a] < origin[b]; });
+
+            vector<double> opportunity_cost = opportunity_costs(
+                    no_nodes, S, [&](size_t i) { return set_at(order[i]); },
+                    [&](size_t i) { return weights[order[i]]; });
+            vector<pair<double, size_t>> node_set_index(S);
+            for (size_t i = 0; i < S; ++i)
+                node_set_index[i] = make_pair(weights[order[i]] / opportunity_cost[i], i);
+            sort(begin(node_set_index), end(node_set_index), greater<pair<double, size_t>>());
+
+            NodeSetVec packed;
+            NodeMarks used;
+            used.clear(no_nodes);
+            for (const auto&[norm_weight, i]: node_set_index) {
+                const auto ns = set_at(order[i]);
+                if (any_of(ns.begin(), ns.end(), [&](NodeID n) { return used.contains(n); }))
+                    continue;
+                for (auto n: ns)
+                    used.insert(n);
+                packed.emplace_back(weights[order[i]], NodeSet(ns.begin(), ns.end()));
+            }
+            return packed;
+        }
+    };
+
     // Returns a vector of separators without duplicates.
     SepVec filter_duplicate_separators(const SepVec &separators) {
         // Works by inserting then extracting from a hashset.
@@ -135,32 +336,19 @@ namespace Geometry {
 
     // Adds leniency to packing by allowing overlapped usage of vertices up to some capacity
     // Is otherwise the same as greedy_weighted_packing but uses a Separator vector instead of NodeSetVec.
-    void capacity_packing(const AMGraph3D &g, SepVec &separator_vec, bool normalize,
+    template<typename GraphT>
+    void capacity_packing(const GraphT &g, SepVec &separator_vec, bool normalize,
                           const vector<size_t> &capacity) {
 
         vector<pair<double, int>> node_set_index;
-        vector<NodeSet> ordered_seps;
-        ordered_seps.reserve(separator_vec.size());
-        for(auto & s : separator_vec){
-            ordered_seps.push_back(order(s.sigma));
-        }
 
         if (normalize) {
-            vector<double> opportunity_cost(separator_vec.size(), 0.0);
-
+            vector<double> opportunity_cost = opportunity_costs(
+                    g.no_nodes(), separator_vec.size(),
+                    [&](size_t i) -> const NodeSetUnordered& { return separator_vec[i].sigma; },
+                    [&](size_t i) { return separator_vec[i].quality; });
             for (int i = 0; i < separator_vec.size(); ++i) {
-                const double &w_i = separator_vec[i].quality;
-                const auto &ns_i = ordered_seps[i];
-                for (int j = i + 1; j < separator_vec.size(); ++j) {
-                    const double &w_j = separator_vec[j].quality;
-                    const auto &ns_j = ordered_seps[j];
-                    int matches = test_intersection(ns_i, ns_j);
-                    if (matches > 0) {
-                        opportunity_cost[i] += w_j;
-                        opportunity_cost[j] += w_i;
-                    }
-                }
-                double weight = w_i / opportunity_cost[i];
+                double weight = separator_vec[i].quality / opportunity_cost[i];
                 node_set_index.emplace_back(weight, i);
             }
         } else
@@ -194,69 +382,71 @@ namespace Geometry {
     // by growing restricted separators on a multi_scale graph.
     // by using sampling=true, restricted separators are only grown from a subset of vertices in the multi-scale graph.
     std::vector<NodeID> multi_scale_vertex_sampling(
-            AMGraph3D &g,
+            const CSRGraph3D &g,
             double quality_noise_level,
             int optimization_steps,
             int restricted_separator_threshold,
             bool sampling = true) {
 
-        const int CORES = thread::hardware_concurrency();
-        vector<thread> threads(CORES);
+        const unsigned int CORES = Util::thread_count();
 
-        Util::AttribVec<NodeID, size_t> touched(g.no_nodes(), 0); // Used for internal sampling.
+        // Used for internal sampling. The counts are read by the threads while separators are committed.
+        vector<atomic<size_t>> touched(g.no_nodes());
 
         // Generate a multi-scale graph.
-        auto msg = multiscale_graph(g, restricted_separator_threshold, false);
+        auto msg = multiscale_graph(g, restricted_separator_threshold);
 
-        // Collection of vertices where successfully grew a restricted separator on the multi-scale graph converted to
-        // vertices on the g.
-        // Keep a vector for each thread.
-        vector<vector<NodeID>> successful_starting_vertex_vv(CORES);
+        // Whether node n of the given layer is sampled given the touch counts so far. The counts only grow, so a
+        // node that is not sampled when its separator could be grown is not sampled when it is committed either.
+        auto is_sampled = [&](size_t layer, NodeID n) {
+            return !sampling || task_uniform(layer, n) < 1.0 / int_pow(2.0, touched[n]);
+        };
 
-        // Function for growing a single restricted separators and converting successes to input vertices.
-        auto sample_starting_vertex = [&](int core,
-                                          const AMGraph3D &current_g,
-                                          const vector<vector<NodeID>> &exp_map) {
-            auto &successful_starting_vertex_v = successful_starting_vertex_vv[core];
-            for (auto n: current_g.node_ids()) {
-                double probability = 1.0 / int_pow(2.0, touched[n]);
-                if (n % CORES == core && (!sampling || rand() <= probability * RAND_MAX)) {
-                    Separator separator = local_separator(current_g, n, quality_noise_level,
-                                                          optimization_steps,
-                                                          restricted_separator_threshold);
-                    const auto &sigma = separator.sigma;
-                    if (!sigma.empty()) {
-                        // Touch each vertex for sampling.
-                        NodeSetUnordered sigma_unordered;
-                        if (sampling) {
-                            for (auto i: sigma) {
-                                touched[i]++;
-                            }
-                        }
+        // The vertex of g found by growing a restricted separator from a node of the current layer and the nodes
+        // of the separator which are touched if the node is still sampled when it is committed.
+        struct Sample {
+            NodeID n0 = AMGraph::InvalidNodeID;
+            vector<NodeID> touch;
+        };
+        vector<Sample> samples;
 
-                        // Take the position we began from. Find the closest vertex from the expanded set of vertices.
-                        // The expanded vertices are vertices on g.
-                        NodeID n0 = exp_map[n][0];
-                        const auto &n_pos = current_g.pos[n]; // Position of the node we grew from.
-                        double dist_to_n0 = abs(sqrt(
-                                pow((n_pos[0] - g.pos[n0][0]), 2) +
-                                pow((n_pos[1] - g.pos[n0][1]), 2) +
-                                pow((n_pos[2] - g.pos[n0][2]), 2)));
-                        // Of the expanded nodes, find the one closest.
-                        for (size_t i = 1; i < exp_map[n].size(); ++i) {
-                            const auto &candidate_n0 = exp_map[n][i];
-                            const auto &candidate_n0_pos = g.pos[candidate_n0];
-                            double dist = abs(sqrt(
-                                    pow((n_pos[0] - candidate_n0_pos[0]), 2) +
-                                    pow((n_pos[1] - candidate_n0_pos[1]), 2) +
-                                    pow((n_pos[2] - candidate_n0_pos[2]), 2)));
-                            if (dist < dist_to_n0) {
-                                dist_to_n0 = dist;
-                                n0 = candidate_n0;
-                            }
+        // Function for growing a single restricted separators and converting successes to input vertices.
+        auto sample_starting_vertex = [&](NodeID n, size_t layer,
+                                          const CSRGraph3D &current_g,
+                                          const ExpansionMap &exp_map,
+                                          Sample &sample) {
+            if (is_sampled(layer, n)) {
+                Separator separator = local_separator(current_g, n, quality_noise_level,
+                                                      optimization_steps,
+                                                      restricted_separator_threshold);
+                const auto &sigma = separator.sigma;
+                if (!sigma.empty()) {
+                    // Touch each vertex for sampling.
+                    if (sampling)
+                        sample.touch.assign(sigma.begin(), sigma.end());
+
+                    // Take the position we began from. Find the closest vertex from the expanded set of vertices.
+                    // The expanded vertices are vertices on g.
+                    NodeID n0 = exp_map[n][0];
+                    const auto &n_pos = current_g.pos[n]; // Position of the node we grew from.
+                    double dist_to_n0 = abs(sqrt(
+                            pow((n_pos[0] - g.pos[n0][0]), 2) +
+                            pow((n_pos[1] - g.pos[n0][1]), 2) +
+                            pow((n_pos[2] - g.pos[n0][2]), 2)));
+                    // Of the expanded nodes, find the one closest.
+                    for (size_t i = 1; i < exp_map[n].size(); ++i) {
+                        const auto &candidate_n0 = exp_map[n][i];
+                        const auto &candidate_n0_pos = g.pos[candidate_n0];
+                        double dist = abs(sqrt(
+                                pow((n_pos[0] - candidate_n0_pos[0]), 2) +
+                                pow((n_pos[1] - candidate_n0_pos[1]), 2) +
+                                pow((n_pos[2] - candidate_n0_pos[2]), 2)));
+                        if (dist < dist_to_n0) {
+                            dist_to_n0 = dist;
+                            n0 = candidate_n0;
                         }
-                        successful_starting_vertex_v.emplace_back(n0);
                     }
+                    sample.n0 = n0;
                 }
             }
         };
@@ -269,15 +459,25 @@ namespace Geometry {
         set<NodeID, decltype(seed_compare)> successful_starting_vertex_set(seed_compare);
 
 
-        // Now compute restricted separators for each layer.
+        // Now compute restricted separators for each layer. The nodes are committed in order, and a node is
+        // sampled according to the touch counts of the nodes committed before it, so the result is the same as
+        // if the nodes were visited one by one, whatever the number of threads.
         for (auto layer = 0; layer < msg.layers.size(); ++layer) {
-            const auto &g_current = msg.layers[layer];
+            const CSRGraph3D &g_current = msg.layers[layer];
             const auto &exp_map_current = msg.expansion_map_vec[layer];
 
-            for (int i = 0; i < CORES; ++i)
-                threads[i] = thread(sample_starting_vertex, i, g_current, exp_map_current);
-            for (int i = 0; i < CORES; ++i)
-                threads[i].join();
+            const size_t N = g_current.no_nodes();
+            samples.assign(N, Sample());
+            Util::parallel_for_ordered(N, [&](size_t n, unsigned int) {
+                sample_starting_vertex(n, layer, g_current, exp_map_current, samples[n]);
+            }, [&](size_t n) {
+                Sample sample = std::move(samples[n]);
+                if (sample.n0 != AMGraph::InvalidNodeID && is_sampled(layer, n)) {
+                    for (auto i: sample.touch)
+                        touched[i]++;
+                    successful_starting_vertex_set.insert(sample.n0);
+                }
+            }, CORES);
 
             // Cleanup touched.
             if (sampling) {
@@ -285,13 +485,6 @@ namespace Geometry {
                     touched[i] = 0;
                 }
             }
-
-            // Unpack
-            for (const auto &thread_results: successful_starting_vertex_vv) {
-                for (auto vertex: thread_results) {
-                    successful_starting_vertex_set.insert(vertex);
-                }
-            }
         }
 
         // Convert the sampled vertices pack into a vector.
@@ -307,35 +500,18 @@ namespace Geometry {
     NodeSetVec maximize_node_set_vec(AMGraph3D &g, const NodeSetVec &_node_set_vec) {
         NodeSetVec node_set_vec = _node_set_vec;
 
-        BreadthFirstSearch bfs(g);
-        AttribVec<NodeID, int> nsv_membership(g.no_nodes(), -1);
-        for (int nsv_cnt = 0; nsv_cnt < node_set_vec.size(); ++nsv_cnt) {
-            const auto &nsv = node_set_vec[nsv_cnt];
-            for (auto n: nsv.second) {
-                bfs.add_init_node(n);
-                nsv_membership[n] = nsv_cnt;
-            }
-        }
-
-        while (bfs.Dijkstra_step());
-
-        for (auto n: g.node_ids())
-            if (nsv_membership[n] == -1 && bfs.pred[n] != AMGraph::InvalidNodeID) {
-                auto m = n;
-                vector<NodeID> path;
-                while (nsv_membership[m] == -1) {
-                    path.push_back(m);
-                    m = bfs.pred[m];
-                }
-                auto nsv_number = nsv_membership[m];
-                for (auto l: path)
-                    nsv_membership[l] = nsv_number;
-            }
-
-        for (auto n: g.node_ids())
-            if (nsv_membership[n] != -1) {
-                node_set_vec[nsv_membership[n]].second.insert(n);
-            }
+        // A single multi-source search from all node sets. Each node is labelled with the node set it is
+        // closest to, so the unassigned nodes can be added without following the predecessors.
+        ShortestPaths sp;
+        sp.reset(g.no_nodes());
+        for (size_t nsv_cnt = 0; nsv_cnt < node_set_vec.size(); ++nsv_cnt)
+            for (auto n: node_set_vec[nsv_cnt].second)
+                sp.add_source(n, 0.0, nsv_cnt);
+        sp.run(g);
+
+        for (auto n: sp.order())
+            if (sp.pred(n) != AMGraph::InvalidNodeID)
+                node_set_vec[sp.source(n)].second.insert(n);
         return node_set_vec;
     }
 
@@ -360,25 +536,39 @@ namespace Geometry {
         // Map from skeleton node to its weight.
         AttribVec<NodeID, double> skel_node_weight;
 
+        // Compute the barycentre and the median distance to the barycentre of each node set in parallel.
+        const size_t S = node_set_vec.size();
+        vector<Vec3d> set_pos(S);
+        vector<double> set_size(S);
+        Util::parallel_for(S, [&](size_t i, unsigned int) {
+            const auto &ns = node_set_vec[i].second;
+            if (ns.empty())
+                return;
+            Vec3d avg_pos(0);
+            for (auto n: ns)
+                avg_pos += g.pos[n];
+            avg_pos /= ns.size();
+
+            vector<double> lengths;
+            lengths.reserve(ns.size());
+            for (auto n: ns)
+                lengths.push_back(length(g.pos[n] - avg_pos));
+            nth_element(begin(lengths), begin(lengths) + lengths.size() / 2, end(lengths));
+            set_pos[i] = avg_pos;
+            set_size[i] = lengths[lengths.size() / 2];
+        }, 16);
+
         // Create a skeleton node for each node set.
-        for (const auto&[w, ns]: node_set_vec)
+        for (size_t i = 0; i < S; ++i) {
+            const auto &ns = node_set_vec[i].second;
             if (ns.size() > 0) {
-                const NodeID skel_node = skel.add_node(Vec3d(0));
-                Vec3d avg_pos(0);
-                for (auto n: ns) {
-                    avg_pos += g.pos[n];
-                    skel_node_map[n] = skel_node;
-                }
-                avg_pos /= ns.size();
-
-                vector<double> lengths;
+                const NodeID skel_node = skel.add_node(set_pos[i]);
                 for (auto n: ns)
-                    lengths.push_back(length(g.pos[n] - avg_pos));
-                nth_element(begin(lengths), begin(lengths) + lengths.size() / 2, end(lengths));
-                node_size[skel_node] = lengths[lengths.size() / 2];
-                skel.pos[skel_node] = avg_pos;
+                    skel_node_map[n] = skel_node;
+                node_size[skel_node] = set_size[i];
                 skel_node_weight[skel_node] = (ns.size());
             }
+        }
 
         // If two graph nodes are connected and belong to different skeleton nodes,
         // we also connect their respective skeleton nodes.
@@ -395,26 +585,90 @@ namespace Geometry {
         if (!merge_branch_nodes)
             return make_pair(skel, skel_node_map);
 
-        // If skeletal nodes s0, s1, and s2 form a clique, we add them to the cliques
-        // vector of NodeSets.
-        vector<NodeSet> cliques;
+        // If skeletal nodes s0 < s1 < s2 form a clique, we add them to the list of
+        // triangles.
+        vector<array<NodeID, 3>> triangles;
         for (NodeID s0: skel.node_ids()) {
             auto N_s0 = skel.neighbors(s0);
             for (NodeID s1: N_s0)
-                for (NodeID s2: N_s0)
-                    if (s1 != s2 && skel.find_edge(s1, s2) != AMGraph::InvalidEdgeID)
-                        cliques.push_back({s0, s1, s2});
-        }
-
-        // If two cliques intersect with more than a single node, we join them.
-        for (int i = 0; i < cliques.size(); ++i)
-            for (int j = 0; j < cliques.size(); ++j)
-                if (i != j) {
-                    if (test_intersection(cliques[i], cliques[j]) > 1) {
-                        cliques[i].insert(begin(cliques[j]), end(cliques[j]));
-                        cliques[j].clear();
-                    }
+                if (s1 > s0)
+                    for (NodeID s2: N_s0)
+                        if (s2 > s1 && skel.find_edge(s1, s2) != AMGraph::InvalidEdgeID)
+                            triangles.push_back({s0, s1, s2});
+        }
+
+        // If two triangles share an edge, i.e. they intersect in more than a single node, we join them.
+        // The triangles are joined with union-find, using the first triangle found on each skeleton edge.
+        const size_t T = triangles.size();
+        vector<size_t> parent(T);
+        for (size_t t = 0; t < T; ++t)
+            parent[t] = t;
+        auto find = [&](size_t t) {
+            while (parent[t] != t) {
+                parent[t] = parent[parent[t]];
+                t = parent[t];
+            }
+            return t;
+        };
+        const size_t no_tri = numeric_limits<size_t>::max();
+        vector<size_t> edge_triangle(skel.no_edges(), no_tri);
+        for (size_t t = 0; t < T; ++t)
+            for (int k = 0; k < 3; ++k) {
+                auto e = skel.find_edge(triangles[t][k], triangles[t][(k + 1) % 3]);
+                if (edge_triangle[e] == no_tri)
+                    edge_triangle[e] = t;
+                else {
+                    // The root with the lowest index survives, so the cliques are in order of their first triangle.
+                    auto r0 = find(edge_triangle[e]), r1 = find(t);
+                    if (r0 != r1)
+                        parent[max(r0, r1)] = min(r0, r1);
                 }
+            }
+
+        // Collect the nodes of the triangles of each merged clique.
+        vector<size_t> clique_index(T, no_tri);
+        vector<NodeSet> cliques;
+        for (size_t t = 0; t < T; ++t) {
+            auto r = find(t);
+            if (clique_index[r] == no_tri) {
+                clique_index[r] = cliques.size();
+                cliques.emplace_back();
+            }
+            cliques[clique_index[r]].insert(begin(triangles[t]), end(triangles[t]));
+        }
+
+        // Two merged cliques may still share more than a single node even if none of their triangles share
+        // an edge, e.g. when the shared nodes come from triangles at opposite ends of a strip. Such cliques are
+        // joined as well, and this is repeated until no two cliques intersect in more than a single node.
+        vector<vector<size_t>> node_cliques(skel.no_nodes());
+        for (size_t c = 0; c < cliques.size(); ++c)
+            for (auto n: cliques[c])
+                node_cliques[n].push_back(c);
+        for (bool merged = true; merged;) {
+            merged = false;
+            for (size_t c = 0; c < cliques.size(); ++c) {
+                map<size_t, int> shared;
+                for (auto n: cliques[c])
+                    for (auto d: node_cliques[n])
+                        if (d != c)
+                            ++shared[d];
+                for (auto [d, count]: shared)
+                    if (count > 1) {
+                        // As above, the clique with the lowest index survives.
+                        size_t keep = min(c, d), gone = max(c, d);
+                        for (auto n: cliques[gone]) {
+                            auto &nc = node_cliques[n];
+                            nc.erase(std::find(begin(nc), end(nc), gone));
+                            if (cliques[keep].insert(n).second)
+                                nc.push_back(keep);
+                        }
+                        cliques[gone].clear();
+                        merged = true;
+                        if (gone == c)
+                            break;
+                    }
+            }
+        }
 
         // Now, we create a branch node connected to all of the nodes in the
         // merged clique
@@ -470,23 +724,20 @@ namespace Geometry {
             }
         }
 
-        // Finally, store the node size in the green channel of the node color
-        // it is perhaps not the best idea, but this way we do not need another
-        // way of storing the size....
+        // Finally, store the node size as the radius of the skeleton nodes.
         for (auto n: skel.node_ids())
-            skel.node_color[n][1] = node_size[n];
+            skel.node_radius[n] = node_size[n];
 
         return make_pair(skel, skel_node_map);
     }
 
     AttribVec<NodeID, double> junction_distance(const AMGraph3D &g) {
-        BreadthFirstSearch bfs(g);
+        vector<NodeID> junctions;
         for (auto n: g.node_ids()) {
             if (g.neighbors(n).size() > 2)
-                bfs.add_init_node(n, 0);
+                junctions.push_back(n);
         }
-        while (bfs.Dijkstra_step());
-        return bfs.dist;
+        return shortest_path_distances(g, junctions);
     }
 
     NodeSetVec skeletal_reweighting(AMGraph3D &g, const NodeSetVec &nsv_for_skel) {
@@ -511,7 +762,7 @@ namespace Geometry {
         for (auto n: g.node_ids())
             nodes_by_tin.push_back(make_pair(bfs.T_in[n], n));
         //    sort(begin(nodes_by_tin), end(nodes_by_tin));
-        shuffle(begin(nodes_by_tin), end(nodes_by_tin), default_random_engine(rand()));
+        shuffle(begin(nodes_by_tin), end(nodes_by_tin), default_random_engine(mix_bits(sampling_seed + shift)));
 
 
         vector<vector<NodeID>> separators;
@@ -564,30 +815,27 @@ namespace Geometry {
     }
 
 
-    NodeSetVec front_separators(AMGraph3D &g, const vector<AttribVecDouble> &dvv) {
-        auto process_dist = [](AMGraph3D &g, const AttribVecDouble &dist, int shift) -> NodeSetVec {
-            auto node_set_vec = separating_node_sets(g, dist, shift);
-            return node_set_vec;
-        };
+    NodeSetVec front_separators(AMGraph3D &g, const vector<AttribVecDouble> &dvv, size_t passes) {
+        if (dvv.empty())
+            return NodeSetVec();
 
-        size_t N = 50;//dvv.size();
-        NodeSetVec node_set_vec_global;
-        vector<future<NodeSetVec>> nsvfutures(N);
-        
-        for(int i=0;i<N;++i)
-            nsvfutures[i] = async(launch::async, process_dist, ref(g), dvv[0], i);
-        
-        for(int i=0;i<N;++i) {
-            NodeSetVec nsv =nsvfutures[i].get();
-            node_set_vec_global.insert(end(node_set_vec_global), begin(nsv), end(nsv));
-        }
+        // Each pass marches a front along one of the fields with its own shuffling of the start nodes. The
+        // passes cycle through the fields, and the number of passes running at once is the thread count.
+        const size_t P = max(passes, dvv.size());
+        NodeSetCollector collector;
+        parallel_for(P, [&](size_t i, unsigned) {
+            collector.submit(i, separating_node_sets(g, dvv[i % dvv.size()], int(i)));
+        });
 
-        greedy_weighted_packing(g, node_set_vec_global, true);
+        NodeSetVec node_set_vec_global = collector.pack(g.no_nodes());
+        skel_log() << "Front separators: packed " << node_set_vec_global.size() << " of " << collector.size()
+                   << " node sets from " << P << " passes over " << dvv.size() << " fields" << endl;
         color_graph_node_sets(g, node_set_vec_global);
         return node_set_vec_global;
     }
 
-    int find_component(const AMGraph3D &g, NodeID n, const vector<NodeSetUnordered> &front_components) {
+    template<typename GraphT>
+    int find_component(const GraphT &g, NodeID n, const vector<NodeSetUnordered> &front_components) {
         int component = -1;
         for (auto m: g.neighbors(n))
             for (int i = 0; i < front_components.size(); ++i)
@@ -603,8 +851,8 @@ namespace Geometry {
     };
 
 
-    template<typename T>
-    void smooth_attribute(const AMGraph3D &g, AttribVec<NodeID, T> &attrib, const NodeSetUnordered &node_set,
+    template<typename GraphT, typename T>
+    void smooth_attribute(const GraphT &g, AttribVec<NodeID, T> &attrib, const NodeSetUnordered &node_set,
                           int N_iter = 1, const AttribVec<NodeID, Vec3d> *_pos = 0) {
         double delta = 0.5;
         const AttribVec<NodeID, Vec3d> &pos = (_pos == 0) ? g.pos : *_pos;
@@ -626,7 +874,8 @@ namespace Geometry {
     }
 
 
-    void node_set_thinning(const AMGraph3D &g, NodeSetUnordered &separator,
+    template<typename GraphT>
+    void node_set_thinning(const GraphT &g, NodeSetUnordered &separator,
                            vector<NodeSetUnordered> &front_components,
                            const AttribVecDouble &priority) {
         using DN_pair = pair<double, NodeID>;
@@ -654,7 +903,8 @@ namespace Geometry {
     }
 
 
-    void optimize_separator(const AMGraph3D &g, NodeSetUnordered &separator,
+    template<typename GraphT>
+    void optimize_separator(const GraphT &g, NodeSetUnordered &separator,
                             vector<NodeSetUnordered> &front_components) {
         if (separator.size() > 0) {
             NodeID n0 = *begin(separator);
@@ -662,20 +912,22 @@ namespace Geometry {
             separator.insert(begin(nbors), end(nbors));
             front_components = connected_components(g, neighbors(g, separator));
 
-            BreadthFirstSearch bfs(g);
-            for (auto n: g.node_ids())
-                bfs.mask[n] = 0;
+            // Dijkstra from n0 restricted to the (thickened) separator. Only separator nodes are reached, so the
+            // search is stored sparsely.
+            ShortestPaths sp;
+            sp.reset_sparse(separator.size());
+            sp.add_source(n0);
+            sp.run(g, [&](NodeID m) { return separator.count(m) > 0; });
+            AttribVecDouble dist;
             for (auto n: separator)
-                bfs.mask[n] = 1;
-
-            bfs.add_init_node(n0);
-            while (bfs.Dijkstra_step());
+                dist[n] = sp.dist(n);
 
-            node_set_thinning(g, separator, front_components, bfs.dist);
+            node_set_thinning(g, separator, front_components, dist);
         }
     }
 
-    double separator_quality(const AMGraph3D& g, const NodeSetUnordered& s){
+    template<typename GraphT>
+    double separator_quality(const GraphT& g, const NodeSetUnordered& s){
         size_t min = -1;
         size_t max = 0;
         for (const auto &d: front_components(g,s)) {
@@ -686,7 +938,8 @@ namespace Geometry {
         return (double) min / max;
     }
 
-    void thicken_separator(const AMGraph3D& g, NodeSetUnordered& sigma){
+    template<typename GraphT>
+    void thicken_separator(const GraphT& g, NodeSetUnordered& sigma){
         auto C_F = front_components(g, sigma);
         for(const auto& c: C_F){
             NodeSetUnordered sigma_thick = sigma;
@@ -695,7 +948,8 @@ namespace Geometry {
         }
     }
 
-    SepVec adjacent_separators(const AMGraph3D& g, const NodeSetUnordered& sigma){
+    template<typename GraphT>
+    SepVec adjacent_separators(const GraphT& g, const NodeSetUnordered& sigma){
         auto fc = front_components(g,sigma);
         SepVec res;
         vector<NodeSetUnordered> nsv(fc.size());
@@ -710,7 +964,8 @@ namespace Geometry {
         return res;
     }
 
-    Separator shrink_separator(const AMGraph3D &g,
+    template<typename GraphT>
+    Separator shrink_separator(const GraphT &g,
                           NodeSetUnordered &separator,
                           const Vec3d &sphere_centre, int opt_steps) {
         auto fc = front_components(g,separator);
@@ -745,7 +1000,102 @@ namespace Geometry {
         return res;
     }
 
-    using hrc = chrono::high_resolution_clock;
+    /** Scratch space for growing local separators. Each thread has one which is reused for all the separators it grows,
+     so once the arrays have reached the size of the graph, growing a separator does not allocate. */
+    class SeparatorWorkspace {
+        /** A front node in the heap. sqr_dist is the squared distance to the centre when the entry was last updated,
+         i.e. at centre version version. The key is the distance plus the total distance the centre had moved at
+         that time. Since a node's distance to the centre decreases by at most the distance the centre moves, the
+         key minus the current total movement is a lower bound on the current distance. Hence, the keys need not be
+         updated when the centre moves, and only entries that reach the top of the heap are updated. */
+        struct FrontEntry {
+            double key;
+            double sqr_dist;
+            NodeID n;
+            unsigned version;
+            bool operator>(const FrontEntry& e) const { return key > e.key || (key == e.key && n > e.n); }
+        };
+        vector<FrontEntry> front_heap; // Min heap of the front nodes.
+        vector<FrontEntry> near_ties;
+        double moved = 0.0; // Total distance the centre has moved.
+        unsigned version = 0;
+
+        void push(const FrontEntry& e) {
+            front_heap.push_back(e);
+            push_heap(front_heap.begin(), front_heap.end(), greater<FrontEntry>());
+        }
+
+        FrontEntry pop() {
+            pop_heap(front_heap.begin(), front_heap.end(), greater<FrontEntry>());
+            FrontEntry e = front_heap.back();
+            front_heap.pop_back();
+            return e;
+        }
+
+        template<typename PosT>
+        FrontEntry current(NodeID n, const PosT& pos, const Vec3d& centre) const {
+            const double d = sqr_length(pos[n] - centre);
+            return {sqrt(d) + moved, d, n, version};
+        }
+
+    public:
+        NodeMarks in_sigma, in_front;
+        vector<NodeID> sigma; // Nodes of the separator in the order they were added.
+
+        void reset(size_t N) {
+            in_sigma.clear(N);
+            in_front.clear(N);
+            sigma.clear();
+            front_heap.clear();
+            moved = 0.0;
+            version = 0;
+        }
+
+        size_t front_size() const { return front_heap.size(); }
+
+        template<typename PosT>
+        void add_to_front(NodeID n, const PosT& pos, const Vec3d& centre) {
+            in_front.insert(n);
+            push(current(n, pos, centre));
+        }
+
+        /** Remove the front node closest to the centre and add it to the separator. Ties are broken by the smaller
+         node id. */
+        template<typename PosT>
+        NodeID move_closest_to_sigma(const PosT& pos, const Vec3d& centre) {
+            // Update entries until the top is current. Its key is then no greater than the lower bound of any other.
+            while(front_heap.front().version != version)
+                push(current(pop().n, pos, centre));
+            FrontEntry best = pop();
+
+            // The keys are rounded, so entries whose keys are within rounding error of the best key could be as
+            // close or closer. They are compared by their exact squared distance.
+            const double limit = best.key * (1.0 + 1e-12) + 1e-300;
+            near_ties.clear();
+            while(!front_heap.empty() && front_heap.front().key <= limit) {
+                FrontEntry e = pop();
+                if(e.version != version)
+                    e = current(e.n, pos, centre);
+                if(e.sqr_dist < best.sqr_dist || (e.sqr_dist == best.sqr_dist && e.n < best.n))
+                    swap(e, best);
+                near_ties.push_back(e);
+            }
+            for(const auto& e: near_ties)
+                push(e);
+
+            const NodeID n = best.n;
+            in_front.erase(n);
+            in_sigma.insert(n);
+            sigma.push_back(n);
+            return n;
+        }
+
+        /// The centre has moved by the given distance. This only invalidates the keys of the front nodes.
+        void move_centre(double dist) {
+            moved += dist;
+            ++version;
+        }
+    };
 
     /** For a given graph, g,  and a given node n0, we compute a local separator.
      The algorithm proceeds in a way similar to Dijkstra, finding a set of nodes separator such that there is anoter set of nodes, front,
@@ -754,51 +1104,60 @@ namespace Geometry {
      persistence is how many iterations the front must have two connected components before we consider the interior
      a local separator.
      The final node set returned is then thinned to the minimal separator.
+     If grown is given, it receives the nodes that were swallowed by the sphere before thinning.
      */
-    Separator local_separator(const AMGraph3D &g, NodeID n0, double quality_noise_level, int optimization_steps,
-                              size_t growth_threshold, const Vec3d* static_centre) {
+    template<typename GraphT>
+    Separator local_separator_impl(const GraphT &g, NodeID n0, double quality_noise_level, int optimization_steps,
+                                   size_t growth_threshold, const Vec3d* static_centre,
+                                   vector<NodeID>* grown = nullptr) {
 
         // Create dynamic connectivity structure
         DynCon<NodeID, DYNCON> con = DynCon<NodeID,DYNCON>();
-        // Create the separator node set and the temporary node set (used during computation)
-        // The tmp sets are needed because of persistence. Whenever we have had two connected components
-        // in front for a number of iterations = persistence, we go back to the original separator.
-        NodeSetUnordered Sigma({n0});
+
+        // The separator, Sigma, and the front, F, are kept in the workspace of this thread.
+        thread_local SeparatorWorkspace ws;
+        ws.reset(g.no_nodes());
+        ws.in_sigma.insert(n0);
+        ws.sigma.push_back(n0);
+        auto record_grown = [&]() {
+            if (grown != nullptr)
+                grown->assign(ws.sigma.begin(), ws.sigma.end());
+        };
+
+        // Create the initial sphere which is of radius zero centered at the input node.
+        Vec3d centre = g.pos[n0];
+        double radius = 0.0;
 
         // Create the front node set. Note that a leaf node is a separator by definition,
         // so if there is only one neighbor, we are done here.
         auto N = g.neighbors(n0);
+        record_grown();
         if (N.size() == 0)
             return {0.0, NodeSetUnordered ()};
         if (N.size() == 1)
             return {0.0, NodeSetUnordered({n0}), 0, -1, 1};
-        NodeSetUnordered F(begin(N), end(N));
+        for (auto v: N)
+            ws.add_to_front(v, g.pos, centre);
 
         // Connect in dynamic connectivity structure
-        for (auto v: F) {
+        for (auto v: N) {
             con.insert(v);
             for (auto w: g.neighbors(v)) {
-                if (F.count(w) != 0) {
+                if (ws.in_front.contains(w)) {
                     con.insert(v, w);
                 }
             }
         }
 
-        // We will need node sets for the connected components of the front.
-        vector<NodeSetUnordered> C_F;
-
-        // Create the initial sphere which is of radius zero centered at the input node.
-        Vec3d centre = g.pos[n0];
-        double radius = 0.0;
-        NodeID last_n = AMGraph3D::InvalidNodeID; // Very last node added to separator.
         // Now, proceed by expanding a sphere
         while (con.front_size_ratio() < quality_noise_level) {
-            if (growth_threshold != -1 && Sigma.size() >= growth_threshold) return {0.0, NodeSetUnordered()};
+            if (growth_threshold != -1 && ws.sigma.size() >= growth_threshold) {
+                record_grown();
+                return {0.0, NodeSetUnordered()};
+            }
 
-            // Find the node in front closest to the center
-            const NodeID n = *min_element(begin(F), end(F), [&](NodeID a, NodeID b) {
-                return sqr_length(g.pos[a] - centre) < sqr_length(g.pos[b] - centre);
-            });
+            // Move the node in front closest to the center from F to Sigma.
+            const NodeID n = ws.move_closest_to_sigma(g.pos, centre);
 
             // Update the sphere centre and radius to contain the new point.
             if(static_centre != nullptr) {
@@ -806,22 +1165,20 @@ namespace Geometry {
                 double l = length(centre - p_n);
                 if (l > radius) {
                     radius = 0.5 * (radius + l);
+                    const Vec3d old_centre = centre;
                     centre = p_n + radius * (centre - p_n) / (1e-30 + length(centre - p_n));
+                    ws.move_centre(length(centre - old_centre));
                 }
             }
 
-            // Now, remove n from F and put it in Sigma.
             // Add n's neighbours (not in Sigma) to F.
-            last_n = n;
-            F.erase(n);
-            Sigma.insert(n);
             // Add new edges in front to dynamic connectivity structure
             for (auto m: g.neighbors(n)) {
-                if (Sigma.count(m) != 0 || F.count(m) != 0) continue;
-                F.insert(m);
+                if (ws.in_sigma.contains(m) || ws.in_front.contains(m)) continue;
+                ws.add_to_front(m, g.pos, centre);
                 con.insert(m);
                 for (auto w: g.neighbors(m)) {
-                    if (F.count(w) == 0) continue;
+                    if (!ws.in_front.contains(w)) continue;
                     con.insert(m,w);
                 }
             }
@@ -830,21 +1187,52 @@ namespace Geometry {
 
             // If the front is empty, we must have included an entire
             // connected component in "separator". Bail!
-            if (F.size() == 0)
+            if (ws.front_size() == 0) {
+                record_grown();
                 return {0.0, NodeSetUnordered()};
+            }
         }
-;
+
+        record_grown();
+        NodeSetUnordered Sigma(ws.sigma.begin(), ws.sigma.end());
         return shrink_separator(g, Sigma, centre, optimization_steps);
     }
 
+    Separator local_separator(const AMGraph3D &g, NodeID n0, double quality_noise_level, int optimization_steps,
+                              size_t growth_threshold, const Vec3d* static_centre) {
+        return local_separator_impl(g, n0, quality_noise_level, optimization_steps, growth_threshold, static_centre);
+    }
+
+    Separator local_separator(const CSRGraph3D &g, NodeID n0, double quality_noise_level, int optimization_steps,
+                              size_t growth_threshold, const Vec3d* static_centre) {
+        return local_separator_impl(g, n0, quality_noise_level, optimization_steps, growth_threshold, static_centre);
+    }
+
     NodeSetVec local_separators(AMGraph3D &g, SamplingType sampling, double quality_noise_level, int optimization_steps,
-                                size_t advanced_sampling_threshold) {
+                                size_t advanced_sampling_threshold, SkeletonizationStats* stats) {
+        // Separator search only reads the adjacency, so we freeze the graph and search the compact copy.
+        auto node_set_vec = local_separators(CSRGraph3D(g), sampling, quality_noise_level, optimization_steps,
+                                             advanced_sampling_threshold, stats);
 
-        // Because we are greedy: all cores belong to this task!
-        const int CORES = thread::hardware_concurrency();
+        // Color the node sets selected by packing, so we can get a sense of the
+        // selection.
+        color_graph_node_sets(g, node_set_vec);
+
+        return node_set_vec;
+    }
 
-        // touched will help us keep track of how many separators use a given node.
-        Util::AttribVec<NodeID, int> touched(g.no_nodes(), 0);
+    NodeSetVec local_separators(const CSRGraph3D &g, SamplingType sampling, double quality_noise_level,
+                                int optimization_steps, size_t advanced_sampling_threshold,
+                                SkeletonizationStats* stats) {
+
+        const unsigned int CORES = Util::thread_count();
+        SkeletonizationStats st;
+        st.thread_busy_time.assign(CORES, 0.0);
+        auto t0 = hrc::now();
+
+        // touched will help us keep track of how many separators use a given node. The counts are read by the
+        // threads while separators are committed.
+        vector<atomic<int>> touched(g.no_nodes());
 
         vector<NodeID> node_id_vec;
 
@@ -855,8 +1243,7 @@ namespace Geometry {
             // Create a random order vector of nodes.
             for (auto n: g.node_ids())
                 node_id_vec.push_back(n);
-            srand(1);
-            shuffle(begin(node_id_vec), end(node_id_vec), default_random_engine(rand()));
+            shuffle(begin(node_id_vec), end(node_id_vec), default_random_engine(sampling_seed));
         } else {
             for (auto n: g.node_ids())
                 node_id_vec.push_back(n);
@@ -864,259 +1251,497 @@ namespace Geometry {
 
         auto t1 = hrc::now();
 
-        // Each core will have its own vector of NodeSets in which to store
-        // separators.
-        vector<NodeSetVec> nsvv(CORES);
-        int cnt = 0;
-        auto create_separators = [&](int core) {
-            auto &nsv = nsvv[core];
-            for (auto n: node_id_vec) {
-                double probability = 1.0 / int_pow(2.0, touched[n]);
-                if (n % CORES == core && (sampling != SamplingType::Basic || rand() <= probability * RAND_MAX)) {
-                    cnt += 1;
-                    auto sep = local_separator(g, n, quality_noise_level, optimization_steps,-1);
-                    // Store in pair to conserve compatibility.
-                    std::pair<double, NodeSet> ns(sep.quality, order(sep.sigma));
-                    if (ns.second.size() > 0) {
-                        nsv.push_back(ns);
-                        for (auto m: ns.second)
-                            touched[m] += 1;
-                    }
-                }
-            }
+        // Whether node_id_vec[i] is sampled given the touch counts so far. The counts only grow, so a node that is
+        // not sampled when its separator could be grown is not sampled when it is committed either.
+        auto is_sampled = [&](size_t i) {
+            return sampling != SamplingType::Basic ||
+                   task_uniform(0, i) < 1.0 / int_pow(2.0, touched[node_id_vec[i]]);
         };
 
-        vector<thread> threads(CORES);
-        for (int i = 0; i < CORES; ++i)
-            threads[i] = thread(create_separators, i);
+        // The separator grown from node_id_vec[i] is stored in slot i until it is committed, so the order of
+        // the separators does not depend on the threads.
+        NodeSetVec node_seps(node_id_vec.size());
+        NodeSetVec node_set_vec_global;
+        atomic<size_t> cnt = 0;
+        auto create_separator = [&](size_t i, unsigned int core, std::pair<double, NodeSet> &ns) {
+            const NodeID n = node_id_vec[i];
+            if (is_sampled(i)) {
+                auto t_start = hrc::now();
+                cnt += 1;
+                auto sep = local_separator(g, n, quality_noise_level, optimization_steps,-1);
+                // Store in pair to conserve compatibility.
+                ns = std::pair<double, NodeSet>(sep.quality, order(sep.sigma));
+                st.thread_busy_time[core] += seconds(hrc::now() - t_start);
+            }
+        };
 
-        for (int i = 0; i < CORES; ++i)
-            threads[i].join();
+        // The cost of growing a separator varies wildly between thin branches and thick trunks, so the nodes are
+        // handed out one at a time. They are committed in order, and a node is sampled according to the touch
+        // counts of the nodes committed before it, so the result does not depend on the number of threads.
+        Util::parallel_for_ordered(node_id_vec.size(), [&](size_t i, unsigned int core) {
+            create_separator(i, core, node_seps[i]);
+        }, [&](size_t i) {
+            auto ns = std::move(node_seps[i]);
+            if (ns.second.size() > 0 && is_sampled(i)) {
+                for (auto m: ns.second)
+                    touched[m] += 1;
+                node_set_vec_global.push_back(std::move(ns));
+            }
+        }, CORES);
 
         auto t2 = hrc::now();
 
-        NodeSetVec node_set_vec_global;
-        for (const auto &nsv: nsvv)
-            for (const auto &ns: nsv)
-                node_set_vec_global.push_back(ns);
-
-        auto sep_bef = node_set_vec_global.size();
+        st.separators_found = node_set_vec_global.size();
         greedy_weighted_packing(g, node_set_vec_global, true);
-        auto sep_aft = node_set_vec_global.size();
+        st.separators_packed = node_set_vec_global.size();
         auto t3 = hrc::now();
 
-        cout << "Computed " << cnt << " separators" << endl;
-        cout << "Found " << sep_bef << " separators" << endl;
-        cout << "Packed " << sep_aft << " separators" << endl;
-        cout << "Finding separators: " << (t2 - t1).count() * 1e-9 << endl;
-        cout << "Packing separators: " << (t3 - t2).count() * 1e-9 << endl;
-
-        // Color the node sets selected by packing, so we can get a sense of the
-        // selection.
-        color_graph_node_sets(g, node_set_vec_global);
+        st.separators_computed = cnt;
+        st.time_sampling = seconds(t1 - t0);
+        st.time_searching = seconds(t2 - t1);
+        st.time_packing = seconds(t3 - t2);
+        report(st, stats);
 
         return node_set_vec_global;
     }
 
-    NodeSetVec multiscale_local_separators(AMGraph3D &g, SamplingType sampling,const size_t grow_threshold,double quality_noise_level, int optimization_steps) {
-        // Because we are greedy: all cores belong to this task!
-        //const unsigned int CORES = std::min(8u,thread::hardware_concurrency());
+    namespace {
+        bool is_finite(const Vec3d &p) {
+            return std::isfinite(p[0]) && std::isfinite(p[1]) && std::isfinite(p[2]);
+        }
 
-        const int CORES = thread::hardware_concurrency();
-        const int CORES_SEC = std::min(CORES,2);
+        /** The squared distance from s to the farthest node within the given number of hops of the grown nodes. A
+         search reads the edges of the nodes adjacent to the nodes swallowed by its sphere, and each step of
+         optimize_separator thickens the separator by a layer and reads the edges of the layer beyond that, so
+         hops = optimization_steps + 1 covers every node whose edges were read. */
+        double footprint_sqr_reach(const AMGraph3D &g, NodeID s, const vector<NodeID> &grown, int hops) {
+            thread_local NodeMarks visited;
+            visited.clear(g.no_nodes());
+            vector<NodeID> layer, next;
+            for (auto n: grown)
+                if (!visited.contains(n)) {
+                    visited.insert(n);
+                    layer.push_back(n);
+                }
+            double r = 0.0;
+            for (int h = 0;; ++h) {
+                for (auto n: layer)
+                    r = max(r, sqr_length(g.pos[n] - g.pos[s]));
+                if (h == hops)
+                    break;
+                next.clear();
+                for (auto n: layer)
+                    for (auto m: g.neighbors(n))
+                        if (!visited.contains(m)) {
+                            visited.insert(m);
+                            next.push_back(m);
+                        }
+                swap(layer, next);
+            }
+            return r;
+        }
+    }
 
-        Util::AttribVec<NodeID, size_t> touched(g.no_nodes(), 0);
+    IncrementalSkeleton::IncrementalSkeleton(AMGraph3D &_g, double _quality_noise_level, int _optimization_steps):
+            g(_g), quality_noise_level(_quality_noise_level), optimization_steps(_optimization_steps) {
+        const size_t N = g.no_nodes();
+        candidate.resize(N);
+        sqr_reach.assign(N, 0.0);
+        seeds_of_node.resize(N);
+        owner.assign(N, AMGraph::InvalidNodeID);
 
-        size_t count_computed = 0;
-        size_t count_found = 0;
-        size_t count_packed = 0;
+        vector<NodeID> seeds;
+        for (auto n: g.node_ids())
+            if (in_use(n))
+                seeds.push_back(n);
+        grow(seeds);
+        pack(seeds);
+
+        // The grid cells are a few times the average edge length, but no smaller than the average reach of a
+        // search, so most searches span only a few cells.
+        double len = 0.0;
+        size_t cnt = 0;
+        for (auto n: seeds)
+            for (auto m: g.neighbors(n))
+                if (n < m) {
+                    len += length(g.pos[n] - g.pos[m]);
+                    ++cnt;
+                }
+        double avg_reach = 0.0;
+        for (auto n: seeds)
+            avg_reach += sqrt(sqr_reach[n]) / seeds.size();
+        cell_size = max(cnt > 0 ? 4.0 * len / cnt : 0.0, avg_reach);
+        if (!(cell_size > 0.0))
+            cell_size = 1.0;
+        for (auto n: seeds)
+            grid_insert(n);
+    }
 
-        long time_creating_separators = 0, time_shrinking = 0, time_expanding = 0, time_packing = 0, time_filtering = 0;
-        auto timer = hrc::now();
+    bool IncrementalSkeleton::in_use(NodeID n) const {
+        return g.valid_node_id(n) && is_finite(g.pos[n]);
+    }
 
-        vector<thread> threads(CORES);
-
-        // Each core will have its own vector of Separators in which to store
-        // separators.
-        vector<vector<Separator> > separator_vv(CORES);
-        auto create_separators = [&](const int core, const AMGraph3D &g, const int level) {
-            auto &separator_v = separator_vv[core];
-            const size_t chunk_size = (g.no_nodes()+CORES-1)/CORES;
-            for (size_t i=core*chunk_size; i<(core+1)*chunk_size && i<g.no_nodes(); ++i) {
-                double probability = 1.0 / int_pow(2.0, touched[i]);
-                if (sampling==SamplingType::None || rand() <= probability * RAND_MAX) {
-                    ++count_computed;
-                    auto separator = local_separator(g, i, quality_noise_level, optimization_steps,
-                                                                grow_threshold);
-                    if (separator.sigma.size() > 0) {
-                        SepVec adjsep = MULTI_SHRINK ? adjacent_separators(g,separator.sigma) : SepVec();
-                        size_t c = 0;
-                        do{
-                            separator.id = count_found;
-                            separator.grouping = count_found;
-                            ++count_found;
-                            separator_v.push_back(separator);
-                            if (sampling!=SamplingType::None) {
-                                for (auto m: separator.sigma) {
-                                    touched[m]++;
-                                }
-                            }
-                            if(c < adjsep.size()) separator = adjsep[c++];
-                        } while(c<adjsep.size());
-                    }
-                }
+    uint64_t IncrementalSkeleton::cell_key(int64_t i, int64_t j, int64_t k) const {
+        // Cells which are 2^21 apart share a key, which is harmless since the distances are checked anyway.
+        return ((uint64_t(i) & 0x1fffff) << 42) | ((uint64_t(j) & 0x1fffff) << 21) | (uint64_t(k) & 0x1fffff);
+    }
+
+    uint64_t IncrementalSkeleton::cell_key(const Vec3d &p) const {
+        return cell_key(int64_t(floor(p[0] / cell_size)), int64_t(floor(p[1] / cell_size)),
+                        int64_t(floor(p[2] / cell_size)));
+    }
+
+    void IncrementalSkeleton::grid_insert(NodeID n) {
+        grid[cell_key(g.pos[n])].push_back(n);
+    }
+
+    void IncrementalSkeleton::grid_erase(NodeID n, const Vec3d &p) {
+        auto it = grid.find(cell_key(p));
+        if (it != grid.end())
+            it->second.erase(remove(it->second.begin(), it->second.end(), n), it->second.end());
+    }
+
+    void IncrementalSkeleton::grow(const vector<NodeID> &seeds) {
+        for (auto s: seeds)
+            for (auto n: candidate[s].second) {
+                auto &sv = seeds_of_node[n];
+                sv.erase(remove(sv.begin(), sv.end(), s), sv.end());
             }
-        };
 
-        auto shrink_expand = [&](
-                int core,
-                const vector<Separator> &node_set_vec_global,
-                const AMGraph3D &g_current,
-                const AMGraph3D &g_next,
-                const vector<vector<NodeID>> &exp_map_current,
-                const int level) {
-            auto &current_level_separator_vec = separator_vv[core];
-            const size_t chunk_size = (node_set_vec_global.size()+CORES_SEC-1)/CORES_SEC;
-            for (unsigned int i = core*chunk_size; i < (core+1)*chunk_size && i < node_set_vec_global.size(); i++) {
-                const auto &sep = node_set_vec_global[i];
-                auto local_timer = hrc::now();
-
-                // Do not include if separator is a leaf. Leaves in the input graph is still included since we do not expand on that level.
-                if (sep.sigma.size() == 1 && g_current.neighbors(*sep.sigma.begin()).size() == 1) {
-                    continue;
-                }
+        Util::parallel_for(seeds.size(), [&](size_t i, unsigned int) {
+            const NodeID s = seeds[i];
+            thread_local vector<NodeID> grown;
+            auto sep = local_separator_impl(g, s, quality_noise_level, optimization_steps, -1, nullptr, &grown);
+            candidate[s] = make_pair(sep.quality, order(sep.sigma));
+            sqr_reach[s] = footprint_sqr_reach(g, s, grown, max(optimization_steps, 0) + 1);
+        }, 16);
+
+        for (auto s: seeds) {
+            max_sqr_reach = max(max_sqr_reach, sqr_reach[s]);
+            for (auto n: candidate[s].second)
+                seeds_of_node[n].push_back(s);
+        }
+    }
 
-                size_t old_size = sep.sigma.size();
+    void IncrementalSkeleton::unpack(NodeID s, vector<NodeID> &freed) {
+        if (packed.erase(s) == 0)
+            return;
+        for (auto n: candidate[s].second) {
+            owner[n] = AMGraph::InvalidNodeID;
+            freed.push_back(n);
+        }
+    }
 
-                // Expand.
+    void IncrementalSkeleton::pack(vector<NodeID> seeds) {
+        sort(seeds.begin(), seeds.end());
+        seeds.erase(unique(seeds.begin(), seeds.end()), seeds.end());
+
+        // Weight divided by opportunity cost, which is the summed weight of all other candidates that share a node.
+        vector<pair<double, NodeID>> order_vec;
+        vector<NodeID> overlapping;
+        for (auto s: seeds) {
+            const auto &[w, ns] = candidate[s];
+            if (ns.empty() || packed.count(s))
+                continue;
+            overlapping.clear();
+            for (auto n: ns)
+                for (auto t: seeds_of_node[n])
+                    if (t != s)
+                        overlapping.push_back(t);
+            sort(overlapping.begin(), overlapping.end());
+            overlapping.erase(unique(overlapping.begin(), overlapping.end()), overlapping.end());
+            double cost = 0.0;
+            for (auto t: overlapping)
+                cost += candidate[t].first;
+            order_vec.emplace_back(w / cost, s);
+        }
+        sort(order_vec.begin(), order_vec.end(), greater<pair<double, NodeID>>());
+
+        for (const auto &[norm_weight, s]: order_vec) {
+            const auto &ns = candidate[s].second;
+            if (any_of(ns.begin(), ns.end(), [&](NodeID n) { return owner[n] != AMGraph::InvalidNodeID; }))
+                continue;
+            packed.insert(s);
+            for (auto n: ns)
+                owner[n] = s;
+        }
+    }
 
-                NodeSetUnordered Sigma;
-                for (NodeID old_v: sep.sigma) {
-                    for (NodeID new_v: exp_map_current[old_v]) Sigma.insert(new_v);
-                }
+    NodeID IncrementalSkeleton::add_node(const Vec3d &p) {
+        const NodeID n = g.add_node(p);
+        candidate.emplace_back();
+        sqr_reach.push_back(0.0);
+        seeds_of_node.emplace_back();
+        owner.push_back(AMGraph::InvalidNodeID);
+        if (in_use(n))
+            grid_insert(n);
+        return n;
+    }
+
+    void IncrementalSkeleton::remove_node(NodeID n) {
+        if (!in_use(n))
+            return;
+        const Vec3d p = g.pos[n];
+        for (auto m: g.neighbors(n))
+            dirty.push_back(g.pos[m]);
+        dirty.push_back(p);
+        grid_erase(n, p);
+        g.remove_node(n);
+        removed.push_back(n);
+    }
+
+    void IncrementalSkeleton::connect_nodes(NodeID n0, NodeID n1) {
+        if (n0 == n1 || !in_use(n0) || !in_use(n1))
+            return;
+        if (g.connect_nodes(n0, n1) != AMGraph::InvalidEdgeID) {
+            dirty.push_back(g.pos[n0]);
+            dirty.push_back(g.pos[n1]);
+        }
+    }
+
+    void IncrementalSkeleton::disconnect_nodes(NodeID n0, NodeID n1) {
+        if (!in_use(n0) || !in_use(n1))
+            return;
+        if (g.find_edge(n0, n1) != AMGraph::InvalidEdgeID) {
+            g.disconnect_nodes(n0, n1);
+            dirty.push_back(g.pos[n0]);
+            dirty.push_back(g.pos[n1]);
+        }
+    }
+
+    size_t IncrementalSkeleton::update() {
+        if (dirty.empty() && removed.empty())
+            return 0;
+
+        // Find the seeds whose search may have read the edges of a touched node. If the cells within the largest
+        // reach outnumber the occupied cells, the occupied cells are simply all visited.
+        vector<NodeID> seeds;
+        const int64_t R = int64_t(ceil(sqrt(max_sqr_reach) / cell_size)) + 1;
+        for (const auto &p: dirty) {
+            auto visit = [&](const vector<NodeID> &cell) {
+                for (auto s: cell)
+                    if (sqr_length(g.pos[s] - p) <= sqr_reach[s])
+                        seeds.push_back(s);
+            };
+            if (double(2 * R + 1) * (2 * R + 1) * (2 * R + 1) > grid.size())
+                for (const auto &[key, cell]: grid)
+                    visit(cell);
+            else {
+                const int64_t ci = floor(p[0] / cell_size), cj = floor(p[1] / cell_size), ck = floor(p[2] / cell_size);
+                for (int64_t i = -R; i <= R; ++i)
+                    for (int64_t j = -R; j <= R; ++j)
+                        for (int64_t k = -R; k <= R; ++k) {
+                            auto it = grid.find(cell_key(ci + i, cj + j, ck + k));
+                            if (it != grid.end())
+                                visit(it->second);
+                        }
+            }
+        }
+        dirty.clear();
+        sort(seeds.begin(), seeds.end());
+        seeds.erase(unique(seeds.begin(), seeds.end()), seeds.end());
+
+        // The separators grown from removed nodes are dropped.
+        vector<NodeID> freed;
+        for (auto s: removed) {
+            unpack(s, freed);
+            for (auto n: candidate[s].second) {
+                auto &sv = seeds_of_node[n];
+                sv.erase(remove(sv.begin(), sv.end(), s), sv.end());
+            }
+            candidate[s] = std::pair<double, NodeSet>();
+            sqr_reach[s] = 0.0;
+        }
+        removed.clear();
+
+        for (auto s: seeds)
+            unpack(s, freed);
+        grow(seeds);
+
+        // Candidates which may fit now are the regrown ones and those which overlap the released separators.
+        vector<NodeID> region = seeds;
+        for (auto n: freed)
+            region.insert(region.end(), seeds_of_node[n].begin(), seeds_of_node[n].end());
+        pack(std::move(region));
+        return seeds.size();
+    }
 
-                for(size_t j=0;j<THICC_SEP;j++) thicken_separator(g_next,Sigma);
+    const std::pair<double, NodeSet> &IncrementalSkeleton::candidate_separator(NodeID n) const {
+        static const std::pair<double, NodeSet> none;
+        return n < candidate.size() ? candidate[n] : none;
+    }
 
-                //time_expanding += (hrc::now() - local_timer).count(); // TODO: This might be a race condition.
-                //local_timer = hrc::now();
+    NodeSetVec IncrementalSkeleton::separators() const {
+        NodeSetVec nsv;
+        nsv.reserve(packed.size());
+        for (auto s: packed)
+            nsv.push_back(candidate[s]);
+        return nsv;
+    }
 
-                // Shrink.
+    pair<AMGraph3D, AttribVec<NodeID, NodeID>> IncrementalSkeleton::skeleton() {
+        return skeleton_from_node_set_vec(g, separators());
+    }
 
-                Vec3d centre = approximate_bounding_sphere(g_next, Sigma).first;
+    /// Multi-scale separator search on a multi-scale graph of g. time_multiscale is the time it took to build msg.
+    static NodeSetVec multiscale_separators(AMGraph3D &g, const MultiScaleGraph &msg, SamplingType sampling,
+                                            const size_t grow_threshold, double quality_noise_level,
+                                            int optimization_steps, double time_multiscale,
+                                            SkeletonizationStats* stats) {
+        // Because we are greedy: all cores belong to this task!
+        const unsigned int CORES = Util::thread_count();
 
-                Separator trimmed_sep;
+        vector<atomic<size_t>> touched(g.no_nodes());
 
-                trimmed_sep = shrink_separator(g_next, Sigma, centre, optimization_steps);
-                trimmed_sep.grouping = sep.grouping;
-                current_level_separator_vec.push_back(trimmed_sep);
-                if(sampling==SamplingType::Advanced){
-                    for(auto n: trimmed_sep.sigma) touched[n]++;
-                }
+        atomic<size_t> count_computed = 0;
+        size_t count_found = 0;
 
-                time_shrinking += (hrc::now() - local_timer).count(); //TODO: Also race condition.
+        SkeletonizationStats st;
+        st.thread_busy_time.assign(CORES, 0.0);
+        auto timer = hrc::now();
+
+        // Whether node i of the given level is sampled given the touch counts so far. The counts only grow, so a
+        // node that is not sampled when its separators could be grown is not sampled when it is committed either.
+        auto is_sampled = [&](size_t level, NodeID i) {
+            return sampling == SamplingType::None || task_uniform(level, i) < 1.0 / int_pow(2.0, touched[i]);
+        };
+
+        // Grow a restricted separator from node i of g. The nodes are touched when the node is committed.
+        auto create_separators = [&](NodeID i, unsigned int core, size_t level, const CSRGraph3D &g,
+                                     SepVec &separator_v) {
+            if (is_sampled(level, i)) {
+                auto t_start = hrc::now();
+                ++count_computed;
+                auto separator = local_separator(g, i, quality_noise_level, optimization_steps,
+                                                            grow_threshold);
+                if (separator.sigma.size() > 0) {
+                    SepVec adjsep = MULTI_SHRINK ? adjacent_separators(g,separator.sigma) : SepVec();
+                    size_t c = 0;
+                    do{
+                        separator_v.push_back(separator);
+                        if(c < adjsep.size()) separator = adjsep[c++];
+                    } while(c<adjsep.size());
+                }
+                st.thread_busy_time[core] += seconds(hrc::now() - t_start);
             }
         };
 
-        auto t1 = hrc::now();
+        // Expand a separator of g_current to g_next and shrink it again. Returns false if the separator is dropped.
+        auto shrink_expand = [&](
+                const Separator &sep,
+                unsigned int core,
+                const CSRGraph3D &g_current,
+                const CSRGraph3D &g_next,
+                const ExpansionMap &exp_map_current,
+                Separator &trimmed_sep) {
+            auto local_timer = hrc::now();
+
+            // Do not include if separator is a leaf. Leaves in the input graph is still included since we do not expand on that level.
+            if (sep.sigma.size() == 1 && g_current.neighbors(*sep.sigma.begin()).size() == 1) {
+                return false;
+            }
 
-        auto msg = Geometry::multiscale_graph(g, grow_threshold, true);
+            // Expand.
 
-        auto t2 = hrc::now();
+            NodeSetUnordered Sigma;
+            for (NodeID old_v: sep.sigma) {
+                for (NodeID new_v: exp_map_current[old_v]) Sigma.insert(new_v);
+            }
+
+            for(size_t j=0;j<THICC_SEP;j++) thicken_separator(g_next,Sigma);
 
-        //std::cout<<"MSG created: "<<msg.layers.size()<<" levels total"<<std::endl;
+            // Shrink.
+
+            Vec3d centre = approximate_bounding_sphere(g_next, Sigma).first;
+
+            trimmed_sep = shrink_separator(g_next, Sigma, centre, optimization_steps);
+            trimmed_sep.grouping = sep.grouping;
+            if(sampling==SamplingType::Advanced){
+                for(auto n: trimmed_sep.sigma) touched[n]++;
+            }
+
+            st.thread_busy_time[core] += seconds(hrc::now() - local_timer);
+            return true;
+        };
+
+        st.time_multiscale = time_multiscale;
 
         vector<Separator> separator_vector_global;
 
         for (int level = msg.layers.size() - 1; level >= 0; --level) {
+            const CSRGraph3D &g_current = msg.layers[level];
             timer = hrc::now();
-            const auto &g_current = msg.layers[level];
             const auto &exp_map_current = msg.expansion_map_vec[level];
 
-            //std::cout << "Finding separators on lvl "<<level<<std::endl;
-
             // Determine separators
-            for (int i = 0; i < CORES; ++i)
-                threads[i] = thread(create_separators, i, g_current,level);
-
-            for (auto& t: threads) t.join();
-
-            //std::cout << "Separators found"<<std::endl;
-
-            for (auto &separator_v: separator_vv)
+            // The separators grown from a node are stored in the slot of the node until the node is committed.
+            // The nodes are committed in order, and a node is sampled according to the touch counts of the nodes
+            // committed before it, so the separators do not depend on how the nodes are scheduled.
+            const size_t N = g_current.no_nodes();
+            vector<SepVec> node_separators(N);
+            Util::parallel_for_ordered(N, [&](size_t i, unsigned int core) {
+                create_separators(i, core, level, g_current, node_separators[i]);
+            }, [&](size_t i) {
+                SepVec separator_v = std::move(node_separators[i]);
+                if (separator_v.empty() || !is_sampled(level, i))
+                    return;
                 for (auto &sep: separator_v) {
-                    separator_vector_global.push_back(sep);
+                    if (sampling != SamplingType::None)
+                        for (auto m: sep.sigma)
+                            touched[m]++;
+                    sep.id = count_found;
+                    sep.grouping = count_found;
+                    ++count_found;
+                    separator_vector_global.push_back(std::move(sep));
                 }
-
-            for (auto &nsv: separator_vv) {
-                nsv.clear();
-            }
-            time_creating_separators += (hrc::now() - timer).count();
+            }, CORES);
+            st.time_searching += seconds(hrc::now() - timer);
 
             // Should do nothing on first layer.
-            //size_t temp = node_set_vec_global.size();
             timer = hrc::now();
             separator_vector_global = filter_duplicate_separators(separator_vector_global);
-            time_filtering += (hrc::now() - timer).count();
-            //cout << "Filtered: " <<  temp - node_set_vec_global.size() << endl;
+            st.time_filtering += seconds(hrc::now() - timer);
 
             // Pack
             timer = hrc::now();
             capacity_packing(g_current, separator_vector_global, true, msg.capacity_vec_vec[level]);
-            time_packing += (hrc::now() - timer).count();
+            st.time_packing += seconds(hrc::now() - timer);
 
             // Cleanup touched
             for (size_t i = 0; i < touched.size(); ++i) {
                 touched[i] = 0;
             }
 
-            // Save graph
-            //graph_save("msg"+ to_string(level)+".graph",g_current);
-            //std::cout << "Saving msg"<<level<<".graph"<<std::endl;
-
             // Expand and shrink.
             if (level != 0) { // Nothing to expand to on final level.
-                //touched = (g.no_nodes(),0);
-
                 timer = hrc::now();
-                for (int i = 0; i < CORES_SEC; ++i)
-                    threads[i] = thread(shrink_expand, i, separator_vector_global, g_current, msg.layers[level - 1],
-                                        exp_map_current,level);
+                const CSRGraph3D &g_next = msg.layers[level - 1];
+
+                // Each separator gets its own slot, so the result is in the order of the packed separators.
+                // The lambda captures the graphs by reference, so no thread copies them.
+                const size_t S = separator_vector_global.size();
+                vector<Separator> trimmed(S);
+                vector<char> kept(S, 0);
+                Util::parallel_for(S, [&](size_t i, unsigned int core) {
+                    kept[i] = shrink_expand(separator_vector_global[i], core, g_current, g_next,
+                                            exp_map_current, trimmed[i]);
+                }, 1, CORES);
 
-                for (int i = 0; i < CORES_SEC; ++i){
-                    threads[i].join();
-                }
-
-                time_expanding += (hrc::now() - timer).count();
                 separator_vector_global.clear();
-                for (const auto &sep_v: separator_vv)
-                    for (const auto &sep: sep_v) {
-                        separator_vector_global.push_back(sep);
-                    }
+                for (size_t i = 0; i < S; ++i)
+                    if (kept[i])
+                        separator_vector_global.push_back(std::move(trimmed[i]));
 
-                for (auto &nsv: separator_vv) {
-                    nsv.clear();
-                }
+                const double t_level = seconds(hrc::now() - timer);
+                st.time_expanding += t_level;
+                st.time_expanding_per_level.push_back(t_level);
             }
         }
 
-        count_packed = separator_vector_global.size();
-
-        auto t3 = hrc::now();
-
-        cout << "#####################" << endl;
-        cout << "Computed " << count_computed << " separators" << endl;
-        cout << "Found " << count_found << " separators" << endl;
-        cout << "Packed " << count_packed << " separators" << endl;
-        cout << "#####################" << endl;
-        cout << "Building multilayer graph: " << (t2 - t1).count() * 1e-9 << endl;
-        //cout << "Creating separators: " << (t3 - t2).count() * 1e-9 << endl;
-        //cout << "#####################" << endl;
-        cout << "Searching for restricted separators: " << time_creating_separators * 1e-9 << endl;
-        cout << "Packing separators: " << time_packing * 1e-9 << endl;
-        cout << "Expanding separators: " << time_expanding * 1e-9 << endl;
-        cout << "Shrinking separators: " << time_shrinking * 1e-9 << endl;
-        cout << "Filtering separators: " << time_filtering * 1e-9 << endl;
-        cout << "#####################" << endl;
+        st.separators_computed = count_computed;
+        st.separators_found = count_found;
+        st.separators_packed = separator_vector_global.size();
+        report(st, stats);
 
         // Color the node sets selected by packing, so we can get a sense of the
         // selection.
@@ -1130,439 +1755,516 @@ namespace Geometry {
         return sepvec_to_nsv(separator_vector_global);
     }
 
-    MultiScaleGraph multiscale_graph(const AMGraph3D &g, const size_t threshold, bool recursive) {
-        MultiScaleGraph msg;
-
-        msg.layers = std::vector<AMGraph3D>();
-        msg.expansion_map_vec = std::vector<ExpansionMap>();
-        msg.capacity_vec_vec = CapacityVecVec();
+    NodeSetVec multiscale_local_separators(AMGraph3D &g, SamplingType sampling,const size_t grow_threshold,double quality_noise_level, int optimization_steps,
+                                           SkeletonizationStats* stats) {
+        auto t0 = hrc::now();
+        auto msg = Geometry::multiscale_graph(g, grow_threshold, true);
+        const double time_multiscale = seconds(hrc::now() - t0);
+        return multiscale_separators(g, msg, sampling, grow_threshold, quality_noise_level,
+                                     optimization_steps, time_multiscale, stats);
+    }
 
-        AMGraph3D graph_current;
-        size_t vertex_target;
-        size_t vertex_count;
+    NodeSetVec multiscale_local_separators(AMGraph3D &g, const MultiScaleGraph &msg, SamplingType sampling,
+                                           const size_t grow_threshold, double quality_noise_level,
+                                           int optimization_steps, SkeletonizationStats* stats) {
+        return multiscale_separators(g, msg, sampling, grow_threshold, quality_noise_level,
+                                     optimization_steps, 0.0, stats);
+    }
 
+    ExpansionMap ExpansionMap::identity(size_t N) {
+        vector<size_t> offsets(N + 1);
+        vector<NodeID> ids(N);
+        for (size_t n = 0; n < N; ++n) {
+            offsets[n] = n;
+            ids[n] = n;
+        }
+        offsets[N] = N;
+        return ExpansionMap(std::move(offsets), std::move(ids));
+    }
 
-        auto graph_decimate = [&](const AMGraph3D& g, size_t to_remove)->AMGraph3D {
-            AMGraph3D g_temp = g;
-            auto map_temp = vector<vector<NodeID>>(g.no_nodes());
+    namespace {
+        /** Contract the edges of a layer until to_remove nodes are gone or no more edges can be contracted.
+         Each pass sorts the edges of the contracted graph by their length in the layer and contracts the shortest
+         edges greedily such that a node is contracted at most once per pass. The contracted node gets the midpoint
+         of the two nodes. Returns the next layer and appends its expansion map and capacities to msg. */
+        CSRGraph3D graph_decimate(const CSRGraph3D &g, size_t to_remove, MultiScaleGraph &msg) {
+            const size_t N = g.no_nodes();
+            const unsigned int CORES = Util::thread_count();
+
+            // The contracted graph is kept in CSR form on the node ids of g. A node which has been merged away
+            // has no neighbors and a NaN position.
+            vector<size_t> offsets(N + 1, 0);
+            vector<NodeID> nbrs;
+            vector<Vec3d> pos(N);
+            for (NodeID n = 0; n < N; ++n) {
+                pos[n] = g.pos[n];
+                offsets[n + 1] = offsets[n] + (std::isnan(pos[n][0]) ? 0 : g.valence(n));
+            }
+            nbrs.resize(offsets[N]);
+            Util::parallel_for(N, [&](size_t n, unsigned int) {
+                if (!std::isnan(pos[n][0]))
+                    copy(g.neighbors(n).begin(), g.neighbors(n).end(), nbrs.begin() + offsets[n]);
+            }, 1024, CORES);
+
+            // Nodes merged into n are kept in a linked list in the order the expansion map lists them.
+            vector<NodeID> head(N, AMGraph::InvalidNodeID), tail(N, AMGraph::InvalidNodeID);
+            vector<NodeID> next(N, AMGraph::InvalidNodeID);
+
+            struct ContractionEdge {
+                double d;
+                NodeID n0, n1;
+                bool operator<(const ContractionEdge &e) const {
+                    return tie(d, n0, n1) < tie(e.d, e.n0, e.n1);
+                }
+            };
 
-            Util::AttribVec<NodeID, int> touched(g.no_nodes(),0);
-            priority_queue<SkeletonPQElem> Q;
+            vector<NodeID> merged_into(N);
+            vector<size_t> edge_offsets(N + 1);
+            vector<ContractionEdge> edges;
+            vector<char> touched(N);
 
-            int total_work = 0;
+            size_t total_work = 0;
             bool did_work = true;
-
-            while(total_work < to_remove && did_work){
+            while (total_work < to_remove && did_work) {
                 did_work = false;
-                touched.clear();
-                for (auto n0: g_temp.node_ids()) {
-                    for (auto n1: g_temp.neighbors(n0)) {
-                        if(n1>n0) continue; // Only visit edge a,b a<b and not b,a
-                        double pri;
-                        pri = -g.sqr_dist(n0, n1);
-                        Q.push(SkeletonPQElem(pri, n0, n1));
-                    }
+
+                // Collect the edges n0, n1 with n1 < n0.
+                edge_offsets[0] = 0;
+                for (NodeID n0 = 0; n0 < N; ++n0) {
+                    size_t cnt = 0;
+                    for (size_t i = offsets[n0]; i < offsets[n0 + 1]; ++i)
+                        cnt += nbrs[i] < n0;
+                    edge_offsets[n0 + 1] = edge_offsets[n0] + cnt;
                 }
-                //cout << "Q was empty now has "<<Q.size()<<endl;
-
-                //cout << "Looping tw: "<<total_work<<", tr: "<<to_remove<<", Q: "<<Q.size()<<endl;
-                while(!Q.empty()){
-                    auto skel_rec = Q.top();
-                    Q.pop();
-                    if(touched[skel_rec.n0] == 0 && touched[skel_rec.n1] == 0) { // Merge vertices
-                        auto e = g_temp.find_edge(skel_rec.n0, skel_rec.n1);
-                        if(e != AMGraph::InvalidEdgeID){
-                            g_temp.merge_nodes(skel_rec.n0, skel_rec.n1);
-                            // Merging removes n0 from graph
-                            map_temp[skel_rec.n1].push_back(skel_rec.n0);
-                            for(auto i: map_temp[skel_rec.n0]){
-                                map_temp[skel_rec.n1].push_back(i);
-                            }
-                            touched[skel_rec.n0] = touched[skel_rec.n1] = 1;
-                            ++total_work;
-                            did_work = true;
+                edges.resize(edge_offsets[N]);
+                Util::parallel_for(N, [&](size_t n0, unsigned int) {
+                    size_t j = edge_offsets[n0];
+                    for (size_t i = offsets[n0]; i < offsets[n0 + 1]; ++i)
+                        if (nbrs[i] < n0)
+                            edges[j++] = {g.sqr_dist(n0, nbrs[i]), n0, nbrs[i]};
+                }, 1024, CORES);
+                sort(edges.begin(), edges.end());
+
+                // Greedy matching of the shortest edges. n0 is merged into n1.
+                fill(touched.begin(), touched.end(), 0);
+                for (NodeID n = 0; n < N; ++n)
+                    merged_into[n] = n;
+                for (const auto &e: edges)
+                    if (!touched[e.n0] && !touched[e.n1]) {
+                        const NodeID n0 = e.n0, n1 = e.n1;
+                        Vec3d p_new = pos[n1];
+                        p_new += pos[n0];
+                        p_new *= 0.5;
+                        pos[n1] = p_new;
+                        pos[n0] = Vec3d(CGLA_NAN);
+
+                        if (head[n1] == AMGraph::InvalidNodeID)
+                            head[n1] = n0;
+                        else
+                            next[tail[n1]] = n0;
+                        tail[n1] = n0;
+                        if (head[n0] != AMGraph::InvalidNodeID) {
+                            next[n0] = head[n0];
+                            tail[n1] = tail[n0];
                         }
+
+                        merged_into[n0] = n1;
+                        touched[n0] = touched[n1] = 1;
+                        ++total_work;
+                        did_work = true;
                     }
+                if (!did_work)
+                    break;
+
+                // Rebuild the contracted graph. The neighbors of a node are its own and those of the node merged
+                // into it, so the sum of the two valences bounds the new valence. Each node gathers its new
+                // neighbors in its own slot, and the slots are compacted afterwards.
+                vector<NodeID> partner(N, AMGraph::InvalidNodeID);
+                for (NodeID n = 0; n < N; ++n)
+                    if (merged_into[n] != n)
+                        partner[merged_into[n]] = n;
+                vector<size_t> slot_offsets(N + 1, 0), counts(N, 0);
+                for (NodeID n = 0; n < N; ++n) {
+                    size_t bound = 0;
+                    if (merged_into[n] == n) {
+                        bound = offsets[n + 1] - offsets[n];
+                        if (partner[n] != AMGraph::InvalidNodeID)
+                            bound += offsets[partner[n] + 1] - offsets[partner[n]];
+                    }
+                    slot_offsets[n + 1] = slot_offsets[n] + bound;
                 }
+                vector<NodeID> slots(slot_offsets[N]);
+                Util::parallel_for(N, [&](size_t n, unsigned int) {
+                    if (merged_into[n] != n)
+                        return;
+                    auto b = slots.begin() + slot_offsets[n];
+                    auto e = b;
+                    for (NodeID m: {NodeID(n), partner[n]})
+                        if (m != AMGraph::InvalidNodeID)
+                            for (size_t i = offsets[m]; i < offsets[m + 1]; ++i) {
+                                const NodeID nn = merged_into[nbrs[i]];
+                                if (nn != n)
+                                    *e++ = nn;
+                            }
+                    sort(b, e);
+                    counts[n] = unique(b, e) - b;
+                }, 256, CORES);
+                for (NodeID n = 0; n < N; ++n)
+                    offsets[n + 1] = offsets[n] + counts[n];
+                nbrs.resize(offsets[N]);
+                Util::parallel_for(N, [&](size_t n, unsigned int) {
+                    copy_n(slots.begin() + slot_offsets[n], counts[n], nbrs.begin() + offsets[n]);
+                }, 1024, CORES);
             }
 
-            //cout << "Finished decimate tw: "<<total_work<<", tr: "<<to_remove<<", dw: "<<did_work<<endl;
-            auto map_result = vector<vector<NodeID>>(g.no_nodes() - total_work);
-            auto cap_result = vector<size_t>(g.no_nodes() - total_work, 0);
-
-            // Perform a special case cleanup that maintains expansion map
-            AMGraph3D g_result; // New graph
-            map<NodeID,NodeID> node_map;
-            size_t node_new_index = 0;
-
-            // For all nodes that are not too close to previously visited nodes
-            // create a new node in the new graph
-            for(auto n: g_temp.node_ids()){
-                if (std::isnan(g_temp.pos[n][0])) {
-                    node_map[n] = AMGraph::InvalidNodeID;
-                } else {
-                    node_map[n] = g_result.add_node(g_temp.pos[n]);
-                    g_result.node_color[node_map[n]] = g_temp.node_color[n];
-                    for (auto i : map_temp[n]) {
-                        map_result[node_new_index].push_back(i);
-                        cap_result[node_new_index] += msg.capacity_vec_vec.back()[i];
-                    }
-                    // Also add the node itself.
-                    map_result[node_new_index].push_back(n);
-                    cap_result[node_new_index] += msg.capacity_vec_vec.back()[n];
-                    ++node_new_index;
+            // Renumber the remaining nodes in increasing order and build the next layer together with
+            // its expansion map and capacities.
+            vector<NodeID> new_id(N, AMGraph::InvalidNodeID);
+            vector<NodeID> old_id;
+            for (NodeID n = 0; n < N; ++n)
+                if (!std::isnan(pos[n][0])) {
+                    new_id[n] = old_id.size();
+                    old_id.push_back(n);
+                }
+            const size_t M = old_id.size();
+
+            const auto &cap_prev = msg.capacity_vec_vec.back();
+            vector<size_t> map_offsets(M + 1, 0);
+            vector<NodeID> map_ids;
+            vector<size_t> cap_result(M, 0);
+            map_ids.reserve(N);
+            for (size_t i = 0; i < M; ++i) {
+                const NodeID n = old_id[i];
+                for (NodeID m = head[n]; m != AMGraph::InvalidNodeID; m = next[m]) {
+                    map_ids.push_back(m);
+                    cap_result[i] += cap_prev[m];
+                    if (m == tail[n])
+                        break;
                 }
+                // Also add the node itself.
+                map_ids.push_back(n);
+                cap_result[i] += cap_prev[n];
+                map_offsets[i + 1] = map_ids.size();
             }
 
-            // For all edges in old graph, create a new edge
-            for (auto n: g_temp.node_ids())
-                if (node_map[n] != AMGraph::InvalidNodeID)
-                    for (AMGraph::NodeID &nn: g_temp.neighbors(n)) {
-                        AMGraph::EdgeID e = g_result.connect_nodes(node_map[n], node_map[nn]);
-                        if (g_result.valid_edge_id(e)) {
-                            AMGraph::EdgeID e_old = g_temp.find_edge(n, nn);
-                            if (g_temp.valid_edge_id(e_old))
-                                g_result.edge_color[e] = g_temp.edge_color[e_old];
-                            else
-                                g_result.edge_color[e] = Vec3f(0);
-                        }
-                    }
+            vector<Vec3d> pos_result(M);
+            vector<size_t> offsets_result(M + 1, 0);
+            for (size_t i = 0; i < M; ++i) {
+                pos_result[i] = pos[old_id[i]];
+                offsets_result[i + 1] = offsets_result[i] + offsets[old_id[i] + 1] - offsets[old_id[i]];
+            }
+            vector<NodeID> nbrs_result(offsets_result[M]);
+            Util::parallel_for(M, [&](size_t i, unsigned int) {
+                const NodeID n = old_id[i];
+                for (size_t j = offsets[n]; j < offsets[n + 1]; ++j)
+                    nbrs_result[offsets_result[i] + j - offsets[n]] = new_id[nbrs[j]];
+            }, 1024, CORES);
+
+            msg.capacity_vec_vec.push_back(std::move(cap_result));
+            msg.expansion_map_vec.emplace_back(std::move(map_offsets), std::move(map_ids));
+            return CSRGraph3D(M, pos_result.data(), offsets_result.data(), nbrs_result.data());
+        }
+    }
 
-            msg.capacity_vec_vec.push_back(cap_result);
-            msg.expansion_map_vec.push_back(map_result);
-            return g_result;
-        };
+    MultiScaleGraph multiscale_graph(const AMGraph3D &g, const size_t threshold, bool /*recursive*/) {
+        return multiscale_graph(CSRGraph3D(g), threshold);
+    }
 
-        graph_current = g;
+    MultiScaleGraph multiscale_graph(const CSRGraph3D &g, const size_t threshold) {
+        MultiScaleGraph msg;
 
         // The first layer is always the input graph.
-        msg.layers.push_back(graph_current);
-        msg.expansion_map_vec.emplace_back(graph_current.no_nodes());
-        msg.capacity_vec_vec.emplace_back(graph_current.no_nodes());
-        for (size_t i = 0; i < graph_current.no_nodes(); ++i) {
-            msg.expansion_map_vec[0][i] = std::vector<NodeID>(1, i);
-            msg.capacity_vec_vec[0][i] = 1;
-        }
-
-        vertex_target = g.no_nodes();
+        msg.layers.push_back(g);
+        msg.expansion_map_vec.push_back(ExpansionMap::identity(g.no_nodes()));
+        msg.capacity_vec_vec.emplace_back(g.no_nodes(), 1);
 
+        size_t vertex_target = g.no_nodes();
         while (vertex_target > threshold) {
-            vertex_count = graph_current.no_nodes();
+            const CSRGraph3D &graph_current = msg.layers.back();
+            const size_t vertex_count = graph_current.no_nodes();
             vertex_target = vertex_count/2;
-            graph_current = graph_decimate(graph_current,graph_current.no_nodes()-vertex_target);
-            if (vertex_count == graph_current.no_nodes()){
-                //cout << "Early return no edges to remove" <<endl;
-                //cout << "Wanted to remove "<<edges_to_remove<<" from graph with "<<vertex_count<<" vertices but failed"<<endl;
-                break; // Was unable to remove any edges.
+            CSRGraph3D graph_next = graph_decimate(graph_current, vertex_count - vertex_target, msg);
+            if (vertex_count == graph_next.no_nodes()) {
+                // Was unable to remove any edges.
+                msg.expansion_map_vec.pop_back();
+                msg.capacity_vec_vec.pop_back();
+                break;
             }
+            msg.layers.push_back(std::move(graph_next));
+        }
 
-            msg.layers.push_back(graph_current);
+        return msg;
+    }
 
+    namespace {
+        const char MSG_MAGIC[8] = {'G','E','L','M','S','G','P','H'};
+        const uint32_t MSG_VERSION = 1;
 
+        template<typename T>
+        void write_pod(ofstream &os, const T &x) {
+            os.write(reinterpret_cast<const char*>(&x), sizeof(T));
         }
 
-        return msg;
-    }
-    
-    //Edits Helen
-    
-    double angle_z_axis(Geometry::AMGraph3D& g, NodeID one, NodeID two){
-    //n = bottom node (one), nb = edge node (two), c = +1 z direction node
-    
-    auto xn = g.pos[one][0];
-    auto xnb = g.pos[two][0];
-    auto xc = xn;
-    auto yn = g.pos[one][1];
-    auto ynb = g.pos[two][1];
-    auto yc = yn;
-    auto zn = g.pos[one][2];
-    auto znb = g.pos[two][2];
-    auto zc = zn + 0.5;
-    
-    
-    // edge direction
-    auto xb = xnb-xn;
-    auto yb = ynb-yn;
-    auto zb = znb-zn;
-    
-    //z direction direction
-    auto xcd = xc-xn;
-    auto ycd = yc-yn;
-    auto zcd = zc-zn;
-    
-    auto length_b = sqrt(xb*xb + yb*yb + zb*zb);
-    auto length_c = sqrt(xcd*xcd + ycd*ycd + zcd*zcd);
-    
-    //    cout << "length b and c: " << length_b << " " << length_c <<  endl;
-    
-    auto dot_p = ((xb/length_b)*(xcd/length_c) + (yb/length_b)*(xcd/length_c) + (zb/length_b)*(zcd/length_c));
-    
-    auto length_b_unit = sqrt((xb/length_b)*(xb/length_b) + (yb/length_b)*(yb/length_b) + (zb/length_b)*(zb/length_b));
-    auto length_c_unit = sqrt((xcd/length_c)*(xcd/length_c) + (ycd/length_c)*(ycd/length_c) + (zcd/length_c)*(zcd/length_c));
-    
-    auto angle = (acos(dot_p/(length_b_unit*length_c_unit))*180)/3.141592;
-    
-    return angle;
-    
-}
+        template<typename T>
+        void write_vec(ofstream &os, const vector<T> &v) {
+            os.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+        }
 
-    NodeID bottom_node_return(Geometry::AMGraph3D& g){
-    cout << "** bottom_node_return function **" << endl;    //Finding z-values and the lowest edges
-    
-    vector<double> z_values;
-    vector<double> z_values_low;
-    vector<NodeID> z_values_low_index;
-    
-    //Loading z-coordinates into vector
-    for(auto i: g.node_ids()){
-        z_values.push_back(g.pos[i][2]);
-        //cout << g.pos[i][2] << " ";
-    }
-    // cout << "Stop" << endl;
-    
-    //Sort the z values and find the X lowest nodes
-    int X = 30;
-    for(int i = 0; i < X; i++){
-        double min = 1000;
-        NodeID index;
-        for(int j = 0; j < z_values.size(); j++){
-            if(z_values[j] < min){
-                min = z_values[j];
-                index = j;
-            }
+        template<typename T>
+        bool read_pod(ifstream &is, T &x) {
+            return bool(is.read(reinterpret_cast<char*>(&x), sizeof(T)));
+        }
+
+        template<typename T>
+        bool read_vec(ifstream &is, vector<T> &v, size_t n) {
+            v.resize(n);
+            return bool(is.read(reinterpret_cast<char*>(v.data()), n * sizeof(T)));
         }
-        z_values_low.push_back(min);
-        z_values_low_index.push_back(index);
-        z_values[index] += 10;
-        g.node_color[index] = Vec3f(1, 0, 0);
     }
-    
-    int I = 0;
-    NodeID root_node;
-    for(int i = 0; i < z_values_low.size(); i++){
-        double angle = 1000;
-        auto NB = g.neighbors(z_values_low_index[i]);
-        for(auto j: NB){
-            if(g.pos[j][2] > z_values_low[i]){ //If the NB is a higher z value, find angle of edge relative to z-axis
-                angle = angle_z_axis(g, z_values_low_index[i], j);
-                
-                
-                if(angle < 45){
-                    I += 1;
-                    
-                    g.node_color[z_values_low_index[i]] = Vec3f(0, 1, 0); //Color the bottom node of the "vertical edge green"
-                    
-                    root_node = z_values_low_index[i];
-                }
+
+    bool multiscale_graph_save(const string &file_name, const MultiScaleGraph &msg) {
+        ofstream os(file_name, ios::binary);
+        if (!os)
+            return false;
+        os.write(MSG_MAGIC, 8);
+        write_pod(os, MSG_VERSION);
+        write_pod(os, uint32_t(msg.layers.size()));
+        for (size_t l = 0; l < msg.layers.size(); ++l) {
+            const auto &layer = msg.layers[l];
+            const uint64_t N = layer.no_nodes();
+            vector<uint64_t> offsets(N + 1, 0);
+            vector<uint64_t> nbrs;
+            vector<double> pos(3 * N);
+            for (NodeID n = 0; n < N; ++n) {
+                for (NodeID m: layer.neighbors(n))
+                    nbrs.push_back(m);
+                offsets[n + 1] = nbrs.size();
+                for (int c = 0; c < 3; ++c)
+                    pos[3 * n + c] = layer.pos[n][c];
             }
+            const auto &exp_map = msg.expansion_map_vec[l];
+            const vector<uint64_t> exp_offsets(exp_map.offset_vec().begin(), exp_map.offset_vec().end());
+            const vector<uint64_t> exp_ids(exp_map.id_vec().begin(), exp_map.id_vec().end());
+            const vector<uint64_t> caps(msg.capacity_vec_vec[l].begin(), msg.capacity_vec_vec[l].end());
+
+            write_pod(os, N);
+            write_pod(os, uint64_t(nbrs.size()));
+            write_pod(os, uint64_t(exp_ids.size()));
+            write_vec(os, pos);
+            write_vec(os, offsets);
+            write_vec(os, nbrs);
+            write_vec(os, exp_offsets);
+            write_vec(os, exp_ids);
+            write_vec(os, caps);
         }
-        
-        //Set limit for how many edge should be found
-        if(I > 0){
-            break;
+        return bool(os);
+    }
+
+    MultiScaleGraph multiscale_graph_load(const string &file_name) {
+        ifstream is(file_name, ios::binary | ios::ate);
+        if (!is)
+            return MultiScaleGraph();
+        const uint64_t file_size = is.tellg();
+        is.seekg(0);
+
+        char magic[8];
+        uint32_t version, L;
+        if (!is.read(magic, 8) || !equal(magic, magic + 8, MSG_MAGIC) ||
+            !read_pod(is, version) || version != MSG_VERSION || !read_pod(is, L))
+            return MultiScaleGraph();
+
+        // Checks that the ids of the CSR arrays offsets and ids are valid: the offsets start at zero, increase,
+        // and end at the size of ids, and the ids are less than id_bound.
+        auto valid_csr = [](const vector<uint64_t> &offsets, const vector<uint64_t> &ids, uint64_t id_bound) {
+            if (offsets.front() != 0 || offsets.back() != ids.size())
+                return false;
+            for (size_t n = 0; n + 1 < offsets.size(); ++n)
+                if (offsets[n] > offsets[n + 1])
+                    return false;
+            for (auto id: ids)
+                if (id >= id_bound)
+                    return false;
+            return true;
+        };
+
+        MultiScaleGraph msg;
+        uint64_t N_prev = 0;
+        for (uint32_t l = 0; l < L; ++l) {
+            uint64_t N, A, E;
+            if (!read_pod(is, N) || !read_pod(is, A) || !read_pod(is, E))
+                return MultiScaleGraph();
+
+            // Bound the counts by the rest of the file before anything is allocated. Each node takes 48 bytes
+            // (position, two offsets, capacity) and each adjacency and expansion id 8 bytes.
+            const uint64_t remaining = file_size - uint64_t(is.tellg());
+            if (N > remaining / 48 || A > remaining / 8 || E > remaining / 8 ||
+                48 * N + 16 + 8 * A + 8 * E > remaining)
+                return MultiScaleGraph();
+
+            vector<double> pos_flat;
+            vector<uint64_t> offsets, nbrs, exp_offsets, exp_ids, caps;
+            if (!read_vec(is, pos_flat, 3 * N) || !read_vec(is, offsets, N + 1) || !read_vec(is, nbrs, A) ||
+                !read_vec(is, exp_offsets, N + 1) || !read_vec(is, exp_ids, E) || !read_vec(is, caps, N))
+                return MultiScaleGraph();
+
+            // Layer 0 expands to itself and every other layer to the one before it.
+            if (!valid_csr(offsets, nbrs, N) || !valid_csr(exp_offsets, exp_ids, l == 0 ? N : N_prev))
+                return MultiScaleGraph();
+            N_prev = N;
+
+            vector<Vec3d> pos(N);
+            for (size_t n = 0; n < N; ++n)
+                pos[n] = Vec3d(pos_flat[3 * n], pos_flat[3 * n + 1], pos_flat[3 * n + 2]);
+            const vector<size_t> offsets_st(offsets.begin(), offsets.end());
+            const vector<NodeID> nbrs_id(nbrs.begin(), nbrs.end());
+            msg.layers.emplace_back(N, pos.data(), offsets_st.data(), nbrs_id.data());
+            msg.expansion_map_vec.emplace_back(vector<size_t>(exp_offsets.begin(), exp_offsets.end()),
+                                               vector<NodeID>(exp_ids.begin(), exp_ids.end()));
+            msg.capacity_vec_vec.emplace_back(caps.begin(), caps.end());
         }
+        return msg;
     }
     
-    
-    vector<NodeID> remove;
-    for(int i = 0; i < z_values_low_index.size(); i++){
-        if(g.pos[z_values_low_index[i]][2] < g.pos[root_node][2]){
-            g.remove_node(z_values_low_index[i]);
+    //Edits Helen
+
+    void color_detached_parts(Geometry::AMGraph3D& g){
+        const RootedTree tree = rooted_tree(g);
+        if(tree.root == AMGraph::InvalidNodeID)
+            return;
+        skel_log() << "root_node: " << tree.root << endl;
+
+        //Color all nodes that can not be reached from the root red
+        size_t loose_nodes = 0;
+        for(auto i: g.node_ids()) {
+            if(std::isnan(g.pos[i][0]))
+                continue;
+            if(tree.reached(i))
+                g.node_color[i] = Vec3f(0,0,0);
+            else {
+                g.node_color[i] = Vec3f(1,0,0);
+                ++loose_nodes;
+            }
         }
+
+        skel_log() << "loose nodes " << loose_nodes << endl;
+        skel_log() << "total number " << g.no_nodes() << endl;
+        skel_log() << "percentage of not connected nodes: " << (100.0 * loose_nodes) / g.no_nodes() << "%" << endl;
+        skel_log() << "branch segments " << tree.no_segments << " strahler order " << tree.strahler[tree.root] << endl;
     }
-    
-    cout << "root_node: " << root_node << endl;
-    
-    
-    cout << "** finished bottom_node_return function **" << endl;
-    return root_node;
-}
 
+    size_t reattach_detached_parts(Geometry::AMGraph3D& g, double max_gap, double max_angle, unsigned candidates) {
+        const NodeID root = skeleton_root(g);
+        if(root == AMGraph::InvalidNodeID)
+            return 0;
+        const double cos_max = cos(max_angle * M_PI / 180.0);
+        candidates = max(candidates, 1u);
 
-//Find distances to all nodes
-pair<AttribVec<NodeID, int>,AttribVec<NodeID, NodeID>> distance_to_all_nodes(Geometry::AMGraph3D& g){
-     cout << "** distance to all nodes function **" << endl;
-    //        NodeID s = skel_root_node(g);  //for branch 22
-    NodeID s = bottom_node_return(g); // for normal
-    NodeID next;
-    int walking = 0;
-    NodeID crossings = s; // should be equal to S, which is the starting vertex
-    
-    Util::AttribVec<NodeID, int> dist(g.no_nodes(),0);
-    Util::AttribVec<NodeID, NodeID> pred(g.no_nodes(),0);
-    Util::AttribVec<NodeID, NodeID> prev_crossing(g.no_nodes(),0);
-    Util::AttribVec<NodeID, int> cross_dist(g.no_nodes(),0);
-    
-    queue<NodeID> Q;
-    forward_list<NodeID> cross_node_Q{};
-    
-    dist[crossings] = 0; //dist to start vertex is 0
-    Q.push(crossings); // start vertex
-    
-    
-    while(!Q.empty()){
-        auto u = Q.front();
-        Q.pop();
-        auto no_NB = g.neighbors(u).size();
-        //            cout << no_NB << " no of NB" << endl;
-        
-        //        g.node_color[u] = Vec3f(1,0,0);
-        
-        //            straight branch
-        //            if(u  == s && dist[u] == 0){
-        
-        //
-        //                cout <<"found start vertex " << endl;
-        //                NodeID t;
-        //                for(auto w: g.neighbors(u)){ t = w; }
-        //                Q.push(t);
-        //                cross_node_Q.push_front(u);
-        //                next = t;
-        //                dist[u] = 1;
-        //                pred[next] = u;
-        //                walking += 1;
-        //
-        //            }
-        
-        if(no_NB == 2){
-            int check = 0;
-            for(auto t: g.neighbors(u)){ //go in the  right direction, the one notvisited before
-                if(dist[t] == 0){
-                                            cout << "At a straight edge part " << endl;
-                    Q.push(t);
-                    next = t;
-                }
-                else if(dist[t] != 0){
-                    check += 1;
-                }
-                
-            }
-            dist[u] = dist[pred[u]] + 1;
-            pred[next] = u;
-            walking += 1;
-            if(check == no_NB){
-                auto q = cross_node_Q.front();
-                cross_node_Q.pop_front();
-                cross_dist[q] += walking;
-                Q.push(q);
-                walking = 0;
-                                   cout << "Hopping, found no avaliable paths in straight branch" << endl;
-            }
-            
-        }
-        
-        //at a crossing
-        else if(no_NB > 2){
-                            cout <<"At a crossing " << endl;
-            int check = 0;
-            for(auto t: g.neighbors(u)){ //go in a direction in the crossing we havent been before
-                if(dist[t] == 0){
-                                            cout << "Going in a direction from the crossing " << endl;
-                    cross_node_Q.push_front(u);
-                    Q.push(t);
-                    pred[t] = u;
-                    dist[u] = dist[pred[u]] + 1;
-                    prev_crossing[u] = crossings;
-                    cross_dist[u] += walking;
-                    walking = 0;
-                    crossings = u;
-                    break;
-                }
-                //If we are at a crossing where all branches have been meet
-                else if(dist[t] != 0){
-                    check += 1;
-                    if(check == no_NB){
-                        if(cross_node_Q.empty()){ //if we have visited the whole tree then stop
-                            break;
-                        }
-                                                    cout << "last root we see " << u << endl;
-                        auto q = cross_node_Q.front();
-                        cross_node_Q.pop_front();
-                        cross_dist[q] += cross_dist[u];
-                        Q.push(q);
-                                                    cout << "hopping back" << endl;
+        struct Link {
+            double d = DBL_MAX;
+            NodeID a = AMGraph::InvalidNodeID, b = AMGraph::InvalidNodeID;
+        };
+
+        // The tree and the detached components are found once. The components are listed in order of
+        // increasing node id.
+        const RootedTree tree = rooted_tree(g, root);
+        const size_t N = g.no_nodes();
+        vector<int> comp(N, -1);
+        vector<vector<NodeID>> comps;
+        for(auto n: g.node_ids()) {
+            if(tree.reached(n) || comp[n] >= 0 || std::isnan(g.pos[n][0]))
+                continue;
+            comp[n] = comps.size();
+            vector<NodeID> nodes = {NodeID(n)};
+            for(size_t i = 0; i < nodes.size(); ++i)
+                for(auto m: g.neighbors(nodes[i]))
+                    if(comp[m] < 0) {
+                        comp[m] = comp[n];
+                        nodes.push_back(m);
                     }
-                    
-                }
-            }
+            sort(nodes.begin(), nodes.end());
+            comps.push_back(std::move(nodes));
         }
-        
-        //at branch ends or the start vertex
-        else if (no_NB == 1){
-            // If the vertex is the start vertex S
-            //go in the  right direction, the one not visited before
-            if(u == s ){ //should be start vertex S
-                                    cout <<"found start vertex " << endl;
-                NodeID t;
-                for(auto w: g.neighbors(u)){ t = w; }
-                Q.push(t);
-                next = t;
-                dist[u] = 1;
-                pred[next] = u;
-                walking += 1;
-            }
-            else if(1 == 1){
-                // if the vertex is a end of a branch
-                                    cout << "at the end of a branch " << endl;
-                dist[u] = dist[pred[u]] + 1;
-                
-                auto q = cross_node_Q.front();
-                cross_node_Q.pop_front();
-                cross_dist[q] += walking;
-                Q.push(q);
-                walking = 0;
+
+        // A component that is attached through the edge from a to b gets the parents that a depth first search of
+        // rooted_tree would give it, i.e. b is entered from a and the rest of the component from b.
+        vector<char> in_tree(N, 0);
+        for(auto n: tree.order)
+            in_tree[n] = 1;
+        auto parent = tree.parent;
+        vector<NodeID> new_nodes = tree.order;
+        vector<pair<NodeID, size_t>> stack;
+        auto enter_component = [&](NodeID a, NodeID b) {
+            in_tree[b] = 1;
+            parent[b] = a;
+            new_nodes.push_back(b);
+            stack.emplace_back(b, 0);
+            while(!stack.empty()) {
+                auto& [n, i] = stack.back();
+                const auto N_n = g.neighbors(n);
+                if(i == N_n.size()) {
+                    stack.pop_back();
+                    continue;
+                }
+                const NodeID m = N_n[i++];
+                if(in_tree[m])
+                    continue;
+                in_tree[m] = 1;
+                parent[m] = n;
+                new_nodes.push_back(m);
+                stack.emplace_back(m, 0);
             }
-            
-            
-            
-        }
-    }
-     cout << "** finished distance to all nodes function **" << endl;
-    return make_pair(dist,pred);
-}
+        };
 
-void color_detached_parts(Geometry::AMGraph3D& g){
-    
-    auto a_pair = distance_to_all_nodes(g);
-    auto dist = a_pair.first;
-    
-    KDTree<Vec3d, AMGraph3D::NodeID> tree_skeleton;
-    KDTree<Vec3d, AMGraph3D::NodeID> tree_branches;
-    
-    vector<NodeID> loose;
-    Util::AttribVec<NodeID, int> loose_seen(g.no_nodes(),0);  //part of the big skeleton, 0 loose branch, 1 has ben searched
-    
-    for(auto i: g.node_ids()){
-        g.node_color[i] = Vec3f(0,0,0);
-    }
-    
-    //Color all nodes that can not be reached red
-    NodeID lose_nodes = 0;
-    NodeID connected_nodes = 0;
-    for(auto i = 0; i < g.no_nodes(); i++ ) {
-        if(dist[i] == 0){
-            g.node_color[i] = Vec3f(1,0,0);
-            lose_nodes += 1;
-            
-            //Create a vector with these LOOSE nodes
-            loose.push_back(i);
-            tree_branches.insert(g.pos[i], i);
-            
-        }
-        else{
-            connected_nodes += 1;
-            tree_skeleton.insert(g.pos[i], i);
+        // A component that could not be attached in a round had no admissible edge to the tree nodes of that round,
+        // so in the next round it is only compared to the nodes attached in the round. Each node is thus inserted
+        // in a KD-tree once.
+        vector<size_t> remaining(comps.size());
+        iota(remaining.begin(), remaining.end(), 0);
+        size_t attached = 0;
+        for(int round = 0; !remaining.empty(); ++round) {
+            KDTree<Vec3d, NodeID> tree_skeleton;
+            for(auto n: new_nodes)
+                tree_skeleton.insert(g.pos[n], n);
+            tree_skeleton.build();
+
+            // Each component is linked through the shortest edge to a tree node within max_gap. The edge must
+            // not deviate more than max_angle from the direction in which the tree grows at the tree node.
+            vector<Link> links(remaining.size());
+            parallel_for(remaining.size(), [&](size_t i, unsigned) {
+                Link& best = links[i];
+                for(auto b: comps[remaining[i]])
+                    for(const auto& rec: tree_skeleton.m_closest(candidates, g.pos[b], max_gap)) {
+                        const NodeID a = rec.v;
+                        const Vec3d edge = g.pos[b] - g.pos[a];
+                        const double d = length(edge);
+                        if(d > best.d || (d == best.d && make_pair(a, b) >= make_pair(best.a, best.b)))
+                            continue;
+                        const NodeID p = parent[a];
+                        const Vec3d growth = p == AMGraph::InvalidNodeID ? Vec3d(0,0,1) : g.pos[a] - g.pos[p];
+                        if(max_angle < 180.0 && dot(edge, growth) < cos_max * d * length(growth))
+                            continue;
+                        best = {d, a, b};
+                    }
+            });
+
+            new_nodes.clear();
+            vector<size_t> still_detached;
+            for(size_t i = 0; i < remaining.size(); ++i)
+                if(links[i].a != AMGraph::InvalidNodeID) {
+                    g.connect_nodes(links[i].a, links[i].b);
+                    enter_component(links[i].a, links[i].b);
+                }
+                else
+                    still_detached.push_back(remaining[i]);
+            const size_t attached_round = remaining.size() - still_detached.size();
+            skel_log() << "reattach round " << round << ": " << attached_round << " of " << remaining.size()
+                       << " detached parts attached" << endl;
+            attached += attached_round;
+            if(attached_round == 0)
+                break;
+            remaining.swap(still_detached);
         }
+        return attached;
     }
-    
-    tree_skeleton.build();
-    tree_branches.build();
-    
-    cout << "loose nodes " << lose_nodes << endl;
-    cout << "total number " << g.no_nodes() << endl;
-    
-    double percentage_not_connected = (static_cast<float>(lose_nodes) / g.no_nodes()) * 100.0f;
-    cout << "percentage of not connected nodes: " << percentage_not_connected << "%" << endl;
-}
 
 }
@@ -9,8 +9,16 @@
 #ifndef graph_skeletonize_hpp
 #define graph_skeletonize_hpp
 
+#include <cfloat>
+#include <cstdint>
+#include <ostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <GEL/Util/AttribVec.h>
 #include <GEL/Geometry/Graph.h>
+#include <GEL/Geometry/CSRGraph.h>
 #include "GEL/CGLA/Vec3d.h"
 
 namespace Geometry {
@@ -20,7 +28,6 @@ namespace Geometry {
     using NodeSetUnordered = std::unordered_set<NodeID>;
     using NodeSetVec = std::vector<std::pair<double, NodeSet>>;
     using AttribVecDouble = Util::AttribVec<NodeID, double>;
-    using ExpansionMap = std::vector<std::vector<AMGraph::NodeID>>;
     using CapacityVecVec = std::vector<std::vector<size_t>>;
 
     // A more advanced separator than the NodeSetVec elements.
@@ -44,30 +51,111 @@ namespace Geometry {
         };
     };
 
-    // A set of graphs of different sizes representing the same original graph.
+    /** Maps each node of a layer of a multi-scale graph to the nodes of the layer below which it was
+     contracted from. The lists are stored back to back in one array. */
+    class ExpansionMap {
+        std::vector<size_t> offsets = std::vector<size_t>(1, 0);
+        std::vector<AMGraph::NodeID> ids;
+    public:
+        ExpansionMap() {}
+
+        /// Create the map from flat arrays. The nodes of n are ids[offsets[n]] up to ids[offsets[n+1]].
+        ExpansionMap(std::vector<size_t>&& _offsets, std::vector<AMGraph::NodeID>&& _ids):
+        offsets(std::move(_offsets)), ids(std::move(_ids)) {}
+
+        /// The identity map on N nodes.
+        static ExpansionMap identity(size_t N);
+
+        /// Number of nodes in the layer the map expands from.
+        size_t size() const { return offsets.size() - 1; }
+
+        /// Nodes of the layer below which node n expands to.
+        IDRange<AMGraph::NodeID> operator[](AMGraph::NodeID n) const {
+            return IDRange<AMGraph::NodeID>(ids.data() + offsets[n], ids.data() + offsets[n+1]);
+        }
+
+        const std::vector<size_t>& offset_vec() const { return offsets; }
+        const std::vector<AMGraph::NodeID>& id_vec() const { return ids; }
+    };
+
+    /** A set of graphs of different sizes representing the same original graph. The layers are frozen
+     graphs since they are only searched. Layer 0 is the original graph. A multi-scale graph only depends on
+     the original graph and the threshold, so it can be built once, saved with multiscale_graph_save, and
+     passed to multiscale_local_separators for any number of runs with different parameters. */
     struct MultiScaleGraph {
-        std::vector<AMGraph3D> layers;
+        std::vector<CSRGraph3D> layers;
         std::vector<ExpansionMap> expansion_map_vec; // expansion_map_vec[layer][nodeID]
         CapacityVecVec capacity_vec_vec; // capacity_vec_vec[layer][nodeID]
     };
 
+    /** Counts and timings gathered while computing local separators. Pass a pointer to an instance to
+     local_separators or multiscale_local_separators to get the statistics of a run. Times are wall clock
+     seconds, and phases that do not apply to a given method are zero. */
+    struct SkeletonizationStats {
+        size_t separators_computed = 0; // Number of separator searches.
+        size_t separators_found = 0;    // Number of searches that produced a separator.
+        size_t separators_packed = 0;   // Number of separators that survived packing.
+
+        double time_sampling = 0;       // Choosing the nodes to grow separators from.
+        double time_multiscale = 0;     // Building the multi-scale graph.
+        double time_searching = 0;      // Growing separators.
+        double time_filtering = 0;      // Removing duplicate separators.
+        double time_packing = 0;        // Packing separators.
+        double time_expanding = 0;      // Expanding separators to the next level and shrinking them.
+
+        /// The time spent expanding and shrinking separators from each level to the next, coarsest level first.
+        std::vector<double> time_expanding_per_level;
+
+        /// The time each thread spent growing, expanding or shrinking separators.
+        std::vector<double> thread_busy_time;
+
+        /// The peak resident memory of the process in bytes at the end of the run. Zero if unavailable.
+        size_t peak_memory = 0;
+    };
+
+    /// Print the statistics in human readable form.
+    std::ostream& operator<<(std::ostream& os, const SkeletonizationStats& stats);
+
+    /** Turn printing of progress and statistics from the skeletonization functions to std::cout on or off.
+     It is off by default. */
+    void set_skeletonization_logging(bool on);
+
+    /** Set the seed used when the skeletonization functions sample the nodes to grow separators from. Each sampling
+     decision draws from its own random stream derived from the seed, and the decision for a node only depends on
+     the separators of the nodes before it in a fixed order. The separators are grown in parallel ahead of time and
+     discarded if the node turns out not to be sampled. Hence, the same input and seed give the same skeleton
+     regardless of the number of threads. The default seed is 1. */
+    void set_skeletonization_seed(uint64_t seed);
+
     /**
      * @brief Create a multi-scale graph of an input graph.
      * @param g the input graph.
      * @param threshold the size of the smallest layer.
-     * @param recursive if the layers are created from the original graph or from the previous layer.
+     * @param recursive is ignored. Each layer is always created from the previous layer.
      * @return A multi-scale graph of g.
      *
      * The multi-scale graph is created by simplifying g repeatedly by edge contractions. Each layer is
-     * half the size of the previous layer. Using recursive affects how the simplification can be reversed
-     * with the expansion map.
+     * half the size of the previous layer, and the expansion map of a layer maps its nodes to the nodes of the
+     * previous layer. Each contraction pass is a greedy matching of the shortest edges, and the
+     * edges are collected and the contracted layers built in parallel.
      */
     MultiScaleGraph multiscale_graph(const AMGraph3D &g, size_t threshold, bool recursive);
 
+    /// Same as above for a frozen graph.
+    MultiScaleGraph multiscale_graph(const CSRGraph3D &g, size_t threshold);
+
+    /// Save a multi-scale graph in a binary file. Returns false if the file could not be written.
+    bool multiscale_graph_save(const std::string& file_name, const MultiScaleGraph& msg);
+
+    /// Load a multi-scale graph saved with multiscale_graph_save. Returns an empty graph on failure.
+    MultiScaleGraph multiscale_graph_load(const std::string& file_name);
+
     /**
      @brief Compute separators by marching a front along a scalar field.
      @param g  the graph that we operate on.
      @param dvv  a vector of scalar fields defined on the graph vertices.
+     @param passes  the number of times a front is marched. The passes cycle through the fields, and each
+     pass uses its own random order of start nodes. At least one pass is made per field.
      @returns This function returns a vector of NodeSets containing a
      number of non-overlapping (local) separators.
      
@@ -76,9 +164,11 @@ namespace Geometry {
      given point in time.  These are then greedily packed, producing the final
      vector of non-overlapping node sets which is then returned.  This can be seen
      as a mix of Reeb graphs - or as a representation which can be turned into that.
+     The passes run in parallel on at most Util::thread_count() threads, and the result does not
+     depend on the number of threads.
      */
     NodeSetVec front_separators(AMGraph3D &g,
-                                const std::vector<AttribVecDouble> &dvv);
+                                const std::vector<AttribVecDouble> &dvv, size_t passes = 50);
 
 
     /**
@@ -95,6 +185,11 @@ namespace Geometry {
     local_separator(const AMGraph3D &g, NodeID n0, double quality_noise_level, int optimization_steps,
                     size_t growth_threshold = -1, const CGLA::Vec3d* static_centre = nullptr);
 
+    /// Same as above but for a frozen graph which is much faster to traverse.
+    Separator
+    local_separator(const CSRGraph3D &g, NodeID n0, double quality_noise_level, int optimization_steps,
+                    size_t growth_threshold = -1, const CGLA::Vec3d* static_centre = nullptr);
+
 
     enum class SamplingType {
         None, Basic, Advanced
@@ -134,15 +229,25 @@ namespace Geometry {
     NodeSetVec local_separators(AMGraph3D &g, SamplingType sampling = SamplingType::None,
                                 double quality_noise_level = 0.09,
                                 int optimization_steps = 0,
-                                size_t advanced_sampling_threshold = 64);
+                                size_t advanced_sampling_threshold = 64,
+                                SkeletonizationStats* stats = nullptr);
+
+    /** Compute local separators on a frozen graph. Unlike the AMGraph3D version, the node colors are not changed.
+     The AMGraph3D version freezes its input and calls this function. */
+    NodeSetVec local_separators(const CSRGraph3D &g, SamplingType sampling = SamplingType::None,
+                                double quality_noise_level = 0.09,
+                                int optimization_steps = 0,
+                                size_t advanced_sampling_threshold = 64,
+                                SkeletonizationStats* stats = nullptr);
 
     inline NodeSetVec local_separators(AMGraph3D &g, bool sampling = false,
                                        double quality_noise_level = 0.09,
-                                       int optimization_steps = 0) {
+                                       int optimization_steps = 0,
+                                       SkeletonizationStats* stats = nullptr) {
         if (sampling) {
-            return local_separators(g, SamplingType::Basic, quality_noise_level, optimization_steps);
+            return local_separators(g, SamplingType::Basic, quality_noise_level, optimization_steps, 64, stats);
         } else {
-            return local_separators(g, SamplingType::None, quality_noise_level, optimization_steps);
+            return local_separators(g, SamplingType::None, quality_noise_level, optimization_steps, 64, stats);
         }
     }
 
@@ -160,7 +265,18 @@ namespace Geometry {
     NodeSetVec multiscale_local_separators(AMGraph3D &g, SamplingType sampling = SamplingType::Advanced,
                                 size_t grow_threshold = 64,
                                 double quality_noise_level = 0.09,
-                                int optimization_steps = 0);
+                                int optimization_steps = 0,
+                                SkeletonizationStats* stats = nullptr);
+
+    /** Same as above but uses a multi-scale graph which has already been built from g, e.g. with
+     multiscale_graph(g, grow_threshold, true). Layer 0 of msg must have the nodes of g. This saves building
+     the hierarchy when the function is called repeatedly on the same graph with different parameters. */
+    NodeSetVec multiscale_local_separators(AMGraph3D &g, const MultiScaleGraph &msg,
+                                SamplingType sampling = SamplingType::Advanced,
+                                size_t grow_threshold = 64,
+                                double quality_noise_level = 0.09,
+                                int optimization_steps = 0,
+                                SkeletonizationStats* stats = nullptr);
 
 
     /**
@@ -180,8 +296,7 @@ namespace Geometry {
      connected by an edge, we connect the corresponding skeletal vertices.  Normally, we have
      merge=true and all of the thriangles in the graph are reduced to Steiner-like vertices.  The
      graph structure has a color associated with vertices, and we color the Steiner vertices red.
-     The green channel is used to store the estimated radius.  In a better API, we would output these
-     things as separate attributes.
+     The estimated radius of each skeletal node is stored in node_radius.
      */
     std::pair<AMGraph3D, Util::AttribVec<AMGraph3D::NodeID, AMGraph3D::NodeID>>
     skeleton_from_node_set_vec(AMGraph3D &g,
@@ -189,6 +304,76 @@ namespace Geometry {
                                bool merge = true,
                                int smooth_steps = 0);
 
+    /** IncrementalSkeleton keeps the local separators of a graph together with the packing of them, so the skeleton
+     can be updated after small edits of the graph without starting over. A candidate separator is grown from every
+     node, as local_separators does without sampling, and the initial packing is the same as that of local_separators.
+
+     The graph is not copied. It is edited in place through the class, so it must outlive the IncrementalSkeleton and
+     must not be edited otherwise. A search only reads the edges of the nodes within optimization_steps+1 hops of the
+     nodes swallowed by its sphere, and an edit only changes the edges of the nodes it touches. Hence, a search that
+     read none of the touched nodes would find the same separator again. For each seed, we keep the distance to the
+     farthest node whose edges were read, and when update is called, the separators of the seeds within that distance
+     of a touched node are grown again. The seeds are found through a uniform grid, so an update costs time
+     proportional to the number of searches which came near the edits. The packed separators which were regrown are
+     released, and the candidates near them are packed greedily again in the usual order of weight divided by
+     opportunity cost, while the rest of the packing is kept. Since the packing is only redone locally, it may differ
+     from what local_separators would produce for the edited graph.
+     */
+    class IncrementalSkeleton {
+        AMGraph3D& g;
+        double quality_noise_level;
+        int optimization_steps;
+
+        std::vector<std::pair<double, NodeSet>> candidate; // The separator grown from each node
+        std::vector<double> sqr_reach;                     // Squared distance from each seed to the nodes its search read
+        std::vector<std::vector<NodeID>> seeds_of_node;    // The seeds whose separators contain each node
+        std::vector<NodeID> owner;                         // The seed of the packed separator containing each node
+        std::set<NodeID> packed;                           // The seeds of the packed separators
+        double max_sqr_reach = 0.0;
+
+        double cell_size = 1.0;
+        std::unordered_map<uint64_t, std::vector<NodeID>> grid;
+        std::vector<CGLA::Vec3d> dirty;                    // Positions of the nodes whose edges were changed
+        std::vector<NodeID> removed;
+
+        bool in_use(NodeID n) const;
+        uint64_t cell_key(int64_t i, int64_t j, int64_t k) const;
+        uint64_t cell_key(const CGLA::Vec3d& p) const;
+        void grid_insert(NodeID n);
+        void grid_erase(NodeID n, const CGLA::Vec3d& p);
+        void grow(const std::vector<NodeID>& seeds);
+        void unpack(NodeID s, std::vector<NodeID>& freed);
+        void pack(std::vector<NodeID> seeds);
+
+    public:
+        /// Compute the separators of g and pack them.
+        explicit IncrementalSkeleton(AMGraph3D& g, double quality_noise_level = 0.09, int optimization_steps = 0);
+
+        /// The graph in its current state.
+        const AMGraph3D& graph() const { return g; }
+
+        /// Add a node without edges at p. No search is affected until the node is connected.
+        NodeID add_node(const CGLA::Vec3d& p);
+
+        /// The edits below do nothing if a node id is out of range or refers to a removed node.
+        void remove_node(NodeID n);
+        void connect_nodes(NodeID n0, NodeID n1);
+        void disconnect_nodes(NodeID n0, NodeID n1);
+
+        /// Regrow the separators affected by the edits made since the last update and repack. Returns the number regrown.
+        size_t update();
+
+        /// The separator grown from n as of the last update. It is empty if the search failed or n is not a node.
+        const std::pair<double, NodeSet>& candidate_separator(NodeID n) const;
+
+        /// The packed separators in order of their seeds. This takes time proportional to their total size.
+        NodeSetVec separators() const;
+
+        /** The skeleton of the current graph and the map from graph nodes to skeletal nodes. Since every node is
+         mapped, this takes time proportional to the size of the graph. */
+        std::pair<AMGraph3D, Util::AttribVec<AMGraph3D::NodeID, AMGraph3D::NodeID>> skeleton();
+    };
+
     /**
      @brief Convert a set of nodes into a set that partitions the graph
      @param g the input graph
@@ -203,7 +388,25 @@ namespace Geometry {
     NodeSetVec maximize_node_set_vec(AMGraph3D &g, const NodeSetVec &node_set_vec);
     
     // Edits Helen
+    /** Colour the nodes of a tree skeleton black if they are connected to the root found by skeleton_root
+     and red otherwise. The analysis is done by rooted_tree (see graph_tree.h). */
     void color_detached_parts(Geometry::AMGraph3D& g);
 
+    /** @brief Connect the parts of a tree skeleton which are detached from the root to the rest of the tree.
+     @param g the skeleton graph which is modified by adding edges
+     @param max_gap the longest edge that may be added
+     @param max_angle the largest angle (in degrees) between an added edge and the direction from the parent of the
+     tree node it attaches to towards that tree node. The default of 180 means no constraint.
+     @param candidates the number of nearest tree nodes considered for each node of a detached part
+     @returns the number of detached parts which were attached
+
+     Each detached component is connected through the shortest admissible edge found among the nearest tree nodes
+     of its nodes. The queries for all components run in parallel against a KD-tree of the tree nodes. Components that
+     cannot reach the tree may be attached to a component attached in the same call, so the procedure is repeated until
+     no more parts can be attached. The tree and the components are only computed once, and each repetition queries a
+     KD-tree of just the nodes attached by the previous one, so every node is inserted in a KD-tree once. */
+    size_t reattach_detached_parts(Geometry::AMGraph3D& g, double max_gap = DBL_MAX, double max_angle = 180.0,
+                                   unsigned candidates = 8);
+
 }
 #endif /* graph_skeletonize_hpp */
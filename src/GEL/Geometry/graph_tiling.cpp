@@ -0,0 +1,190 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <GEL/Util/Parallel.h>
+#include <GEL/Geometry/KDTree.h>
+#include <GEL/Geometry/graph_io.h>
+#include <GEL/Geometry/graph_skeletonize.h>
+#include <GEL/Geometry/graph_tiling.h>
+
+using namespace std;
+using namespace CGLA;
+
+namespace Geometry {
+    using NodeID = AMGraph::NodeID;
+
+    namespace {
+        /// The xy plane divided into nx by ny square tiles. Positions outside the grid belong to the closest tile.
+        struct TileGrid {
+            double x0 = 0, y0 = 0, size = 1;
+            long nx = 0, ny = 0;
+
+            long tile_x(const Vec3d& p) const { return clamp(long(floor((p[0] - x0) / size)), 0L, nx - 1); }
+            long tile_y(const Vec3d& p) const { return clamp(long(floor((p[1] - y0) / size)), 0L, ny - 1); }
+            size_t tile(const Vec3d& p) const { return tile_y(p) * nx + tile_x(p); }
+            size_t no_tiles() const { return nx * ny; }
+        };
+
+        /// The part of a tile's skeleton that the tile owns.
+        struct TileSkeleton {
+            vector<Vec3d> pos;
+            vector<double> radius;
+            vector<pair<size_t, size_t>> edges;
+
+            /// Edges leaving the tile: the local node and the position of the node at the far end.
+            vector<pair<size_t, Vec3d>> crossings;
+        };
+
+        TileSkeleton skeletonize_tile(const vector<Vec3d>& tile_pts, const TileGrid& grid, size_t t,
+                                      double rad, int N_closest, bool multiscale, size_t grow_threshold) {
+            TileSkeleton ts;
+            AMGraph3D g = graph_from_points(tile_pts, rad, N_closest);
+            if (g.no_nodes() == 0)
+                return ts;
+            NodeSetVec nsv = multiscale ?
+                    multiscale_local_separators(g, SamplingType::Advanced, grow_threshold) :
+                    local_separators(g, SamplingType::Advanced);
+            auto [skel, _] = skeleton_from_node_set_vec(g, nsv);
+            g.clear();
+
+            vector<size_t> local(skel.no_nodes(), SIZE_MAX);
+            for (NodeID n: skel.node_ids())
+                if (!std::isnan(skel.pos[n][0]) && grid.tile(skel.pos[n]) == t) {
+                    local[n] = ts.pos.size();
+                    ts.pos.push_back(skel.pos[n]);
+                    ts.radius.push_back(skel.node_radius[n]);
+                }
+            for (NodeID n: skel.node_ids())
+                if (local[n] != SIZE_MAX)
+                    for (auto m: skel.neighbors(n)) {
+                        if (local[m] == SIZE_MAX)
+                            ts.crossings.emplace_back(local[n], skel.pos[m]);
+                        else if (n < m)
+                            ts.edges.emplace_back(local[n], local[m]);
+                    }
+            return ts;
+        }
+    }
+
+    AMGraph3D tiled_skeleton(const vector<Vec3d>& pts, double rad, int N_closest,
+                             double tile_size, double overlap, bool multiscale,
+                             size_t grow_threshold, unsigned int max_tiles) {
+        AMGraph3D skel;
+        // Crossing edges are stitched to nodes within overlap of their far end, so without an overlap the
+        // tiles would never be joined.
+        if (!(tile_size > 0) || !(overlap > 0))
+            return skel;
+        overlap = min(overlap, tile_size);
+
+        // Set up the grid and sort the point indices by tile.
+        Vec3d p_min(DBL_MAX), p_max(-DBL_MAX);
+        for (const auto& p: pts)
+            if (!std::isnan(p[0])) {
+                p_min = v_min(p_min, p);
+                p_max = v_max(p_max, p);
+            }
+        if (p_min[0] > p_max[0])
+            return skel;
+
+        // Tiles that outnumber the points cannot hold enough points to be skeletonized, and a tiny tile_size could
+        // otherwise make the grid arrays arbitrarily large.
+        const double nx = floor((p_max[0] - p_min[0]) / tile_size) + 1;
+        const double ny = floor((p_max[1] - p_min[1]) / tile_size) + 1;
+        if (nx * ny > double(pts.size()))
+            return skel;
+        TileGrid grid;
+        grid.x0 = p_min[0];
+        grid.y0 = p_min[1];
+        grid.size = tile_size;
+        grid.nx = long(nx);
+        grid.ny = long(ny);
+
+        const size_t T = grid.no_tiles();
+        vector<size_t> offsets(T + 1, 0);
+        for (const auto& p: pts)
+            if (!std::isnan(p[0]))
+                ++offsets[grid.tile(p) + 1];
+        for (size_t t = 0; t < T; ++t)
+            offsets[t + 1] += offsets[t];
+        vector<size_t> tile_pts_idx(offsets[T]);
+        vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < pts.size(); ++i)
+            if (!std::isnan(pts[i][0]))
+                tile_pts_idx[fill[grid.tile(pts[i])]++] = i;
+
+        // Each tile runs with its share of the threads, so at most max_tiles tile graphs are alive at a time. The
+        // ThreadLimit is handed on by parallel_for to the threads it starts, so it holds at every level of nesting.
+        const unsigned int threads = Util::thread_count();
+        const unsigned int in_flight = min(max_tiles == 0 ? threads : max_tiles, threads);
+        vector<TileSkeleton> tiles(T);
+        Util::parallel_for(T, [&](size_t t, unsigned int) {
+            if (offsets[t] == offsets[t + 1])
+                return;
+            Util::ThreadLimit limit(max(1u, threads / in_flight));
+            const long tx = t % grid.nx;
+            const long ty = t / grid.nx;
+            const double x_lo = grid.x0 + tx * tile_size - overlap;
+            const double x_hi = grid.x0 + (tx + 1) * tile_size + overlap;
+            const double y_lo = grid.y0 + ty * tile_size - overlap;
+            const double y_hi = grid.y0 + (ty + 1) * tile_size + overlap;
+
+            vector<Vec3d> tile_pts;
+            for (long y = max(ty - 1, 0L); y <= min(ty + 1, grid.ny - 1); ++y)
+                for (long x = max(tx - 1, 0L); x <= min(tx + 1, grid.nx - 1); ++x) {
+                    const size_t u = y * grid.nx + x;
+                    for (size_t k = offsets[u]; k < offsets[u + 1]; ++k) {
+                        const Vec3d& p = pts[tile_pts_idx[k]];
+                        if (p[0] >= x_lo && p[0] <= x_hi && p[1] >= y_lo && p[1] <= y_hi)
+                            tile_pts.push_back(p);
+                    }
+                }
+            tiles[t] = skeletonize_tile(tile_pts, grid, t, rad, N_closest, multiscale, grow_threshold);
+        }, 1, in_flight);
+
+        // Assemble the tile skeletons in tile order.
+        vector<size_t> first(T, 0);
+        vector<size_t> tile_of;
+        for (size_t t = 0; t < T; ++t) {
+            first[t] = skel.no_nodes();
+            for (size_t i = 0; i < tiles[t].pos.size(); ++i) {
+                NodeID n = skel.add_node(tiles[t].pos[i]);
+                skel.node_radius[n] = tiles[t].radius[i];
+                tile_of.push_back(t);
+            }
+            for (const auto& [a, b]: tiles[t].edges)
+                skel.connect_nodes(first[t] + a, first[t] + b);
+        }
+
+        // Stitch the edges that leave a tile to the nearest node of another tile. An edge across a border is
+        // often seen by only one of the two tiles, so the crossings of both tiles are stitched, and the node pairs
+        // which both tiles agree on are connected once.
+        if (skel.no_nodes() == 0)
+            return skel;
+        KDTree<Vec3d, NodeID> tree;
+        for (auto n: skel.node_ids())
+            tree.insert(skel.pos[n], n);
+        tree.build();
+        vector<pair<NodeID, NodeID>> stitches;
+        for (size_t t = 0; t < T; ++t)
+            for (const auto& [a, p]: tiles[t].crossings)
+                for (const auto& rec: tree.m_closest(8, p, overlap))
+                    if (tile_of[rec.v] != t) {
+                        const NodeID n = first[t] + a;
+                        stitches.emplace_back(min(n, rec.v), max(n, rec.v));
+                        break;
+                    }
+        sort(stitches.begin(), stitches.end());
+        stitches.erase(unique(stitches.begin(), stitches.end()), stitches.end());
+        for (const auto& [n, m]: stitches)
+            skel.connect_nodes(n, m);
+        return skel;
+    }
+}
@@ -0,0 +1,43 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#ifndef graph_tiling_h
+#define graph_tiling_h
+
+#include <vector>
+#include <GEL/CGLA/Vec3d.h>
+#include <GEL/Geometry/Graph.h>
+
+namespace Geometry {
+
+    /**
+     @brief Skeletonize a point cloud which is too big to be turned into a single graph.
+     @param pts the points. Points with NaN coordinates are skipped.
+     @param rad the radius within which two points are connected (as in graph_from_points)
+     @param N_closest the maximum number of neighbors each point is connected to (as in graph_from_points)
+     @param tile_size the side length of the square tiles that the xy plane is divided into
+     @param overlap the width of the band around each tile from which points are also included. It must be positive
+     since the tiles are stitched within this distance, and it is clamped to tile_size.
+     @param multiscale if true multiscale_local_separators is used, otherwise local_separators
+     @param grow_threshold passed on to multiscale_local_separators
+     @param max_tiles the maximum number of tiles processed at the same time. Zero means Util::thread_count().
+     @returns the skeleton of the entire point cloud. Node radii are stored in node_radius. An empty graph is returned
+     if tile_size or overlap is not positive, or if the tiles would outnumber the points.
+
+     The tiles are columns that span the whole extent in z, which suits scans of terrain and forest stands. For
+     each tile a graph is built from the points within the tile and its overlap band, and this graph is skeletonized
+     on its own. Only the skeletal nodes which lie inside the tile are kept. A skeletal edge from such a node to a node
+     outside the tile is instead connected to the nearest kept skeletal node of another tile within overlap of its
+     far end. This is done for the crossing edges of both tiles at a border, and each pair of nodes is connected
+     once. Thus, only max_tiles graphs exist at a time, and the threads are shared among the tiles in flight.
+     The points themselves are kept in memory. The result does not depend on the number of threads.
+     */
+    AMGraph3D tiled_skeleton(const std::vector<CGLA::Vec3d>& pts, double rad, int N_closest,
+                             double tile_size, double overlap, bool multiscale = true,
+                             size_t grow_threshold = 64, unsigned int max_tiles = 0);
+}
+
+#endif /* graph_tiling_h */
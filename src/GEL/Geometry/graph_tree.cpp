@@ -0,0 +1,142 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <GEL/Geometry/graph_tree.h>
+
+using namespace std;
+using namespace CGLA;
+
+namespace Geometry {
+    using NodeID = AMGraph::NodeID;
+
+    namespace {
+        template<typename GraphT>
+        NodeID find_root(const GraphT& g, size_t candidates, double max_angle) {
+            vector<pair<double, NodeID>> low;
+            low.reserve(g.no_nodes());
+            for (auto n: g.node_ids())
+                if (!std::isnan(g.pos[n][2]))
+                    low.emplace_back(g.pos[n][2], n);
+            if (low.empty())
+                return AMGraph::InvalidNodeID;
+
+            const size_t K = max(size_t(1), min(candidates, low.size()));
+            nth_element(low.begin(), low.begin() + (K-1), low.end());
+            sort(low.begin(), low.begin() + K);
+
+            const double cos_max = cos(max_angle * M_PI / 180.0);
+            for (size_t i = 0; i < K; ++i) {
+                const NodeID n = low[i].second;
+                for (auto m: g.neighbors(n)) {
+                    const Vec3d d = g.pos[m] - g.pos[n];
+                    if (d[2] > 0 && d[2] > cos_max * length(d))
+                        return n;
+                }
+            }
+            return low[0].second;
+        }
+    }
+
+    NodeID skeleton_root(const AMGraph3D& g, size_t candidates, double max_angle) {
+        return find_root(g, candidates, max_angle);
+    }
+
+    NodeID skeleton_root(const CSRGraph3D& g, size_t candidates, double max_angle) {
+        return find_root(g, candidates, max_angle);
+    }
+
+    RootedTree rooted_tree(const CSRGraph3D& g, NodeID root) {
+        const size_t N = g.no_nodes();
+        RootedTree t;
+        t.parent = Util::AttribVec<NodeID, NodeID>(N, AMGraph::InvalidNodeID);
+        t.depth = Util::AttribVec<NodeID, int>(N, -1);
+        t.path_length = Util::AttribVec<NodeID, double>(N, 0.0);
+        t.subtree_size = Util::AttribVec<NodeID, size_t>(N, 0);
+        t.strahler = Util::AttribVec<NodeID, int>(N, 0);
+        t.segment = Util::AttribVec<NodeID, int>(N, -1);
+        t.child_offsets.assign(N+1, 0);
+
+        if (root == AMGraph::InvalidNodeID)
+            root = skeleton_root(g);
+        if (!g.valid_node_id(root))
+            return t;
+        t.root = root;
+
+        // Depth first search. The stack holds each node on the current path with the index of the next neighbor to
+        // visit, so nodes are discovered in the same order as a recursive search would discover them.
+        vector<pair<NodeID, size_t>> stack;
+        t.order.reserve(N);
+        t.order.push_back(root);
+        t.depth[root] = 0;
+        stack.emplace_back(root, 0);
+        while (!stack.empty()) {
+            auto& [n, i] = stack.back();
+            const auto N_n = g.neighbors(n);
+            if (i == N_n.size()) {
+                stack.pop_back();
+                continue;
+            }
+            const NodeID m = N_n[i++];
+            if (t.depth[m] >= 0)
+                continue;
+            t.parent[m] = n;
+            t.depth[m] = t.depth[n] + 1;
+            t.path_length[m] = t.path_length[n] + length(g.pos[m] - g.pos[n]);
+            t.order.push_back(m);
+            stack.emplace_back(m, 0);
+        }
+
+        // Children in CSR form. Filling in pre-order keeps the children of each node in the order they were found.
+        for (auto n: t.order)
+            if (n != root)
+                ++t.child_offsets[t.parent[n] + 1];
+        for (size_t n = 0; n < N; ++n)
+            t.child_offsets[n+1] += t.child_offsets[n];
+        t.children_vec.resize(t.order.size() - 1);
+        vector<size_t> fill(t.child_offsets.begin(), t.child_offsets.end() - 1);
+        for (auto n: t.order)
+            if (n != root)
+                t.children_vec[fill[t.parent[n]]++] = n;
+
+        // Children come after their parent in pre-order, so a reverse sweep sees all children of a node first.
+        for (auto it = t.order.rbegin(); it != t.order.rend(); ++it) {
+            const NodeID n = *it;
+            size_t size = 1;
+            int max_order = 0;
+            int max_count = 0;
+            for (auto c: t.children(n)) {
+                size += t.subtree_size[c];
+                if (t.strahler[c] > max_order) {
+                    max_order = t.strahler[c];
+                    max_count = 1;
+                }
+                else if (t.strahler[c] == max_order)
+                    ++max_count;
+            }
+            t.subtree_size[n] = size;
+            t.strahler[n] = max_order == 0 ? 1 : (max_count > 1 ? max_order + 1 : max_order);
+        }
+
+        // A node continues the segment of its parent if it is the only child.
+        for (auto n: t.order) {
+            const NodeID p = t.parent[n];
+            if (p == AMGraph::InvalidNodeID || t.child_offsets[p+1] - t.child_offsets[p] != 1)
+                t.segment[n] = t.no_segments++;
+            else
+                t.segment[n] = t.segment[p];
+        }
+        return t;
+    }
+
+    RootedTree rooted_tree(const AMGraph3D& g, NodeID root) {
+        if (root == AMGraph::InvalidNodeID)
+            root = skeleton_root(g);
+        return rooted_tree(CSRGraph3D(g), root);
+    }
+}
@@ -0,0 +1,89 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#ifndef graph_tree_h
+#define graph_tree_h
+
+#include <vector>
+#include <GEL/Geometry/Graph.h>
+#include <GEL/Geometry/CSRGraph.h>
+
+namespace Geometry {
+
+    /** @brief Find the root of a tree-like skeleton such as that of a plant or a tree scanned standing upright.
+     @param g the skeleton graph
+     @param candidates the number of lowest nodes that are considered
+     @param max_angle the largest angle (in degrees) between the z axis and an edge going up from the root
+     @returns the lowest of the candidate nodes which has an edge going upwards within max_angle of the z axis. If
+     no candidate has such an edge, the lowest node is returned. InvalidNodeID is returned only if g has no nodes.
+
+     The candidates are selected in linear time, and only their neighbors are visited. Removed nodes are ignored. */
+    AMGraph::NodeID skeleton_root(const AMGraph3D& g, size_t candidates = 30, double max_angle = 45.0);
+    AMGraph::NodeID skeleton_root(const CSRGraph3D& g, size_t candidates = 30, double max_angle = 45.0);
+
+    /** RootedTree stores a spanning tree of the nodes reachable from a root together with the per node quantities
+     that are needed to analyse the branching structure of a skeleton. If the graph has cycles, the edges not in the
+     depth first spanning tree are ignored. Nodes which cannot be reached from the root have no parent and depth -1,
+     and all other attributes are zero for them. */
+    struct RootedTree {
+        using NodeID = AMGraph::NodeID;
+
+        /// The root of the tree.
+        NodeID root = AMGraph::InvalidNodeID;
+
+        /// Parent of each node. InvalidNodeID for the root and for nodes that were not reached.
+        Util::AttribVec<NodeID, NodeID> parent;
+
+        /// Number of edges on the path to the root.
+        Util::AttribVec<NodeID, int> depth;
+
+        /// Euclidean length of the path to the root.
+        Util::AttribVec<NodeID, double> path_length;
+
+        /// Number of nodes in the subtree rooted at each node, the node itself included.
+        Util::AttribVec<NodeID, size_t> subtree_size;
+
+        /// Strahler order. Leaves have order 1, and the order increases where two branches of equal order meet.
+        Util::AttribVec<NodeID, int> strahler;
+
+        /** Branch segment of each node. A segment is a maximal chain of nodes which starts at the root or at a
+         child of a node that does not have exactly one child. Unreached nodes have segment -1. */
+        Util::AttribVec<NodeID, int> segment;
+
+        /// Number of branch segments.
+        int no_segments = 0;
+
+        /** The reached nodes in depth first pre-order. Each subtree and each branch segment is a contiguous
+         range of this vector. */
+        std::vector<NodeID> order;
+
+        /// children[child_offsets[n]] up to (but excluding) children[child_offsets[n+1]] are the children of n.
+        std::vector<size_t> child_offsets;
+        std::vector<NodeID> children_vec;
+
+        /// Return whether n was reached from the root.
+        bool reached(NodeID n) const { return depth[n] >= 0; }
+
+        /// Return the children of n without allocating.
+        IDRange<NodeID> children(NodeID n) const {
+            const NodeID* c = children_vec.data();
+            return IDRange<NodeID>(c + child_offsets[n], c + child_offsets[n+1]);
+        }
+    };
+
+    /** @brief Analyse g as a tree rooted at root.
+     @param g the skeleton graph
+     @param root the root node. If it is InvalidNodeID, skeleton_root is used to find it.
+     @returns the rooted tree with all attributes filled in.
+
+     A single iterative depth first search builds the parent and children arrays together with the depth and path
+     length. Subtree sizes and Strahler orders are then accumulated in one sweep over the reversed pre-order, and
+     branch segments are assigned in one sweep over the pre-order. The total cost is linear in the size of g. */
+    RootedTree rooted_tree(const AMGraph3D& g, AMGraph::NodeID root = AMGraph::InvalidNodeID);
+    RootedTree rooted_tree(const CSRGraph3D& g, AMGraph::NodeID root = AMGraph::InvalidNodeID);
+}
+
+#endif /* graph_tree_h */
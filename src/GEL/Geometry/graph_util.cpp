@@ -6,20 +6,25 @@
 //  Copyright © 2018 J. Andreas Bærentzen. All rights reserved.
 //
 
+#include <cstdint>
 #include <future>
 #include <thread>
 #include <unordered_set>
 #include <unordered_map>
 #include <queue>
 #include <vector>
+#include <tuple>
+#include <algorithm>
 #include <iostream>
 #include <random>
 #include <GEL/Util/Grid2D.h>
 #include <GEL/Util/AttribVec.h>
+#include <GEL/Util/Parallel.h>
 #include <GEL/Geometry/Graph.h>
 #include <GEL/Geometry/build_bbtree.h>
 #include <GEL/Geometry/KDTree.h>
 #include <GEL/Geometry/GridAlgorithm.h>
+#include <GEL/Geometry/ShortestPaths.h>
 #include <GEL/Geometry/bounding_sphere.h>
 #include <GEL/HMesh/HMesh.h>
 #include <GEL/Geometry/graph_util.h>
@@ -34,9 +39,7 @@ namespace Geometry {
     using NodeID = AMGraph::NodeID;
     using NodeSet = AMGraph::NodeSet;
     using NodeSetUnordered = unordered_set<NodeID>;
-    using NodeQueue = queue<NodeID>;
     using NodeSetVec = vector<pair<double,NodeSet>>;
-    using ExpansionMap = std::vector<std::vector<AMGraph::NodeID>>;
     using CapacityVecVec = std::vector<std::vector<size_t>>;
 
     SkeletonPQElem::SkeletonPQElem(double _pri, AMGraph3D::NodeID _n0, AMGraph3D::NodeID _n1): pri(_pri), n0(_n0), n1(_n1) {}
@@ -59,7 +62,9 @@ namespace Geometry {
         return matches;
     }
 
-    NodeSetUnordered neighbors(const AMGraph3D& g, const NodeSetUnordered& s) {
+    namespace {
+    template<typename GraphT>
+    NodeSetUnordered neighbors_impl(const GraphT& g, const NodeSetUnordered& s) {
         NodeSetUnordered _nbors;
         for(auto n: s)
             for(auto m: g.neighbors(n))
@@ -72,6 +77,15 @@ namespace Geometry {
         
         return nbors;
     }
+    }
+
+    NodeSetUnordered neighbors(const AMGraph3D& g, const NodeSetUnordered& s) {
+        return neighbors_impl(g, s);
+    }
+
+    NodeSetUnordered neighbors(const CSRGraph3D& g, const NodeSetUnordered& s) {
+        return neighbors_impl(g, s);
+    }
 
 
 
@@ -103,62 +117,67 @@ namespace Geometry {
         return out;
     }
 
-    std::vector<NodeSetUnordered> connected_components(const AMGraph& g,
-                                                       const NodeSetUnordered& s) {
-        NodeSetUnordered s_visited;
+    namespace {
+    template<typename GraphT>
+    std::vector<NodeSetUnordered> connected_components_impl(const GraphT& g,
+                                                            const NodeSetUnordered& s) {
+        // Membership and visit marks are kept in per thread arrays rather than hash sets.
+        thread_local NodeMarks in_s, s_visited;
+        in_s.clear(g.no_nodes());
+        s_visited.clear(g.no_nodes());
+        for(auto n: s)
+            in_s.insert(n);
+
         vector<NodeSetUnordered> component_vec;
+        vector<NodeID> Q;
         for(auto nf0 : s) {
-            if(s_visited.count(nf0)==0)
+            if(!s_visited.contains(nf0))
             {
-                NodeQueue Q;
-                Q.push(nf0);
+                Q.clear();
+                Q.push_back(nf0);
                 s_visited.insert(nf0);
-                NodeSetUnordered component;
-                while(!Q.empty())
+                for(size_t head = 0; head < Q.size(); ++head)
                 {
-                    NodeID nf = Q.front();
-                    Q.pop();
-                    
-                    bool in_s = s.count(nf)>0;
-                    if(in_s)
-                        component.insert(nf);
+                    NodeID nf = Q[head];
                     for(auto nnf: g.neighbors(nf)) {
-                        if (s_visited.count(nnf)==0) {
-                            if( s.count(nnf)>0 ) {
-                                Q.push(nnf);
-                                s_visited.insert(nnf);
-                            }
+                        if (!s_visited.contains(nnf) && in_s.contains(nnf)) {
+                            Q.push_back(nnf);
+                            s_visited.insert(nnf);
                         }
                     }
-                    
                 }
-                component_vec.push_back(component);
+                component_vec.push_back(NodeSetUnordered(Q.begin(), Q.end()));
             }
         }
         return component_vec;
     }
 
-    std::vector<NodeSetUnordered> front_components(const AMGraph3D &g, const NodeSetUnordered &s) {
-        NodeSetUnordered s_visited;
-        vector<NodeSetUnordered> components_front;
+    template<typename GraphT>
+    std::vector<NodeSetUnordered> front_components_impl(const GraphT &g, const NodeSetUnordered &s) {
+        thread_local NodeMarks in_s, s_visited;
+        in_s.clear(g.no_nodes());
+        s_visited.clear(g.no_nodes());
+        for(auto n: s)
+            in_s.insert(n);
+
         NodeSetUnordered front_set; // Set of nodes that are a neighbour to a node in s.
+        vector<NodeID> Q;
         for (auto n0 : s) { // This ensures we that visit every component of s.
-            if (s_visited.count(n0) == 0) { // n0 is a starting node in the component.
+            if (!s_visited.contains(n0)) { // n0 is a starting node in the component.
                 // Run a BFS.
-                NodeQueue Q;
-                Q.push(n0);
+                Q.clear();
+                Q.push_back(n0);
                 s_visited.insert(n0);
-                while(!Q.empty()) {
-                    NodeID n = Q.front();
-                    Q.pop();
+                for(size_t head = 0; head < Q.size(); ++head) {
+                    NodeID n = Q[head];
                     for (auto neighbour : g.neighbors(n)) {
-                        if (s_visited.count(neighbour) == 0) {
+                        if (!s_visited.contains(neighbour)) {
                             s_visited.insert(neighbour);
-                            if (s.count(neighbour) == 0) {
+                            if (!in_s.contains(neighbour)) {
                                 // Node is part of the front since it is not in s.
                                 front_set.insert(neighbour);
                             } else {
-                                Q.push(neighbour);
+                                Q.push_back(neighbour);
                             }
                         }
                     }
@@ -166,37 +185,152 @@ namespace Geometry {
             }
         }
 
-        return connected_components(g, front_set);
+        return connected_components_impl(g, front_set);
+    }
     }
 
-    void saturate_graph(AMGraph3D& g, int hops, double dist_frac, double rad) {
-        using NodeMap = std::unordered_map<NodeID, pair<int, double>>;
-        vector<pair<NodeID, NodeID>> node_pairs;
-        for(NodeID n0: g.node_ids()) {
-            queue<NodeID> Q;
-            Q.push(n0);
-            NodeMap node_map;
-            node_map[n0] = make_pair(0, 0.0);
-            
-            while(!Q.empty()) {
-                auto n = Q.front();
-                auto [h_n, d_n] = node_map[n];
-                Q.pop();
+    std::vector<NodeSetUnordered> connected_components(const AMGraph& g, const NodeSetUnordered& s) {
+        return connected_components_impl(g, s);
+    }
+
+    std::vector<NodeSetUnordered> connected_components(const CSRGraph3D& g, const NodeSetUnordered& s) {
+        return connected_components_impl(g, s);
+    }
+
+    std::vector<NodeSetUnordered> front_components(const AMGraph3D &g, const NodeSetUnordered &s) {
+        return front_components_impl(g, s);
+    }
+
+    std::vector<NodeSetUnordered> front_components(const CSRGraph3D &g, const NodeSetUnordered &s) {
+        return front_components_impl(g, s);
+    }
+
+    namespace {
+        /** Scratch space for the bounded hop searches of saturate_graph. The state of the nodes reached by a search
+         is kept in a small open addressing hash table, so the memory used is proportional to the size of the hop
+         neighbourhood rather than to the size of the graph. Only the slots used by a search are cleared after it. */
+        class HopSearchWorkspace {
+        public:
+            struct NodeState {
+                NodeID n = AMGraph::InvalidNodeID;
+                int hop = 0;
+                double dist = 0.0;
+                bool emitted = false;
+            };
+
+        private:
+            vector<NodeState> slots = vector<NodeState>(64);
+            vector<size_t> used;
+
+            size_t slot_of(NodeID n) const {
+                const size_t mask = slots.size() - 1;
+                size_t h = size_t((uint64_t(n) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+                while(slots[h].n != AMGraph::InvalidNodeID && slots[h].n != n)
+                    h = (h + 1) & mask;
+                return h;
+            }
+
+            void grow() {
+                vector<NodeState> old(2 * slots.size());
+                swap(old, slots);
+                used.clear();
+                for(const auto& s: old)
+                    if(s.n != AMGraph::InvalidNodeID) {
+                        const size_t h = slot_of(s.n);
+                        slots[h] = s;
+                        used.push_back(h);
+                    }
+            }
+
+        public:
+            vector<NodeID> Q;
+
+            /// Returns the state of n or null if the current search has not reached n.
+            NodeState* find(NodeID n) {
+                NodeState& s = slots[slot_of(n)];
+                return s.n == n ? &s : nullptr;
+            }
+
+            /// Returns the state of n which is added if the current search has not reached n.
+            NodeState& insert(NodeID n) {
+                if(2 * (used.size() + 1) > slots.size())
+                    grow();
+                const size_t h = slot_of(n);
+                if(slots[h].n != n) {
+                    slots[h] = NodeState();
+                    slots[h].n = n;
+                    used.push_back(h);
+                }
+                return slots[h];
+            }
+
+            /// Forget the nodes reached by the current search.
+            void clear() {
+                for(auto h: used)
+                    slots[h] = NodeState();
+                used.clear();
+                Q.clear();
+            }
+        };
+
+        /** Search from n0 out to hops hops and append the nodes that n0 should be connected to onto node_pairs.
+         The search visits nodes in the same order as a breadth first search, and a node is revisited if a
+         shorter path is found. */
+        void saturate_from_node(const CSRGraph3D& g, NodeID n0, int hops, double dist_frac, double rad,
+                                HopSearchWorkspace& ws, vector<pair<NodeID, NodeID>>& node_pairs) {
+            ws.clear();
+            ws.Q.push_back(n0);
+            ws.insert(n0);
+            for(size_t head = 0; head < ws.Q.size(); ++head) {
+                const NodeID n = ws.Q[head];
+                const auto* s_n = ws.find(n);
+                const int h_n = s_n->hop;
+                const double d_n = s_n->dist;
                 for(auto m: g.neighbors(n)) {
                     double d_m = d_n + sqrt(g.sqr_dist(n, m));
-                    if(node_map.count(m) == 0 || d_m < node_map[m].second) {
+                    auto* s_m = ws.find(m);
+                    if(s_m == nullptr || d_m < s_m->dist) {
+                        if(s_m == nullptr)
+                            s_m = &ws.insert(m);
                         double d_n0_m = sqrt(g.sqr_dist(n0, m));
-                        if (d_n0_m<dist_frac*d_m && d_n0_m < rad)
+                        // Only the first time a pair is found matters, since connecting twice does nothing.
+                        if (d_n0_m<dist_frac*d_m && d_n0_m < rad && !s_m->emitted) {
                             node_pairs.push_back(make_pair(n0, m));
+                            s_m->emitted = true;
+                        }
                         if(h_n+1<hops)
-                            Q.push(m);
-                        node_map[m] = make_pair(h_n+1, d_m);
+                            ws.Q.push_back(m);
+                        s_m->hop = h_n+1;
+                        s_m->dist = d_m;
                     }
                 }
             }
         }
-        for (auto [n0, n1]: node_pairs)
-            g.connect_nodes(n0, n1);
+    }
+
+    void saturate_graph(AMGraph3D& _g, int hops, double dist_frac, double rad) {
+        // All the searching happens before any edge is added, so we can search a frozen copy.
+        const CSRGraph3D g(_g);
+        const size_t N = g.no_nodes();
+
+        // Nodes are searched in blocks, and the pairs found for each block are stored separately. Concatenating the
+        // blocks in order gives precisely the pairs of a serial search, so the edges (and edge ids) do not depend on
+        // the number of threads or on scheduling.
+        const size_t BLOCK_SIZE = 256;
+        const size_t no_blocks = (N + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        const unsigned int T = Util::thread_count();
+        vector<HopSearchWorkspace> workspaces(T);
+        vector<vector<pair<NodeID, NodeID>>> block_pairs(no_blocks);
+
+        Util::parallel_for(no_blocks, [&](size_t b, unsigned int worker) {
+            const NodeID end = min(N, (b+1) * BLOCK_SIZE);
+            for(NodeID n0 = b * BLOCK_SIZE; n0 < end; ++n0)
+                saturate_from_node(g, n0, hops, dist_frac, rad, workspaces[worker], block_pairs[b]);
+        }, 1, T);
+
+        for (const auto& node_pairs: block_pairs)
+            for (auto [n0, n1]: node_pairs)
+                _g.connect_nodes(n0, n1);
     }
 
     Vec3d geometric_median(const vector<Vec3d>& pts) {
@@ -247,58 +381,131 @@ namespace Geometry {
 
     int graph_edge_contract(AMGraph3D& g, double dist_thresh) {
         using NodeID = AMGraph::NodeID;
-        auto priority = [&](NodeID a, NodeID b) { return -g.sqr_dist(a,b); };
-        priority_queue<SkeletonPQElem> Q;
-        
-        int cntr, total_work = 0;
-        do {
-            Util::AttribVec<AMGraph::NodeID, int> touched(g.no_nodes(),0);
-            cntr = 0;
-            for(auto n0 : g.node_ids()) {
-                for(auto n1: g.neighbors(n0)) {
-                    double pri = priority(n0,n1);
-                    if(pri>-sqr(dist_thresh))
-                        Q.push(SkeletonPQElem(pri, n0, n1));
+        const size_t N = g.no_nodes();
+        const double sqr_thresh = sqr(dist_thresh);
+
+        // Union-find over the nodes. Each root owns the (lazily updated) adjacency list of its cluster.
+        vector<NodeID> parent(N);
+        vector<size_t> cluster_size(N, 1);
+        vector<vector<NodeID>> adj(N);
+        vector<Vec3d> pos(N);
+        for(auto n: g.node_ids()) {
+            parent[n] = n;
+            pos[n] = g.pos[n];
+            adj[n] = g.neighbors(n);
+        }
+        // The radii and named attributes of the roots are averaged as the positions.
+        auto radius = g.node_radius;
+        auto attributes = g.node_attributes;
+        auto find = [&](NodeID n) {
+            while(parent[n] != n) {
+                parent[n] = parent[parent[n]];
+                n = parent[n];
+            }
+            return n;
+        };
+
+        // Heap entries are stamped with the versions of both end points. Whenever a node is the result of a merge,
+        // its version is bumped and the entries referring to the old version are skipped when popped. This makes
+        // the heap updatable without searching it.
+        struct ContractElem {
+            double d;
+            NodeID n0, n1;
+            unsigned v0, v1;
+            bool operator<(const ContractElem& c) const {
+                return std::tie(d, n0, n1) > std::tie(c.d, c.n0, c.n1);
+            }
+        };
+        vector<unsigned> version(N, 0);
+        priority_queue<ContractElem> Q;
+        auto push_edges = [&](NodeID n) {
+            for(auto m: adj[n])
+                if(n < m || version[n] > 0) {
+                    double d = sqr_length(pos[n] - pos[m]);
+                    if(d < sqr_thresh)
+                        Q.push({d, n, m, version[n], version[m]});
                 }
+        };
+        for(auto n: g.node_ids())
+            push_edges(n);
+
+        int total_work = 0;
+        while(!Q.empty()) {
+            auto c = Q.top();
+            Q.pop();
+            if(parent[c.n0] != c.n0 || parent[c.n1] != c.n1 ||
+               version[c.n0] != c.v0 || version[c.n1] != c.v1)
+                continue;
+
+            // Merge the smaller cluster into the larger. As in merge_nodes the new position, radius and named
+            // attributes are the averages of those of the two nodes.
+            NodeID a = c.n0, b = c.n1;
+            if(cluster_size[a] > cluster_size[b])
+                swap(a, b);
+            parent[a] = b;
+            cluster_size[b] += cluster_size[a];
+            pos[b] = 0.5 * (pos[a] + pos[b]);
+            radius[b] = 0.5 * (radius[a] + radius[b]);
+            for(auto& [name, attr]: attributes)
+                attr[b] = 0.5 * (attr[a] + attr[b]);
+            adj[b].insert(adj[b].end(), adj[a].begin(), adj[a].end());
+            vector<NodeID>().swap(adj[a]);
+
+            // Resolve neighbors to their roots and remove duplicates and the self loop.
+            for(auto& m: adj[b])
+                m = find(m);
+            sort(adj[b].begin(), adj[b].end());
+            adj[b].erase(unique(adj[b].begin(), adj[b].end()), adj[b].end());
+            adj[b].erase(remove(adj[b].begin(), adj[b].end(), b), adj[b].end());
+
+            ++version[b];
+            push_edges(b);
+            ++total_work;
+        }
+
+        // Build the contracted graph directly from the cluster roots.
+        AMGraph3D gn;
+        gn.add_attributes_of(g);
+        vector<NodeID> node_map(N, AMGraph::InvalidNodeID);
+        for(auto n: g.node_ids())
+            if(parent[n] == n && !std::isnan(pos[n][0])) {
+                node_map[n] = gn.add_node(pos[n]);
+                gn.copy_node_attributes(node_map[n], g, n);
+                gn.node_radius[node_map[n]] = radius[n];
+                for(auto& [name, attr]: attributes)
+                    gn.node_attributes[name][node_map[n]] = attr[n];
             }
-            
-            while(!Q.empty()) { 
-                auto skel_rec = Q.top();
-                Q.pop();
-                if(touched[skel_rec.n0]==0 && touched[skel_rec.n1]==0) {
-                    auto e = g.find_edge(skel_rec.n0, skel_rec.n1);
-                    if( e != AMGraph::InvalidEdgeID) {
-                        g.merge_nodes(skel_rec.n0,skel_rec.n1, true);
-                        touched[skel_rec.n0] = 1;
-                        touched[skel_rec.n1] = 1;
-                        ++cntr;
+        for(auto n: g.node_ids())
+            if(node_map[n] != AMGraph::InvalidNodeID)
+                for(auto m: adj[n]) {
+                    m = find(m);
+                    if(n < m && node_map[m] != AMGraph::InvalidNodeID) {
+                        auto e = gn.connect_nodes(node_map[n], node_map[m]);
+                        auto e_old = g.find_edge(n, m);
+                        if(gn.valid_edge_id(e) && g.valid_edge_id(e_old))
+                            gn.copy_edge_attributes(e, g, e_old);
                     }
                 }
-            }
-            total_work += cntr;
-        } while(cntr);
-        
-        g.cleanup();
+        g = std::move(gn);
         return total_work;
     }
 
     namespace  {
     const Vec3f& get_color(int i)
     {
-        static Vec3f ctable[100000];
-        static bool was_here;
-        gel_srand(0);
-        if(!was_here)
-        {
-            was_here = true;
-            ctable[0] = Vec3f(0);
+        // The table is built on first use, which is thread safe, so concurrent skeletonizations can color node sets.
+        static const vector<Vec3f> ctable = [] {
+            vector<Vec3f> t(100000);
+            gel_srand(0);
+            t[0] = Vec3f(0);
             for(int j=1;j<100000;++j)
-                ctable[j] = Vec3f(0.3)+0.7*normalize(Vec3f(gel_rand(),gel_rand(),gel_rand()));
-            ctable[3] = Vec3f(1,0,0);
-            ctable[4] = Vec3f(0,1,0);
-            ctable[5] = Vec3f(0,0,1);
-            ctable[6] = Vec3f(1,0,1);
-        }
+                t[j] = Vec3f(0.3)+0.7*normalize(Vec3f(gel_rand(),gel_rand(),gel_rand()));
+            t[3] = Vec3f(1,0,0);
+            t[4] = Vec3f(0,1,0);
+            t[5] = Vec3f(0,0,1);
+            t[6] = Vec3f(1,0,1);
+            return t;
+        }();
         return ctable[i%100000];
     }
     }
@@ -329,13 +536,12 @@ namespace Geometry {
     }
 
     AttribVec<NodeID, double> leaf_distance(const AMGraph3D& g) {
-        BreadthFirstSearch bfs(g);
+        vector<NodeID> leaves;
         for(auto n: g.node_ids()) {
             if(g.neighbors(n).size()<=1)
-                bfs.add_init_node(n,0);
+                leaves.push_back(n);
         }
-        while(bfs.Dijkstra_step());
-        return bfs.dist;
+        return shortest_path_distances(g, leaves);
     }
 
 
@@ -413,13 +619,18 @@ namespace Geometry {
         Vec3i dim = Vec3i(diag/l)+Vec3i(1);
         
         AMGraph3D g;
-        OBBTree tree;
-        build_OBBTree(m, tree);
+        BVH tree;
+        build_BVH(m, tree);
+        vector<Vec3f> voxel_pos;
+        for(Vec3i p: Range3D(dim))
+            voxel_pos.push_back(Vec3f(p0 + Vec3d(p)*l));
+        vector<float> dist = tree.compute_signed_distance(voxel_pos);
         RGrid<NodeID> node_grid(dim,-1);
+        size_t i = 0;
         for(Vec3i p: Range3D(dim))
         {
             Vec3d x = p0 + Vec3d(p)*l;
-            double d = tree.compute_signed_distance(Vec3f(x));
+            double d = dist[i++];
             if(d<=0.0) {
                 NodeID n =g.add_node(x);
                 node_grid[p] = n;
@@ -439,7 +650,9 @@ namespace Geometry {
     }
 
 
-    pair<Vec3d, double> approximate_bounding_sphere(const AMGraph3D& g, const NodeSetUnordered& s) {
+    namespace {
+    template<typename GraphT>
+    pair<Vec3d, double> approximate_bounding_sphere_impl(const GraphT& g, const NodeSetUnordered& s) {
         vector<Vec3d> pts;
         if(s.empty())
             for(auto n: g.node_ids())
@@ -449,6 +662,15 @@ namespace Geometry {
                 pts.push_back(g.pos[n]);
         return approximate_bounding_sphere(pts);
     }
+    }
+
+    pair<Vec3d, double> approximate_bounding_sphere(const AMGraph3D& g, const NodeSetUnordered& s) {
+        return approximate_bounding_sphere_impl(g, s);
+    }
+
+    pair<Vec3d, double> approximate_bounding_sphere(const CSRGraph3D& g, const NodeSetUnordered& s) {
+        return approximate_bounding_sphere_impl(g, s);
+    }
 
 
 
@@ -541,7 +763,7 @@ namespace Geometry {
         seg_tree.build();
     }
 
-    double GraphDist::dist(const Vec3d& p) {
+    double GraphDist::dist(const Vec3d& p) const {
         double dist = 1e32;
         Vec3d k;
         size_t segment_idx;
@@ -557,6 +779,14 @@ namespace Geometry {
         return dist;
     }
 
+    vector<double> GraphDist::dist(const vector<Vec3d>& pts) const {
+        vector<double> d(pts.size());
+        Util::parallel_for(pts.size(), [&](size_t i, unsigned int) {
+            d[i] = dist(pts[i]);
+        }, 64);
+        return d;
+    }
+
     pair<double,double> graph_H_dist(const Geometry::AMGraph3D& g0, const Geometry::AMGraph3D& g, size_t samples) {
         
         GraphDist gd0(g0);
@@ -567,9 +797,9 @@ namespace Geometry {
                 if(g.valid_node_id(n) && g.valid_node_id(m) && n<m) {
                     total_length += length(g.pos[m]-g.pos[n]);
                 }
-        int cnt = 0;
-        double avg_dist = 0;
-        double max_dist = 0.0;
+        // The samples are drawn serially, so they do not depend on the number of threads, and the distances
+        // are then computed in one batch.
+        vector<Vec3d> pts;
         srand(0);
         for(auto n : g.node_ids())
             for(auto m : g.neighbors(n))
@@ -578,13 +808,17 @@ namespace Geometry {
                     int samples_per_edge = samples*(l/total_length) + 0.5;
                     for (int s = 0; s < samples_per_edge; ++s) {
                         double r = rand()/double(RAND_MAX);
-                        Vec3d p = r * g.pos[m] + (1.0-r) * g.pos[n];
-                        double d = gd0.dist(p);
-                        avg_dist += d;
-                        max_dist = max(max_dist,d);
-                        cnt += 1;
+                        pts.push_back(r * g.pos[m] + (1.0-r) * g.pos[n]);
                     }
                 }
+        int cnt = 0;
+        double avg_dist = 0;
+        double max_dist = 0.0;
+        for(double d : gd0.dist(pts)) {
+            avg_dist += d;
+            max_dist = max(max_dist,d);
+            cnt += 1;
+        }
         avg_dist /= cnt;
         return make_pair(avg_dist, max_dist);
         
@@ -648,16 +882,14 @@ std::vector<std::pair<int,int>>  symmetry_pairs(const AMGraph3D& g, NodeID n, do
     };
     
     // We run Dijkstra on the graph to be able to detect loops
-    BreadthFirstSearch bfs(g);
-    bfs.add_init_node(n);
-    while(bfs.Dijkstra_step());
+    const auto dist = shortest_path_distances(g, {n});
     
     // For every outgoing edge, we create a vector of the vertices
     // in the corresponding subtree.
     vector<vector<Vec3d>> pt_vecs;
     vector<NodeID> nbors = g.neighbors(n);
     for (auto nn: nbors)
-        pt_vecs.push_back(subtree_points(g, nn, n, bfs.dist));
+        pt_vecs.push_back(subtree_points(g, nn, n, dist));
    
     // This lambda computes the symmetry score for edge i<->j
     // The score is roughly the registration error between the two.
@@ -9,9 +9,11 @@
 #ifndef graph_abstraction_hpp
 #define graph_abstraction_hpp
 
+#include <algorithm>
 #include <vector>
 #include <unordered_set>
 #include <GEL/Geometry/Graph.h>
+#include <GEL/Geometry/CSRGraph.h>
 #include <GEL/Geometry/KDTree.h>
 #include <GEL/HMesh/Manifold.h>
 //#include <GEL/Geometry/bounding_box_tools.h>
@@ -21,17 +23,39 @@ namespace Geometry {
     using NodeSetUnordered = std::unordered_set<AMGraph::NodeID>;
     using NodeSet = AMGraph::NodeSet;
     using NodeSetVec = std::vector<std::pair<double,NodeSet>>;
-    using ExpansionMap = std::vector<std::vector<AMGraph::NodeID>>;
     using CapacityVecVec = std::vector<std::vector<size_t>>;
 
+    /** A dense set of node ids that can be emptied in constant time. Each node has a stamp, and a node is
+     in the set if its stamp equals the current epoch, so clearing just bumps the epoch. NodeMarks is meant as
+     scratch space which is reused across many searches on the same graph. */
+    class NodeMarks {
+        std::vector<unsigned> stamp;
+        unsigned epoch = 1;
+    public:
+        /// Empty the set and make room for node ids up to N-1.
+        void clear(size_t N) {
+            if(stamp.size() < N)
+                stamp.resize(N, 0);
+            if(++epoch == 0) {
+                std::fill(stamp.begin(), stamp.end(), 0);
+                epoch = 1;
+            }
+        }
+        bool contains(AMGraph::NodeID n) const { return stamp[n] == epoch; }
+        void insert(AMGraph::NodeID n) { stamp[n] = epoch; }
+        void erase(AMGraph::NodeID n) { stamp[n] = 0; }
+    };
+
     /// Linear time counting of the number of shared members of set1 and set2.
     int test_intersection (const AMGraph3D::NodeSet& set1, const AMGraph3D::NodeSet& set2);
 
     /// Returns a vector containing the connected components of set s
     std::vector<NodeSetUnordered> connected_components(const AMGraph& g, const NodeSetUnordered& s);
+    std::vector<NodeSetUnordered> connected_components(const CSRGraph3D& g, const NodeSetUnordered& s);
 
     /// Returns the connected components of the front of s.
     std::vector<NodeSetUnordered> front_components(const AMGraph3D& g, const NodeSetUnordered & s);
+    std::vector<NodeSetUnordered> front_components(const CSRGraph3D& g, const NodeSetUnordered & s);
 
     /// Smooth the attributes in dist associated with graph g smooth_iter times
     AttribVecDouble smooth_dist(const AMGraph3D& g, const AttribVecDouble& dist, int smooth_iter=0);
@@ -43,13 +67,17 @@ namespace Geometry {
     AttribVecDouble negate_dist(const AMGraph3D& g, const AttribVecDouble& dist_in);
 
     /** Add edges to g. For each vertex in g we visit neighbors at a maximum of `hops' graph hops from the original vertex.
-     Saturation is here used differently from the conventional graph theoretical usage.. */
+     Saturation is here used differently from the conventional graph theoretical usage..
+     The searches run in parallel, but the edges are added in the same order as a serial search would add them,
+     so the result does not depend on the number of threads. */
     void saturate_graph(AMGraph3D& g, int hops, double dist_frac = 1.0001, double rad = 1e300);
 
     /// Simple Laplacian graph smoothing. iter specifies number of iterations, and alpha in range [0..1] is the weight.
     void smooth_graph(AMGraph3D& g, const int iter, const float alpha);
 
-    /// Contracts edges in the graph g shorter than dist_thresh. A priority queue is used to contract shorter edges first.
+    /** Contracts edges in the graph g shorter than dist_thresh. The shortest edge is always contracted first, and the merged
+     node is placed at the midpoint. As in merge_nodes, its radius and named attributes are averaged as well. Merges are tracked with union-find and edge lengths updated in a heap, so all edges
+     are handled in a single sweep. Afterwards g only contains the merged nodes. Returns the number of contractions. */
     int graph_edge_contract(AMGraph3D& g, double dist_thresh);
 
     struct SkeletonPQElem {
@@ -89,10 +117,12 @@ namespace Geometry {
 
     /// This function computes the neighbors of s in g. In other words it returns the set of nodes that are connected to s but do not belong to s.
     NodeSetUnordered neighbors(const AMGraph3D& g, const NodeSetUnordered& s);
+    NodeSetUnordered neighbors(const CSRGraph3D& g, const NodeSetUnordered& s);
 
     /** Compute the approximate bounding sphere for the nodes in graph g optionally restricted to the node set passed as second argument.
         This function returns center and radius of the sphere */
     std::pair<CGLA::Vec3d, double> approximate_bounding_sphere(const AMGraph3D& g, const NodeSetUnordered& s = NodeSetUnordered({}));
+    std::pair<CGLA::Vec3d, double> approximate_bounding_sphere(const CSRGraph3D& g, const NodeSetUnordered& s = NodeSetUnordered({}));
 
     /**
      @brief k means clustering of graph nodes
@@ -138,7 +168,10 @@ namespace Geometry {
     public:
         
         GraphDist(const Geometry::AMGraph3D& g);
-        double dist(const CGLA::Vec3d& p);
+        double dist(const CGLA::Vec3d& p) const;
+
+        /// Compute the distance from each of the points in pts to the graph in parallel.
+        std::vector<double> dist(const std::vector<CGLA::Vec3d>& pts) const;
     };
 
     /** Computes the distance at samples points from graph g0 to g1 and vice versa. H is for Hausdorff. */
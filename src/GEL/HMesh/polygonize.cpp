@@ -6,6 +6,9 @@
 //  Copyright (c) 2013 J. Andreas Bærentzen. All rights reserved.
 //
 
+#include <algorithm>
+#include <cstdint>
+#include <GEL/Util/Parallel.h>
 #include <GEL/Geometry/GridAlgorithm.h>
 #include <GEL/Geometry/Implicit.h>
 #include <GEL/Geometry/Neighbours.h>
@@ -111,13 +114,60 @@ namespace HMesh
         return gf;
     }
 
-      
-    void polygonize(const RGrid<float>& grid, std::vector<CGLA::Vec3d>& quad_vertices,
+
+    namespace {
+        /// Returns true if a voxel with the value val is inside. NaN values are neither inside nor outside.
+        bool is_inside_value(float val, float tau, bool high_is_inside)
+        {
+            return !isnan(val) && (high_is_inside == (val > tau));
+        }
+
+        /** Visit the voxels with z in [z0, z1) of a regular grid that are inside. Only inside voxels can produce a
+            face, which is the same rule that the hierarchical grid applies to its coalesced cells. */
+        template<class F>
+        void for_each_candidate(const RGrid<float>& grid, float tau, bool high_is_inside, int z0, int z1, F&& f)
+        {
+            const Vec3i& dims = grid.get_dims();
+            for(Vec3i pi: Range3D(Vec3i(0,0,z0), Vec3i(dims[0],dims[1],z1)))
+                if(is_inside_value(grid[pi], tau, high_is_inside))
+                    f(pi);
+        }
+
+        /** Visit the voxels with z in [z0, z1) of a hierarchical grid that may be inside. A coalesced cell holds a
+            single value, so if that value is not inside, none of its voxels can produce a face and the cell is
+            skipped. */
+        template<class F>
+        void for_each_candidate(const HGrid<float>& grid, float tau, bool high_is_inside, int z0, int z1, F&& f)
+        {
+            const int B = grid.get_bottom_dim();
+            const Vec3i& top_dims = grid.get_top_dims();
+            for(Vec3i ti: Range3D(Vec3i(0,0,z0/B), Vec3i(top_dims[0],top_dims[1],(z1-1)/B+1))) {
+                const auto& cell = grid.get_cell(ti);
+                if(cell.is_coalesced()) {
+                    if(!is_inside_value(*cell.get(), tau, high_is_inside))
+                        continue;
+                }
+                const Vec3i lo = v_max(ti * B, Vec3i(0,0,z0));
+                const Vec3i hi = v_min(ti * B + Vec3i(B), Vec3i(grid.get_dims()[0],grid.get_dims()[1],z1));
+                for(Vec3i pi: Range3D(lo, hi))
+                    f(pi);
+            }
+        }
+
+        /// The number of z layers in a slab. For a hierarchical grid a slab is a layer of cells.
+        int slab_thickness(const RGrid<float>&) { return 8; }
+        int slab_thickness(const HGrid<float>& grid) { return grid.get_bottom_dim(); }
+    }
+
+    /** Find the quads between inside and outside voxels. Quad corners are points of the lattice of voxel corners,
+        and each distinct corner becomes one vertex, so the quads share vertices. The grid is processed in parallel
+        slabs, and the result does not depend on the number of threads. */
+    template<class GridT>
+    void polygonize(const GridT& grid, std::vector<CGLA::Vec3d>& vertices, std::vector<int>& indices,
                     float tau, bool high_is_inside)
     {
         auto is_inside = [&](const Vec3i& pi) {
-            float val = grid[pi];
-            return !isnan(val) && (high_is_inside == (val > tau));
+            return is_inside_value(grid[pi], tau, high_is_inside);
         };
         auto is_outside = [&](const Vec3i& pi) {
             if (grid.in_domain(pi)) {
@@ -127,40 +177,77 @@ namespace HMesh
             return true;
 
         };
-        
-        quad_vertices.clear();
-        for(Vec3i pi: Range3D(grid.get_dims())) {
-            if(is_inside(pi)) {
-                Vec3d p(pi);
-                for (int nbr_idx = 0; nbr_idx < 6 ; ++ nbr_idx) {
-                    Vec3i pni = pi + N6i[nbr_idx];
-                    if(is_outside(pni))
-                        for(int n=0;n<4;++n)
-                            quad_vertices.push_back(p + hex_faces[nbr_idx][3-n]);
-                }
-            }
+
+        // A corner of voxel pi is pi plus an offset in {0,1}^3, and it is identified by its index in the lattice.
+        const Vec3i dims = grid.get_dims();
+        auto corner_key = [&](const Vec3i& c) {
+            return (uint64_t(c[2])*(dims[1]+1)+c[1])*(dims[0]+1)+c[0];
+        };
+        Vec3i hex_corners[6][4];
+        for (int nbr_idx = 0; nbr_idx < 6 ; ++ nbr_idx)
+            for(int n=0;n<4;++n)
+                hex_corners[nbr_idx][n] = Vec3i(hex_faces[nbr_idx][3-n] + Vec3d(0.5));
+
+        const int S = slab_thickness(grid);
+        const size_t no_slabs = (dims[2]+S-1)/S;
+        vector<vector<uint64_t>> slab_keys(no_slabs);
+        Util::parallel_for(no_slabs, [&](size_t k, unsigned int) {
+            auto& keys = slab_keys[k];
+            for_each_candidate(grid, tau, high_is_inside, int(k)*S, min(int(k+1)*S, dims[2]), [&](const Vec3i& pi) {
+                if(is_inside(pi))
+                    for (int nbr_idx = 0; nbr_idx < 6 ; ++ nbr_idx)
+                        if(is_outside(pi + N6i[nbr_idx]))
+                            for(int n=0;n<4;++n)
+                                keys.push_back(corner_key(pi + hex_corners[nbr_idx][n]));
+            });
+        });
+
+        // The distinct corners in lattice order.
+        vector<size_t> offsets(no_slabs+1, 0);
+        for(size_t k=0; k<no_slabs; ++k)
+            offsets[k+1] = offsets[k] + slab_keys[k].size();
+        vector<uint64_t> corners;
+        corners.reserve(offsets[no_slabs]);
+        for(const auto& keys: slab_keys)
+            corners.insert(corners.end(), keys.begin(), keys.end());
+        sort(corners.begin(), corners.end());
+        corners.erase(unique(corners.begin(), corners.end()), corners.end());
+
+        vertices.resize(corners.size());
+        for(size_t i=0; i<corners.size(); ++i) {
+            uint64_t key = corners[i];
+            const int x = key % (dims[0]+1);
+            key /= (dims[0]+1);
+            const int y = key % (dims[1]+1);
+            const int z = key / (dims[1]+1);
+            vertices[i] = Vec3d(x,y,z) - Vec3d(0.5);
         }
+
+        indices.resize(offsets[no_slabs]);
+        Util::parallel_for(no_slabs, [&](size_t k, unsigned int) {
+            auto& keys = slab_keys[k];
+            for(size_t i=0; i<keys.size(); ++i)
+                indices[offsets[k]+i] = int(lower_bound(corners.begin(), corners.end(), keys[i]) - corners.begin());
+            keys = vector<uint64_t>();
+        });
     }
 
-    void volume_polygonize(const XForm& xform, const Geometry::RGrid<float>& grid,
-                           HMesh::Manifold& mani, float tau, bool make_triangles, bool high_is_inside)
+    template<class GridT>
+    void polygonize_grid(const XForm& xform, const GridT& grid,
+                         HMesh::Manifold& mani, float tau, bool make_triangles, bool high_is_inside)
     {
-        const double delta = sqrt(3.0)/2.0;
-
         mani.clear();
-        vector<Vec3d> quad_vertices;
-        polygonize(grid, quad_vertices, tau, high_is_inside);
+        vector<Vec3d> vertices;
         vector<int> indices;
-        vector<int> faces(quad_vertices.size()/4,4);
-        for(int i=0;i<quad_vertices.size();++i)
-            indices.push_back(i);
-        build(mani, quad_vertices.size(),
-                   quad_vertices[0].get(),
+        polygonize(grid, vertices, indices, tau, high_is_inside);
+        if(indices.empty())
+            return;
+        vector<int> faces(indices.size()/4,4);
+        build(mani, vertices.size(),
+                   vertices[0].get(),
                    faces.size(),
                    &faces[0],
                    &indices[0]);
-        
-        stitch_mesh(mani, 0.001 * delta);
 
         if(make_triangles)
             triangulate(mani);
@@ -208,5 +295,17 @@ namespace HMesh
         for(auto v: mani.vertices())
             mani.pos(v) = xform.inverse(mani.pos(v));
     }
+
+    void volume_polygonize(const XForm& xform, const Geometry::RGrid<float>& grid,
+                           HMesh::Manifold& mani, float tau, bool make_triangles, bool high_is_inside)
+    {
+        polygonize_grid(xform, grid, mani, tau, make_triangles, high_is_inside);
+    }
+
+    void volume_polygonize(const XForm& xform, const Geometry::HGrid<float>& grid,
+                           HMesh::Manifold& mani, float tau, bool make_triangles, bool high_is_inside)
+    {
+        polygonize_grid(xform, grid, mani, tau, make_triangles, high_is_inside);
+    }
     
 }
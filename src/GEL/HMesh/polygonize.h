@@ -13,6 +13,7 @@
 
 #include <GEL/Geometry/XForm.h>
 #include <GEL/Geometry/RGrid.h>
+#include <GEL/Geometry/HGrid.h>
 #include <GEL/HMesh/Manifold.h>
 
 namespace HMesh
@@ -32,12 +33,21 @@ namespace HMesh
      
      This function computes an iso surface using the method of dual contouring. For each voxel that is inside,
      it visits the six neighbors and outputs a quad if that neighbor is outside. This leads to a cuberille mesh.
+     The quads are found in parallel slabs of the grid, and their corners are indexed by position in the lattice
+     of voxel corners, so the mesh is built with shared vertices and needs no stitching.
      Afterwards, vertices are  placed on the isocontour by taking the average of the intersections of each of the four
      cube diagonals with the isosurface (approximated via linear interpolation). Dual contouring is very simple and leads
      to bette triangles than marching cubes. On the flip side, the vertex placement is arguably a bit more ad hoc.
      */
     void volume_polygonize(const Geometry::XForm& xform, const Geometry::RGrid<float>& grid,
                            HMesh::Manifold& mani, float tau, bool make_triangles=true, bool high_is_inside=true);
+
+    /** @brief Computes a polygonal mesh from a volumetric isocontour stored in a hierarchical grid.
+     This works like the function above, but only the cells of the grid which are split or whose single value
+     is inside are visited, so the cost depends on the number of cells near the surface rather than on the
+     full resolution of the grid. */
+    void volume_polygonize(const Geometry::XForm& xform, const Geometry::HGrid<float>& grid,
+                           HMesh::Manifold& mani, float tau, bool make_triangles=true, bool high_is_inside=true);
 }
 
 #endif /* defined(__PointReconstruction__polygonize__) */
@@ -0,0 +1,43 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <GEL/Util/Parallel.h>
+
+namespace Util {
+
+    namespace {
+        std::atomic<unsigned int> requested_thread_count{0};
+        thread_local unsigned int current_limit = 0;
+    }
+
+    void set_thread_count(unsigned int n) {
+        requested_thread_count = n;
+    }
+
+    unsigned int thread_count() {
+        unsigned int n = requested_thread_count;
+        if (n == 0)
+            n = std::thread::hardware_concurrency();
+        if (current_limit != 0)
+            n = std::min(n, current_limit);
+        return std::max(n, 1u);
+    }
+
+    unsigned int thread_limit() {
+        return current_limit;
+    }
+
+    ThreadLimit::ThreadLimit(unsigned int n): previous(current_limit) {
+        current_limit = n;
+    }
+
+    ThreadLimit::~ThreadLimit() {
+        current_limit = previous;
+    }
+}
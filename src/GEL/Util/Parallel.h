@@ -0,0 +1,208 @@
+/* ----------------------------------------------------------------------- *
+ * This file is part of GEL, http://www.imm.dtu.dk/GEL
+ * Copyright (C) the authors and DTU Informatics
+ * For license and list of authors, see ../../doc/intro.pdf
+ * ----------------------------------------------------------------------- */
+
+#ifndef Parallel_h
+#define Parallel_h
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Util {
+
+    /** Set the number of threads used by the parallel algorithms of GEL. Zero, which is the default, means that
+     we use as many threads as the hardware supports. */
+    void set_thread_count(unsigned int n);
+
+    /// Returns the number of threads that parallel algorithms will use. Never less than one.
+    unsigned int thread_count();
+
+    /// Returns the limit set by the innermost ThreadLimit of the calling thread or zero if there is none.
+    unsigned int thread_limit();
+
+    /** While an object of this class exists, parallel algorithms called from the thread that created it use at most
+     n threads (n = 0 means no limit). This is for running several tasks at once, where each task is itself
+     parallel and should only use its share of the threads. parallel_for divides the limit among its workers and
+     passes the shares on to the threads it starts, so nested parallel calls also stay within the limit. */
+    class ThreadLimit {
+        unsigned int previous;
+    public:
+        explicit ThreadLimit(unsigned int n);
+        ~ThreadLimit();
+        ThreadLimit(const ThreadLimit&) = delete;
+        ThreadLimit& operator=(const ThreadLimit&) = delete;
+    };
+
+    namespace detail {
+        /** The chunks that remain for a worker. The owner takes chunks from the front while
+         idle workers steal the back half. Work items are expensive compared to locking, so a mutex is fine. */
+        struct WorkRange {
+            std::mutex m;
+            size_t lo = 0, hi = 0;
+
+            bool pop_front(size_t& c) {
+                std::lock_guard<std::mutex> lock(m);
+                if (lo == hi)
+                    return false;
+                c = lo++;
+                return true;
+            }
+
+            bool steal_half(size_t& new_lo, size_t& new_hi) {
+                std::lock_guard<std::mutex> lock(m);
+                if (lo == hi)
+                    return false;
+                const size_t mid = lo + (hi - lo) / 2;
+                new_lo = mid;
+                new_hi = hi;
+                hi = mid;
+                return true;
+            }
+        };
+    }
+
+    /**
+     @brief Call f(i, worker) for all i in [0, N) using a work stealing scheduler.
+     @param N the number of work items.
+     @param f the function called for each item. worker is the index of the thread that calls f and is in
+     the range [0, threads). It can be used to index per thread storage.
+     @param chunk_size the number of consecutive items handed out at a time.
+     @param threads the number of threads. Zero means thread_count().
+
+     The items are initially divided into contiguous blocks - one for each thread. A thread processes its block
+     chunk by chunk, and when it runs dry it steals the back half of the remaining chunks of another thread.
+     Thus, threads that are handed cheap items end up helping the threads that are handed expensive items.
+     Each item is processed exactly once, but which worker processes it and in what order is not deterministic
+     unless a single thread is used.
+     */
+    template<typename Func>
+    void parallel_for(size_t N, Func&& f, size_t chunk_size = 1, unsigned int threads = 0) {
+        if (N == 0)
+            return;
+        chunk_size = std::max<size_t>(chunk_size, 1);
+        const size_t no_chunks = (N + chunk_size - 1) / chunk_size;
+        const unsigned int T = static_cast<unsigned int>(
+                std::min<size_t>(threads == 0 ? thread_count() : threads, no_chunks));
+
+        auto do_chunk = [&](size_t c, unsigned int worker) {
+            const size_t end = std::min(N, (c + 1) * chunk_size);
+            for (size_t i = c * chunk_size; i < end; ++i)
+                f(i, worker);
+        };
+
+        if (T <= 1) {
+            for (size_t c = 0; c < no_chunks; ++c)
+                do_chunk(c, 0);
+            return;
+        }
+
+        std::vector<detail::WorkRange> ranges(T);
+        for (unsigned int t = 0; t < T; ++t) {
+            ranges[t].lo = (no_chunks * t) / T;
+            ranges[t].hi = (no_chunks * (t + 1)) / T;
+        }
+
+        // Under a ThreadLimit each worker gets its share of the limit for the parallel calls it makes.
+        const unsigned int limit = thread_limit();
+        const unsigned int worker_limit = limit == 0 ? 0 : std::max(1u, limit / T);
+
+        auto worker_fun = [&](unsigned int worker) {
+            ThreadLimit share(worker_limit);
+            auto& own = ranges[worker];
+            for (;;) {
+                size_t c;
+                while (own.pop_front(c))
+                    do_chunk(c, worker);
+
+                // Our own range is empty. Look for a victim, starting with our neighbour.
+                bool stolen = false;
+                for (unsigned int k = 1; k < T && !stolen; ++k) {
+                    size_t lo, hi;
+                    if (ranges[(worker + k) % T].steal_half(lo, hi)) {
+                        std::lock_guard<std::mutex> lock(own.m);
+                        own.lo = lo;
+                        own.hi = hi;
+                        stolen = true;
+                    }
+                }
+                // No work anywhere: since work is never added, we are done.
+                if (!stolen)
+                    return;
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(T - 1);
+        for (unsigned int t = 1; t < T; ++t)
+            pool.emplace_back(worker_fun, t);
+        worker_fun(0);
+        for (auto& th: pool)
+            th.join();
+    }
+
+    /**
+     @brief Call f(i, worker) for all i in [0, N) in parallel and commit(i) for all i in increasing order.
+     @param N the number of work items.
+     @param f the function called for each item. worker is in the range [0, threads) as for parallel_for.
+     @param commit the function called for item i once f has returned for all items up to and including i.
+     @param threads the number of threads. Zero means thread_count().
+
+     The items are handed out one at a time in increasing order, so items near the next one to be committed are
+     processed first. The calls of commit never overlap, and they are made by whichever thread completes the
+     items they wait for, so no thread waits for the others to finish a batch of items. This allows serial
+     algorithms whose steps depend on the previous steps to be run speculatively: f computes item i from the
+     state committed so far, and commit(i) checks against the final state before item i whether the result
+     can be used. Data shared between f and commit must be protected, e.g. with atomics.
+     */
+    template<typename Func, typename Commit>
+    void parallel_for_ordered(size_t N, Func&& f, Commit&& commit, unsigned int threads = 0) {
+        if (N == 0)
+            return;
+        const unsigned int T = static_cast<unsigned int>(
+                std::min<size_t>(threads == 0 ? thread_count() : threads, N));
+        if (T <= 1) {
+            for (size_t i = 0; i < N; ++i) {
+                f(i, 0);
+                commit(i);
+            }
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::vector<std::atomic<bool>> done(N);
+        std::mutex commit_mutex;
+        size_t committed = 0;
+
+        const unsigned int limit = thread_limit();
+        const unsigned int worker_limit = limit == 0 ? 0 : std::max(1u, limit / T);
+
+        auto worker_fun = [&](unsigned int worker) {
+            ThreadLimit share(worker_limit);
+            for (size_t i = next++; i < N; i = next++) {
+                f(i, worker);
+                done[i].store(true, std::memory_order_release);
+                // Every thread drains the completed prefix after finishing an item, so the last item to complete
+                // is always followed by the commits it was holding back.
+                std::lock_guard<std::mutex> lock(commit_mutex);
+                while (committed < N && done[committed].load(std::memory_order_acquire))
+                    commit(committed++);
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(T - 1);
+        for (unsigned int t = 1; t < T; ++t)
+            pool.emplace_back(worker_fun, t);
+        worker_fun(0);
+        for (auto& th: pool)
+            th.join();
+    }
+}
+
+#endif /* Parallel_h */
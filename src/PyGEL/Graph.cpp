@@ -69,6 +69,19 @@ size_t Graph_positions(Graph_ptr _self, double** pos){
     return N;
 }
 
+size_t Graph_node_radius(Graph_ptr _self, double** radius){
+    AMGraph3D* self = reinterpret_cast<AMGraph3D*>(_self);
+    auto N = self->no_nodes();
+    if(N == 0) {
+        *radius = nullptr;
+        return 0;
+    }
+    // Indexing the last node makes sure that there is a radius for every node.
+    self->node_radius[N-1];
+    *radius = &(self->node_radius[0]);
+    return N;
+}
+
 void Graph_clear(Graph_ptr _self){
     AMGraph3D* self = reinterpret_cast<AMGraph3D*>(_self);
     self->clear();
@@ -109,6 +122,57 @@ void Graph_merge_nodes(Graph_ptr _self, size_t n0, size_t n1, bool avg){
     self->merge_nodes(NodeID(n0), NodeID(n1));
 }
 
+size_t Graph_add_nodes(Graph_ptr _self, const double* pos, size_t N){
+    AMGraph3D* self = reinterpret_cast<AMGraph3D*>(_self);
+    const size_t first = self->no_nodes();
+    for(size_t i=0; i<N; ++i)
+        self->add_node(Vec3d(pos[3*i],pos[3*i+1],pos[3*i+2]));
+    return first;
+}
+
+size_t Graph_connect_node_pairs(Graph_ptr _self, const size_t* pairs, size_t M){
+    AMGraph3D* self = reinterpret_cast<AMGraph3D*>(_self);
+    size_t cnt = 0;
+    for(size_t i=0; i<M; ++i)
+        if(self->connect_nodes(NodeID(pairs[2*i]), NodeID(pairs[2*i+1])) != AMGraph::InvalidEdgeID)
+            ++cnt;
+    return cnt;
+}
+
+size_t Graph_edge_count(Graph_ptr _self){
+    AMGraph3D* self = reinterpret_cast<AMGraph3D*>(_self);
+    size_t A = 0;
+    for(auto n: self->node_ids())
+        A += self->edges(n).size();
+    return A/2;
+}
+
+size_t Graph_edges(Graph_ptr _self, size_t* pairs, size_t M){
+    AMGraph3D* self = reinterpret_cast<AMGraph3D*>(_self);
+    size_t i = 0;
+    for(auto n: self->node_ids())
+        for(const auto& [m, e]: self->edges(n))
+            if(size_t(n) < m && i < M) {
+                pairs[2*i] = n;
+                pairs[2*i+1] = m;
+                ++i;
+            }
+    return i;
+}
+
+size_t Graph_adjacency(Graph_ptr _self, size_t* offsets, size_t* nbrs, size_t A){
+    AMGraph3D* self = reinterpret_cast<AMGraph3D*>(_self);
+    size_t i = 0;
+    offsets[0] = 0;
+    for(auto n: self->node_ids()) {
+        for(const auto& [m, e]: self->edges(n))
+            if(i < A)
+                nbrs[i++] = m;
+        offsets[n+1] = i;
+    }
+    return i;
+}
+
 double Graph_average_edge_length(Graph_ptr _self){
     AMGraph3D* self = reinterpret_cast<AMGraph3D*>(_self);
     double r = self->average_edge_length();
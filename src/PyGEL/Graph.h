@@ -34,6 +34,7 @@ DLLEXPORT size_t Graph_neighbors(Graph_ptr _self, size_t n, IntVector_ptr _nbors
 
 DLLEXPORT void Graph_cleanup(Graph_ptr self);
 DLLEXPORT size_t Graph_positions(Graph_ptr self, double** pos);
+DLLEXPORT size_t Graph_node_radius(Graph_ptr self, double** radius);
 DLLEXPORT double Graph_average_edge_length(Graph_ptr self);
 
 DLLEXPORT size_t Graph_add_node(Graph_ptr self, double* pos);
@@ -43,6 +44,12 @@ DLLEXPORT size_t Graph_connect_nodes(Graph_ptr self, size_t n0, size_t n1);
 DLLEXPORT void Graph_disconnect_nodes(Graph_ptr self, size_t n0, size_t n1);
 DLLEXPORT void Graph_merge_nodes(Graph_ptr self, size_t n0, size_t n1, bool avg);
 
+DLLEXPORT size_t Graph_add_nodes(Graph_ptr self, const double* pos, size_t N);
+DLLEXPORT size_t Graph_connect_node_pairs(Graph_ptr self, const size_t* pairs, size_t M);
+DLLEXPORT size_t Graph_edge_count(Graph_ptr self);
+DLLEXPORT size_t Graph_edges(Graph_ptr self, size_t* pairs, size_t M);
+DLLEXPORT size_t Graph_adjacency(Graph_ptr self, size_t* offsets, size_t* nbrs, size_t A);
+
 
 #ifdef __cplusplus
 }
@@ -72,3 +72,62 @@ size_t I3DTree_m_closest_points(I3DTree_ptr tree, double x, double y, double z,
     }
     return N;
 }
+
+void I3DTree_insert_points(I3DTree_ptr _tree, size_t n, const double* pts, const size_t* vals) {
+    I3DTree& tree = *reinterpret_cast<I3DTree*>(_tree);
+    for(size_t i=0;i<n;++i)
+        tree.insert(Vec3d(pts[3*i], pts[3*i+1], pts[3*i+2]), vals[i]);
+}
+
+namespace {
+    using Record = Geometry::KDTreeRecord<Vec3d, size_t>;
+
+    /// Run a batch query with the n points in pts and copy the results to the output arguments.
+    template<typename Query>
+    size_t batch_query(size_t n, const double* pts, Query&& query,
+                       size_t* _offsets, Vec3dVector_ptr _keys, IntVector_ptr _vals) {
+        vector<Vec3d> query_pts(n);
+        for(size_t i=0;i<n;++i)
+            query_pts[i] = Vec3d(pts[3*i], pts[3*i+1], pts[3*i+2]);
+
+        vector<size_t> offsets;
+        vector<Record> records;
+        query(query_pts, offsets, records);
+
+        Vec3dVector& keys = *reinterpret_cast<Vec3dVector*>(_keys);
+        IntVector& vals = *reinterpret_cast<IntVector*>(_vals);
+        auto N = records.size();
+        keys.resize(N);
+        vals.resize(N);
+        for(size_t i=0;i<N;++i) {
+            keys[i] = records[i].k;
+            vals[i] = records[i].v;
+        }
+        copy(offsets.begin(), offsets.end(), _offsets);
+        return N;
+    }
+}
+
+size_t I3DTree_closest_point_batch(I3DTree_ptr _tree, size_t n, const double* pts, double r,
+                                   size_t* offsets, Vec3dVector_ptr keys, IntVector_ptr vals) {
+    const I3DTree& tree = *reinterpret_cast<I3DTree*>(_tree);
+    return batch_query(n, pts, [&](const vector<Vec3d>& p, vector<size_t>& o, vector<Record>& rec) {
+        tree.closest_point(p, r, o, rec);
+    }, offsets, keys, vals);
+}
+
+size_t I3DTree_in_sphere_batch(I3DTree_ptr _tree, size_t n, const double* pts, double r,
+                               size_t* offsets, Vec3dVector_ptr keys, IntVector_ptr vals) {
+    const I3DTree& tree = *reinterpret_cast<I3DTree*>(_tree);
+    return batch_query(n, pts, [&](const vector<Vec3d>& p, vector<size_t>& o, vector<Record>& rec) {
+        tree.in_sphere(p, r, o, rec);
+    }, offsets, keys, vals);
+}
+
+size_t I3DTree_m_closest_points_batch(I3DTree_ptr _tree, size_t n, const double* pts, double r, int m,
+                                      size_t* offsets, Vec3dVector_ptr keys, IntVector_ptr vals) {
+    const I3DTree& tree = *reinterpret_cast<I3DTree*>(_tree);
+    return batch_query(n, pts, [&](const vector<Vec3d>& p, vector<size_t>& o, vector<Record>& rec) {
+        tree.m_closest(max(m, 0), p, r, o, rec);
+    }, offsets, keys, vals);
+}
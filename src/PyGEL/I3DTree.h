@@ -35,6 +35,17 @@ extern "C" {
                                        Vec3dVector_ptr keys, IntVector_ptr vals);
     DLLEXPORT size_t I3DTree_m_closest_points(I3DTree_ptr tree, double x, double y, double z, double r, int m,
                                               Vec3dVector_ptr keys, IntVector_ptr vals);
+
+    // The functions below insert or query n points stored as consecutive xyz triples in pts. The queries run
+    // in parallel. The results for point i are keys and vals from offsets[i] up to offsets[i+1], and offsets
+    // must have room for n+1 entries. The total number of results is returned.
+    DLLEXPORT void I3DTree_insert_points(I3DTree_ptr tree, size_t n, const double* pts, const size_t* vals);
+    DLLEXPORT size_t I3DTree_closest_point_batch(I3DTree_ptr tree, size_t n, const double* pts, double r,
+                                                 size_t* offsets, Vec3dVector_ptr keys, IntVector_ptr vals);
+    DLLEXPORT size_t I3DTree_in_sphere_batch(I3DTree_ptr tree, size_t n, const double* pts, double r,
+                                             size_t* offsets, Vec3dVector_ptr keys, IntVector_ptr vals);
+    DLLEXPORT size_t I3DTree_m_closest_points_batch(I3DTree_ptr tree, size_t n, const double* pts, double r, int m,
+                                                    size_t* offsets, Vec3dVector_ptr keys, IntVector_ptr vals);
     
 #ifdef __cplusplus
 }
@@ -26,6 +26,10 @@ void IntVector_delete(IntVector_ptr self) {
     delete reinterpret_cast<IntVector*>(self);
 }
 
+size_t* IntVector_data(IntVector_ptr self) {
+    return reinterpret_cast<IntVector*>(self)->data();
+}
+
 size_t IntVector_get(IntVector_ptr self, size_t idx) {
     return (*reinterpret_cast<IntVector*>(self))[idx];
 }
@@ -27,6 +27,7 @@ extern "C" {
     DLLEXPORT IntVector_ptr IntVector_new(size_t s);
     DLLEXPORT size_t IntVector_get(IntVector_ptr self, size_t idx);
     DLLEXPORT size_t IntVector_size(IntVector_ptr self);
+    DLLEXPORT size_t* IntVector_data(IntVector_ptr self);
     DLLEXPORT void IntVector_delete(IntVector_ptr self);
 #ifdef __cplusplus
 }
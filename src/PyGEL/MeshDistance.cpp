@@ -8,6 +8,8 @@
 
 #include "MeshDistance.h"
 
+#include <algorithm>
+#include <vector>
 #include <GEL/CGLA/CGLA.h>
 #include <GEL/HMesh/Manifold.h>
 #include <GEL/Geometry/build_bbtree.h>
@@ -17,41 +19,59 @@ using namespace CGLA;
 using namespace Geometry;
 
 class MeshDistance {
-    Geometry::AABBTree aabb_tree;
+    Geometry::BVH bvh;
 public:
     MeshDistance(HMesh::Manifold* m);
     
-    float signed_distance(const CGLA::Vec3f& p, float upper);
-    bool ray_inside_test(const CGLA::Vec3f& p, int no_rays);
+    std::vector<float> signed_distance(const std::vector<CGLA::Vec3f>& pts, float upper);
+    std::vector<int> ray_inside_test(const std::vector<CGLA::Vec3f>& pts, int no_rays);
 };
 
 
 MeshDistance::MeshDistance(Manifold* m) {
-    build_AABBTree(*m, aabb_tree);
+    build_BVH(*m, bvh);
 }
 
-float MeshDistance::signed_distance(const CGLA::Vec3f& p, float upper){
-    
-    return aabb_tree.compute_signed_distance(p);
-    
+std::vector<float> MeshDistance::signed_distance(const std::vector<CGLA::Vec3f>& pts, float upper){
+    return bvh.compute_signed_distance(pts, upper);
 }
 
-bool MeshDistance::ray_inside_test(const CGLA::Vec3f& p, int no_rays) {
+std::vector<int> MeshDistance::ray_inside_test(const std::vector<CGLA::Vec3f>& pts, int no_rays) {
     auto rand_vec = []() {return Vec3f(gel_rand()/double(GEL_RAND_MAX),
                                        gel_rand()/double(GEL_RAND_MAX),
                                        gel_rand()/double(GEL_RAND_MAX));
     };
-    
-    int even=0;
-    int odd=0;
-    for (int i=0;i<no_rays;++i) {
-        int cnt = aabb_tree.intersect_cnt(p, rand_vec());
-        if(cnt % 2 == 0)
-            ++even;
-        else
-            ++odd;
+
+    // The points are processed in blocks, so only the rays of one block are stored at a time. The directions are
+    // drawn serially in the order in which they used to be drawn, so the result does not depend on the number of
+    // threads.
+    const size_t block_size = 4096;
+    std::vector<int> inside(pts.size());
+    std::vector<CGLA::Vec3f> ray_pts, ray_dirs;
+    for(size_t first=0; first<pts.size(); first += block_size) {
+        const size_t last = std::min(first + block_size, pts.size());
+        ray_pts.clear();
+        ray_dirs.clear();
+        for(size_t j=first; j<last; ++j)
+            for (int i=0;i<no_rays;++i) {
+                ray_pts.push_back(pts[j]);
+                ray_dirs.push_back(rand_vec());
+            }
+        std::vector<int> cnt = bvh.intersect_cnt(ray_pts, ray_dirs);
+
+        for(size_t j=first; j<last; ++j) {
+            int even=0;
+            int odd=0;
+            for (int i=0;i<no_rays;++i) {
+                if(cnt[(j-first)*no_rays+i] % 2 == 0)
+                    ++even;
+                else
+                    ++odd;
+            }
+            inside[j] = odd > even;
+        }
     }
-    return odd > even;
+    return inside;
 }
 
 
@@ -75,8 +95,11 @@ void MeshDistance_signed_distance(MeshDistance_ptr _self,
                                    float* d,
                                    float upper) {
     MeshDistance* self = reinterpret_cast<MeshDistance*>(_self);
+    std::vector<Vec3f> pts(no_query_points);
     for(int i=0; i<no_query_points;++i)
-        d[i] = self->signed_distance(Vec3f(p[3*i],p[3*i+1],p[3*i+2]), upper);
+        pts[i] = Vec3f(p[3*i],p[3*i+1],p[3*i+2]);
+    auto dist = self->signed_distance(pts, upper);
+    std::copy(dist.begin(), dist.end(), d);
 }
 
 void MeshDistance_ray_inside_test(MeshDistance_ptr _self,
@@ -85,7 +108,10 @@ void MeshDistance_ray_inside_test(MeshDistance_ptr _self,
                                   int* s,
                                   int no_rays) {
     MeshDistance* self = reinterpret_cast<MeshDistance*>(_self);
+    std::vector<Vec3f> pts(no_query_points);
     for(int i=0; i<no_query_points;++i)
-        s[i] = self->ray_inside_test(Vec3f(p[3*i],p[3*i+1],p[3*i+2]), no_rays);
+        pts[i] = Vec3f(p[3*i],p[3*i+1],p[3*i+2]);
+    auto inside = self->ray_inside_test(pts, no_rays);
+    std::copy(inside.begin(), inside.end(), s);
 }
 
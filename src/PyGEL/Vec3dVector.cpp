@@ -25,6 +25,10 @@ size_t Vec3dVector_size(Vec3dVector_ptr self) {
 }
 
 
+double* Vec3dVector_data(Vec3dVector_ptr self) {
+    return reinterpret_cast<double*>(reinterpret_cast<Vec3dVector*>(self)->data());
+}
+
 double* Vec3dVector_get(Vec3dVector_ptr self, size_t idx) {
     return (*reinterpret_cast<Vec3dVector*>(self))[idx].get();
 }
@@ -27,6 +27,7 @@ extern "C" {
     DLLEXPORT Vec3dVector_ptr Vec3dVector_new(size_t s);
     DLLEXPORT double* Vec3dVector_get(Vec3dVector_ptr self, size_t idx);
     DLLEXPORT size_t Vec3dVector_size(Vec3dVector_ptr self);
+    DLLEXPORT double* Vec3dVector_data(Vec3dVector_ptr self);
     DLLEXPORT void Vec3dVector_delete(Vec3dVector_ptr self);
 
 #ifdef __cplusplus
@@ -7,12 +7,16 @@
 //
 
 
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <GEL/Geometry/Graph.h>
 #include <GEL/Geometry/graph_io.h>
 #include <GEL/Geometry/graph_skeletonize.h>
+#include <GEL/Geometry/graph_tiling.h>
+#include <GEL/Geometry/graph_tree.h>
 #include <GEL/Geometry/graph_util.h>
+#include <GEL/Util/Parallel.h>
 #include "Graph.h"
 #include "Manifold.h"
 
@@ -22,6 +26,29 @@ using namespace std;
 using namespace Geometry;
 using namespace HMesh;
 
+namespace {
+    // Statistics of the most recent call of one of the local separator based skeletonizers.
+    SkeletonizationStats last_skeletonization_stats;
+
+    /// Returns true if the first layer of msg has the same nodes, positions, and adjacency as g.
+    bool multiscale_graph_matches(const MultiScaleGraph& msg, const AMGraph3D& g) {
+        if (msg.layers.empty() || msg.layers[0].no_nodes() != g.no_nodes())
+            return false;
+        const CSRGraph3D& layer = msg.layers[0];
+        for (auto n: g.node_ids()) {
+            const CGLA::Vec3d &p = layer.pos[n], &q = g.pos[n];
+            if (!(p == q) && !(std::isnan(p[0]) && std::isnan(q[0])))
+                return false;
+            const auto nbrs = layer.neighbors(n);
+            const auto& edges = g.edges(n);
+            if (nbrs.size() != edges.size() ||
+                !equal(nbrs.begin(), nbrs.end(), edges.begin(), [](AMGraph::NodeID m, const auto& e) { return m == e.first; }))
+                return false;
+        }
+        return true;
+    }
+}
+
 void graph_from_mesh(Manifold_ptr _m_ptr, Graph_ptr _g_ptr) {
     AMGraph3D& g = *reinterpret_cast<AMGraph3D*>(_g_ptr);
     Manifold& m = *reinterpret_cast<Manifold*>(_m_ptr);
@@ -50,6 +77,19 @@ bool graph_save(Graph_ptr _g_ptr, const char* _file_name) {
     return Geometry::graph_save(file_name, *g_ptr);
 }
 
+bool graph_from_points_file(Graph_ptr _g_ptr, const char* _file_name, double rad, int N_closest) {
+    AMGraph3D* g_ptr = reinterpret_cast<AMGraph3D*>(_g_ptr);
+    const string file_name(_file_name);
+    *g_ptr = graph_from_points(file_name, rad, N_closest);
+    return g_ptr->no_nodes()>0;
+}
+
+void graph_from_points(Graph_ptr _g_ptr, const double* pts, size_t N, double rad, int N_closest) {
+    AMGraph3D* g_ptr = reinterpret_cast<AMGraph3D*>(_g_ptr);
+    const CGLA::Vec3d* pts_begin = reinterpret_cast<const CGLA::Vec3d*>(pts);
+    *g_ptr = graph_from_points(vector<CGLA::Vec3d>(pts_begin, pts_begin + N), rad, N_closest);
+}
+
 void graph_to_mesh_cyl(Graph_ptr _g_ptr, Manifold_ptr _m_ptr, float fudge) {
     AMGraph3D* g_ptr = reinterpret_cast<AMGraph3D*>(_g_ptr);
     Manifold* m_ptr = reinterpret_cast<Manifold*>(_m_ptr);
@@ -85,7 +125,7 @@ void graph_LS_skeleton(Graph_ptr _g_ptr, Graph_ptr _skel_ptr, IntVector_ptr _map
     IntVector* map_ptr = reinterpret_cast<IntVector*>(_map_ptr);
     map_ptr->resize(g_ptr->no_nodes());
 
-    auto seps = local_separators(*g_ptr, sampling);
+    auto seps = local_separators(*g_ptr, sampling, 0.09, 0, &last_skeletonization_stats);
     auto [skel, mapping]  = skeleton_from_node_set_vec(*g_ptr, seps);
     *skel_ptr = skel;
 
@@ -93,15 +133,22 @@ void graph_LS_skeleton(Graph_ptr _g_ptr, Graph_ptr _skel_ptr, IntVector_ptr _map
         (*map_ptr)[n] = mapping[n];
 }
 
-void graph_MSLS_skeleton(Graph_ptr _g_ptr, Graph_ptr _skel_ptr, IntVector_ptr _map_ptr, int grow_thresh) {
+void graph_MSLS_skeleton(Graph_ptr _g_ptr, Graph_ptr _skel_ptr, IntVector_ptr _map_ptr, int grow_thresh,
+                         MultiScaleGraph_ptr _msg_ptr) {
     using IntVector = vector<size_t>;
 
     AMGraph3D* g_ptr = reinterpret_cast<AMGraph3D*>(_g_ptr);
     AMGraph3D* skel_ptr = reinterpret_cast<AMGraph3D*>(_skel_ptr);
     IntVector* map_ptr = reinterpret_cast<IntVector*>(_map_ptr);
+    MultiScaleGraph* msg_ptr = reinterpret_cast<MultiScaleGraph*>(_msg_ptr);
     map_ptr->resize(g_ptr->no_nodes());
 
-    auto seps = multiscale_local_separators(*g_ptr, Geometry::SamplingType::Advanced, grow_thresh, 0.1);
+    // A multi-scale graph which does not match the input graph is ignored, and a new one is built.
+    auto seps = (msg_ptr && multiscale_graph_matches(*msg_ptr, *g_ptr)) ?
+        multiscale_local_separators(*g_ptr, *msg_ptr, Geometry::SamplingType::Advanced, grow_thresh, 0.1, 0,
+                                    &last_skeletonization_stats) :
+        multiscale_local_separators(*g_ptr, Geometry::SamplingType::Advanced, grow_thresh, 0.1, 0,
+                                    &last_skeletonization_stats);
     auto [skel, mapping]  = skeleton_from_node_set_vec(*g_ptr, seps);
     *skel_ptr = skel;
 
@@ -109,11 +156,103 @@ void graph_MSLS_skeleton(Graph_ptr _g_ptr, Graph_ptr _skel_ptr, IntVector_ptr _m
         (*map_ptr)[n] = mapping[n];
 }
 
+MultiScaleGraph_ptr graph_multiscale_new(Graph_ptr _g_ptr, int grow_thresh) {
+    AMGraph3D* g_ptr = reinterpret_cast<AMGraph3D*>(_g_ptr);
+    return reinterpret_cast<MultiScaleGraph_ptr>(new MultiScaleGraph(multiscale_graph(*g_ptr, grow_thresh, true)));
+}
+
+void graph_multiscale_delete(MultiScaleGraph_ptr msg_ptr) {
+    delete reinterpret_cast<MultiScaleGraph*>(msg_ptr);
+}
+
+bool graph_multiscale_save(MultiScaleGraph_ptr _msg_ptr, const char* file_name) {
+    MultiScaleGraph* msg_ptr = reinterpret_cast<MultiScaleGraph*>(_msg_ptr);
+    return multiscale_graph_save(string(file_name), *msg_ptr);
+}
+
+MultiScaleGraph_ptr graph_multiscale_load(const char* file_name) {
+    // Exceptions must not cross the C interface, so null is returned if the file cannot be loaded for any reason.
+    try {
+        MultiScaleGraph msg = multiscale_graph_load(string(file_name));
+        if (msg.layers.empty())
+            return nullptr;
+        return reinterpret_cast<MultiScaleGraph_ptr>(new MultiScaleGraph(std::move(msg)));
+    }
+    catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+size_t graph_multiscale_layer_sizes(MultiScaleGraph_ptr _msg_ptr, size_t* sizes, size_t max_layers) {
+    MultiScaleGraph* msg_ptr = reinterpret_cast<MultiScaleGraph*>(_msg_ptr);
+    const size_t L = msg_ptr->layers.size();
+    for (size_t l = 0; l < min(L, max_layers); ++l)
+        sizes[l] = msg_ptr->layers[l].no_nodes();
+    return L;
+}
+
 void graph_saturate(Graph_ptr _g_ptr, int hops, double dist_frac, double rad) {
     AMGraph3D* g_ptr = reinterpret_cast<AMGraph3D*>(_g_ptr);
     saturate_graph(*g_ptr, hops, dist_frac, rad);
 }
 
+IncrementalSkeleton_ptr graph_incremental_new(Graph_ptr _g_ptr) {
+    AMGraph3D* g_ptr = reinterpret_cast<AMGraph3D*>(_g_ptr);
+    return reinterpret_cast<IncrementalSkeleton_ptr>(new IncrementalSkeleton(*g_ptr));
+}
+
+void graph_incremental_delete(IncrementalSkeleton_ptr inc_ptr) {
+    delete reinterpret_cast<IncrementalSkeleton*>(inc_ptr);
+}
+
+size_t graph_incremental_add_node(IncrementalSkeleton_ptr inc_ptr, const double* pos) {
+    return reinterpret_cast<IncrementalSkeleton*>(inc_ptr)->add_node(CGLA::Vec3d(pos[0], pos[1], pos[2]));
+}
+
+void graph_incremental_remove_node(IncrementalSkeleton_ptr inc_ptr, size_t n) {
+    reinterpret_cast<IncrementalSkeleton*>(inc_ptr)->remove_node(n);
+}
+
+void graph_incremental_connect_nodes(IncrementalSkeleton_ptr inc_ptr, size_t n0, size_t n1) {
+    reinterpret_cast<IncrementalSkeleton*>(inc_ptr)->connect_nodes(n0, n1);
+}
+
+void graph_incremental_disconnect_nodes(IncrementalSkeleton_ptr inc_ptr, size_t n0, size_t n1) {
+    reinterpret_cast<IncrementalSkeleton*>(inc_ptr)->disconnect_nodes(n0, n1);
+}
+
+size_t graph_incremental_update(IncrementalSkeleton_ptr inc_ptr) {
+    return reinterpret_cast<IncrementalSkeleton*>(inc_ptr)->update();
+}
+
+void graph_incremental_skeleton(IncrementalSkeleton_ptr inc_ptr, Graph_ptr _skel_ptr, IntVector_ptr _map_ptr) {
+    using IntVector = vector<size_t>;
+    IncrementalSkeleton* isk_ptr = reinterpret_cast<IncrementalSkeleton*>(inc_ptr);
+    AMGraph3D* skel_ptr = reinterpret_cast<AMGraph3D*>(_skel_ptr);
+    IntVector* map_ptr = reinterpret_cast<IntVector*>(_map_ptr);
+    auto [skel, mapping] = isk_ptr->skeleton();
+    *skel_ptr = skel;
+    map_ptr->resize(isk_ptr->graph().no_nodes());
+    for(auto n: isk_ptr->graph().node_ids())
+        (*map_ptr)[n] = mapping[n];
+}
+
+void graph_tiled_skeleton(Graph_ptr _skel_ptr, const double* pts, size_t N, double rad, int N_closest,
+                          double tile_size, double overlap, bool multiscale, int grow_thresh, int max_tiles) {
+    AMGraph3D* skel_ptr = reinterpret_cast<AMGraph3D*>(_skel_ptr);
+    const CGLA::Vec3d* pts_begin = reinterpret_cast<const CGLA::Vec3d*>(pts);
+    *skel_ptr = tiled_skeleton(vector<CGLA::Vec3d>(pts_begin, pts_begin + N), rad, N_closest, tile_size, overlap,
+                               multiscale, max(grow_thresh, 1), max(max_tiles, 0));
+}
+
+bool graph_tiled_skeleton_file(Graph_ptr _skel_ptr, const char* file_name, double rad, int N_closest,
+                               double tile_size, double overlap, bool multiscale, int grow_thresh, int max_tiles) {
+    AMGraph3D* skel_ptr = reinterpret_cast<AMGraph3D*>(_skel_ptr);
+    *skel_ptr = tiled_skeleton(load_points(string(file_name)), rad, N_closest, tile_size, overlap,
+                               multiscale, max(grow_thresh, 1), max(max_tiles, 0));
+    return skel_ptr->no_nodes() > 0;
+}
+
 DLLEXPORT void graph_front_skeleton(Graph_ptr _g_ptr, Graph_ptr _skel_ptr, IntVector_ptr _map_ptr, int N_col, double* colors){
     using IntVector = vector<size_t>;
     AMGraph3D* g_ptr = reinterpret_cast<AMGraph3D*>(_g_ptr);
@@ -145,3 +284,64 @@ void graph_color_detached_parts(Graph_ptr _g_ptr) {
     color_detached_parts(*g_ptr);
 }
 
+size_t graph_reattach_detached_parts(Graph_ptr _g_ptr, double max_gap, double max_angle, unsigned candidates) {
+    AMGraph3D* g_ptr = reinterpret_cast<AMGraph3D*>(_g_ptr);
+    return reattach_detached_parts(*g_ptr, max_gap, max_angle, candidates);
+}
+
+size_t graph_rooted_tree(Graph_ptr _g_ptr, size_t root, size_t* parent, int* depth, double* path_length,
+                         size_t* subtree_size, int* strahler, int* segment) {
+    AMGraph3D* g_ptr = reinterpret_cast<AMGraph3D*>(_g_ptr);
+    RootedTree t = rooted_tree(*g_ptr, root);
+    for(auto n: g_ptr->node_ids()) {
+        parent[n] = t.parent[n];
+        depth[n] = t.depth[n];
+        path_length[n] = t.path_length[n];
+        subtree_size[n] = t.subtree_size[n];
+        strahler[n] = t.strahler[n];
+        segment[n] = t.segment[n];
+    }
+    return t.root;
+}
+
+void graph_set_thread_count(int n) {
+    Util::set_thread_count(max(n, 0));
+}
+
+int graph_get_thread_count() {
+    return Util::thread_count();
+}
+
+void graph_set_skeletonization_logging(bool on) {
+    set_skeletonization_logging(on);
+}
+
+void graph_set_skeletonization_seed(uint64_t seed) {
+    set_skeletonization_seed(seed);
+}
+
+int graph_skeletonization_stats(size_t* counts, double* times, double* busy_times, int max_threads) {
+    const auto& st = last_skeletonization_stats;
+    counts[0] = st.separators_computed;
+    counts[1] = st.separators_found;
+    counts[2] = st.separators_packed;
+    counts[3] = st.peak_memory;
+    times[0] = st.time_sampling;
+    times[1] = st.time_multiscale;
+    times[2] = st.time_searching;
+    times[3] = st.time_filtering;
+    times[4] = st.time_packing;
+    times[5] = st.time_expanding;
+    const int T = st.thread_busy_time.size();
+    for (int i = 0; i < min(T, max_threads); ++i)
+        busy_times[i] = st.thread_busy_time[i];
+    return T;
+}
+
+int graph_skeletonization_level_times(double* times, int max_levels) {
+    const auto& st = last_skeletonization_stats;
+    const int L = st.time_expanding_per_level.size();
+    for (int i = 0; i < min(L, max_levels); ++i)
+        times[i] = st.time_expanding_per_level[i];
+    return L;
+}
@@ -9,6 +9,7 @@
 #ifndef graph_functions_hpp
 #define graph_functions_hpp
 
+#include <stdint.h>
 #include "IntVector.h"
 
 #if defined(__APPLE__) || defined(__linux__)
@@ -19,6 +20,8 @@
 
 typedef char* Graph_ptr;
 typedef char* Manifold_ptr;
+typedef char* MultiScaleGraph_ptr;
+typedef char* IncrementalSkeleton_ptr;
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +32,9 @@ DLLEXPORT void graph_from_mesh(Manifold_ptr m_ptr, Graph_ptr g_ptr);
 DLLEXPORT bool graph_load(Graph_ptr g_ptr, const char* file_name);
 DLLEXPORT bool graph_save(Graph_ptr g_ptr, const char* file_name);
 
+DLLEXPORT bool graph_from_points_file(Graph_ptr g_ptr, const char* file_name, double rad, int N_closest);
+DLLEXPORT void graph_from_points(Graph_ptr g_ptr, const double* pts, size_t N, double rad, int N_closest);
+
 DLLEXPORT void graph_to_mesh_cyl(Graph_ptr g_ptr, Manifold_ptr m_ptr, float fudge);
 DLLEXPORT void graph_to_mesh_iso(Graph_ptr _g_ptr, Manifold_ptr _m_ptr, float fudge, size_t grid_res);
 
@@ -38,11 +44,43 @@ DLLEXPORT void graph_prune(Graph_ptr g_ptr);
 DLLEXPORT void graph_saturate(Graph_ptr _g_ptr, int hops, double dist_frac, double rad);
 
 DLLEXPORT void graph_LS_skeleton(Graph_ptr g_ptr, Graph_ptr skel_ptr, IntVector_ptr map_ptr, bool sampling=false);
-DLLEXPORT void graph_MSLS_skeleton(Graph_ptr g_ptr, Graph_ptr skel_ptr, IntVector_ptr map_ptr, int grow_thresh=64);
+DLLEXPORT void graph_MSLS_skeleton(Graph_ptr g_ptr, Graph_ptr skel_ptr, IntVector_ptr map_ptr, int grow_thresh=64,
+                                   MultiScaleGraph_ptr msg_ptr=0);
+
+DLLEXPORT MultiScaleGraph_ptr graph_multiscale_new(Graph_ptr g_ptr, int grow_thresh);
+DLLEXPORT void graph_multiscale_delete(MultiScaleGraph_ptr msg_ptr);
+DLLEXPORT bool graph_multiscale_save(MultiScaleGraph_ptr msg_ptr, const char* file_name);
+DLLEXPORT MultiScaleGraph_ptr graph_multiscale_load(const char* file_name);
+DLLEXPORT size_t graph_multiscale_layer_sizes(MultiScaleGraph_ptr msg_ptr, size_t* sizes, size_t max_layers);
+
+DLLEXPORT IncrementalSkeleton_ptr graph_incremental_new(Graph_ptr g_ptr);
+DLLEXPORT void graph_incremental_delete(IncrementalSkeleton_ptr inc_ptr);
+DLLEXPORT size_t graph_incremental_add_node(IncrementalSkeleton_ptr inc_ptr, const double* pos);
+DLLEXPORT void graph_incremental_remove_node(IncrementalSkeleton_ptr inc_ptr, size_t n);
+DLLEXPORT void graph_incremental_connect_nodes(IncrementalSkeleton_ptr inc_ptr, size_t n0, size_t n1);
+DLLEXPORT void graph_incremental_disconnect_nodes(IncrementalSkeleton_ptr inc_ptr, size_t n0, size_t n1);
+DLLEXPORT size_t graph_incremental_update(IncrementalSkeleton_ptr inc_ptr);
+DLLEXPORT void graph_incremental_skeleton(IncrementalSkeleton_ptr inc_ptr, Graph_ptr skel_ptr, IntVector_ptr map_ptr);
+
+DLLEXPORT void graph_tiled_skeleton(Graph_ptr skel_ptr, const double* pts, size_t N, double rad, int N_closest,
+                                    double tile_size, double overlap, bool multiscale, int grow_thresh, int max_tiles);
+DLLEXPORT bool graph_tiled_skeleton_file(Graph_ptr skel_ptr, const char* file_name, double rad, int N_closest,
+                                         double tile_size, double overlap, bool multiscale, int grow_thresh, int max_tiles);
 
 DLLEXPORT void graph_front_skeleton(Graph_ptr g_ptr, Graph_ptr skel_ptr, IntVector_ptr map_ptr, int N_col, double* colors);
 
 DLLEXPORT void graph_color_detached_parts(Graph_ptr g_ptr);
+DLLEXPORT size_t graph_reattach_detached_parts(Graph_ptr g_ptr, double max_gap, double max_angle, unsigned candidates);
+DLLEXPORT size_t graph_rooted_tree(Graph_ptr g_ptr, size_t root, size_t* parent, int* depth, double* path_length,
+                                   size_t* subtree_size, int* strahler, int* segment);
+
+DLLEXPORT void graph_set_thread_count(int n);
+DLLEXPORT int graph_get_thread_count();
+
+DLLEXPORT void graph_set_skeletonization_logging(bool on);
+DLLEXPORT void graph_set_skeletonization_seed(uint64_t seed);
+DLLEXPORT int graph_skeletonization_stats(size_t* counts, double* times, double* busy_times, int max_threads);
+DLLEXPORT int graph_skeletonization_level_times(double* times, int max_levels);
 
 #ifdef __cplusplus
 }
@@ -206,7 +206,7 @@ void graph_to_feq(Graph_ptr _g_ptr, Manifold_ptr _m_ptr, double *node_radii, boo
 
     if (use_graph_radii)
         for(auto n : g_ptr->node_ids()) 
-             node_rs[n] = g_ptr->node_color[n][1];
+             node_rs[n] = g_ptr->node_radius[n];
     else 
         for(auto n : g_ptr->node_ids())
             node_rs[n] = node_radii[n];
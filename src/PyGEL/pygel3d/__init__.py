@@ -59,6 +59,8 @@ lib_py_gel.IntVector_get.argtypes = (ct.c_void_p, ct.c_size_t)
 lib_py_gel.IntVector_size.argtypes = (ct.c_void_p,)
 lib_py_gel.IntVector_size.restype = ct.c_size_t
 lib_py_gel.IntVector_delete.argtypes = (ct.c_void_p,)
+lib_py_gel.IntVector_data.argtypes = (ct.c_void_p,)
+lib_py_gel.IntVector_data.restype = ct.POINTER(ct.c_size_t)
 
 
 # Vec3dVector
@@ -68,6 +70,8 @@ lib_py_gel.Vec3dVector_get.restype = ct.POINTER(ct.c_double)
 lib_py_gel.Vec3dVector_size.argtypes = (ct.c_void_p,)
 lib_py_gel.Vec3dVector_size.restype = ct.c_size_t
 lib_py_gel.Vec3dVector_delete.argtypes = (ct.c_void_p,)
+lib_py_gel.Vec3dVector_data.argtypes = (ct.c_void_p,)
+lib_py_gel.Vec3dVector_data.restype = ct.POINTER(ct.c_double)
 
 # I3DTree
 lib_py_gel.I3DTree_new.restype = ct.c_void_p
@@ -76,6 +80,16 @@ lib_py_gel.I3DTree_insert.argtypes = (ct.c_void_p, ct.c_double, ct.c_double, ct.
 lib_py_gel.I3DTree_build.argtypes = (ct.c_void_p,)
 lib_py_gel.I3DTree_closest_point.argtypes = (ct.c_void_p, ct.c_double, ct.c_double, ct.c_double, ct.c_double, ct.POINTER(ct.c_double*3), ct.POINTER(ct.c_size_t))
 lib_py_gel.I3DTree_in_sphere.argtypes = (ct.c_void_p, ct.c_double, ct.c_double, ct.c_double, ct.c_double, ct.c_void_p,ct.c_void_p)
+lib_py_gel.I3DTree_in_sphere.restype = ct.c_size_t
+lib_py_gel.I3DTree_m_closest_points.argtypes = (ct.c_void_p, ct.c_double, ct.c_double, ct.c_double, ct.c_double, ct.c_int, ct.c_void_p,ct.c_void_p)
+lib_py_gel.I3DTree_m_closest_points.restype = ct.c_size_t
+lib_py_gel.I3DTree_insert_points.argtypes = (ct.c_void_p, ct.c_size_t, ct.POINTER(ct.c_double), ct.POINTER(ct.c_size_t))
+lib_py_gel.I3DTree_closest_point_batch.argtypes = (ct.c_void_p, ct.c_size_t, ct.POINTER(ct.c_double), ct.c_double, ct.POINTER(ct.c_size_t), ct.c_void_p, ct.c_void_p)
+lib_py_gel.I3DTree_closest_point_batch.restype = ct.c_size_t
+lib_py_gel.I3DTree_in_sphere_batch.argtypes = (ct.c_void_p, ct.c_size_t, ct.POINTER(ct.c_double), ct.c_double, ct.POINTER(ct.c_size_t), ct.c_void_p, ct.c_void_p)
+lib_py_gel.I3DTree_in_sphere_batch.restype = ct.c_size_t
+lib_py_gel.I3DTree_m_closest_points_batch.argtypes = (ct.c_void_p, ct.c_size_t, ct.POINTER(ct.c_double), ct.c_double, ct.c_int, ct.POINTER(ct.c_size_t), ct.c_void_p, ct.c_void_p)
+lib_py_gel.I3DTree_m_closest_points_batch.restype = ct.c_size_t
 
 # Manifold class
 lib_py_gel.Manifold_from_triangles.argtypes = (ct.c_size_t,ct.c_size_t, np.ctypeslib.ndpointer(ct.c_double), np.ctypeslib.ndpointer(ct.c_int))
@@ -237,6 +251,8 @@ lib_py_gel.Graph_neighbors.restype = ct.c_size_t
 lib_py_gel.Graph_neighbors.argtypes = (ct.c_void_p, ct.c_size_t, ct.c_void_p, ct.c_char)
 lib_py_gel.Graph_positions.argtypes = (ct.c_void_p,ct.POINTER(ct.POINTER(ct.c_double)))
 lib_py_gel.Graph_positions.restype = ct.c_size_t
+lib_py_gel.Graph_node_radius.argtypes = (ct.c_void_p,ct.POINTER(ct.POINTER(ct.c_double)))
+lib_py_gel.Graph_node_radius.restype = ct.c_size_t
 lib_py_gel.Graph_average_edge_length.argtypes = (ct.c_void_p,)
 lib_py_gel.Graph_average_edge_length.restype = ct.c_double
 lib_py_gel.Graph_add_node.argtypes = (ct.c_void_p, np.ctypeslib.ndpointer(ct.c_double))
@@ -247,6 +263,16 @@ lib_py_gel.Graph_connect_nodes.argtypes = (ct.c_void_p, ct.c_size_t, ct.c_size_t
 lib_py_gel.Graph_connect_nodes.restype = ct.c_size_t
 lib_py_gel.Graph_disconnect_nodes.argtypes = (ct.c_void_p, ct.c_size_t, ct.c_size_t)
 lib_py_gel.Graph_merge_nodes.argtypes = (ct.c_void_p, ct.c_size_t, ct.c_size_t, ct.c_bool)
+lib_py_gel.Graph_add_nodes.argtypes = (ct.c_void_p, ct.POINTER(ct.c_double), ct.c_size_t)
+lib_py_gel.Graph_add_nodes.restype = ct.c_size_t
+lib_py_gel.Graph_connect_node_pairs.argtypes = (ct.c_void_p, ct.POINTER(ct.c_size_t), ct.c_size_t)
+lib_py_gel.Graph_connect_node_pairs.restype = ct.c_size_t
+lib_py_gel.Graph_edge_count.argtypes = (ct.c_void_p,)
+lib_py_gel.Graph_edge_count.restype = ct.c_size_t
+lib_py_gel.Graph_edges.argtypes = (ct.c_void_p, ct.POINTER(ct.c_size_t), ct.c_size_t)
+lib_py_gel.Graph_edges.restype = ct.c_size_t
+lib_py_gel.Graph_adjacency.argtypes = (ct.c_void_p, ct.POINTER(ct.c_size_t), ct.POINTER(ct.c_size_t), ct.c_size_t)
+lib_py_gel.Graph_adjacency.restype = ct.c_size_t
 
 # Graph functions
 lib_py_gel.graph_from_mesh.argtypes = (ct.c_void_p, ct.c_void_p)
@@ -254,6 +280,9 @@ lib_py_gel.graph_load.argtypes = (ct.c_void_p, ct.c_char_p)
 lib_py_gel.graph_load.restype = ct.c_void_p
 lib_py_gel.graph_save.argtypes = (ct.c_void_p, ct.c_char_p)
 lib_py_gel.graph_save.restype = ct.c_bool
+lib_py_gel.graph_from_points_file.argtypes = (ct.c_void_p, ct.c_char_p, ct.c_double, ct.c_int)
+lib_py_gel.graph_from_points_file.restype = ct.c_bool
+lib_py_gel.graph_from_points.argtypes = (ct.c_void_p, ct.POINTER(ct.c_double), ct.c_size_t, ct.c_double, ct.c_int)
 lib_py_gel.graph_to_mesh_cyl.argtypes = (ct.c_void_p, ct.c_void_p, ct.c_float)
 lib_py_gel.graph_to_mesh_cyl.restype = ct.c_void_p
 lib_py_gel.graph_to_mesh_iso.argtypes = (ct.c_void_p, ct.c_void_p, ct.c_float, ct.c_int)
@@ -263,9 +292,44 @@ lib_py_gel.graph_edge_contract.argtypes = (ct.c_void_p, ct.c_double)
 lib_py_gel.graph_prune.argtypes = (ct.c_void_p,)
 lib_py_gel.graph_saturate.argtypes = (ct.c_void_p, ct.c_int, ct.c_double, ct.c_double)
 lib_py_gel.graph_LS_skeleton.argtypes = (ct.c_void_p, ct.c_void_p, ct.c_void_p, ct.c_bool)
-lib_py_gel.graph_MSLS_skeleton.argtypes = (ct.c_void_p, ct.c_void_p, ct.c_void_p, ct.c_int)
+lib_py_gel.graph_MSLS_skeleton.argtypes = (ct.c_void_p, ct.c_void_p, ct.c_void_p, ct.c_int, ct.c_void_p)
+lib_py_gel.graph_multiscale_new.argtypes = (ct.c_void_p, ct.c_int)
+lib_py_gel.graph_multiscale_new.restype = ct.c_void_p
+lib_py_gel.graph_multiscale_delete.argtypes = (ct.c_void_p,)
+lib_py_gel.graph_multiscale_save.argtypes = (ct.c_void_p, ct.c_char_p)
+lib_py_gel.graph_multiscale_save.restype = ct.c_bool
+lib_py_gel.graph_multiscale_load.argtypes = (ct.c_char_p,)
+lib_py_gel.graph_multiscale_load.restype = ct.c_void_p
+lib_py_gel.graph_multiscale_layer_sizes.argtypes = (ct.c_void_p, ct.POINTER(ct.c_size_t), ct.c_size_t)
+lib_py_gel.graph_multiscale_layer_sizes.restype = ct.c_size_t
 lib_py_gel.graph_front_skeleton.argtypes = (ct.c_void_p, ct.c_void_p, ct.c_void_p, ct.c_int, ct.POINTER(ct.c_double))
+lib_py_gel.graph_incremental_new.argtypes = (ct.c_void_p,)
+lib_py_gel.graph_incremental_new.restype = ct.c_void_p
+lib_py_gel.graph_incremental_delete.argtypes = (ct.c_void_p,)
+lib_py_gel.graph_incremental_add_node.argtypes = (ct.c_void_p, np.ctypeslib.ndpointer(ct.c_double))
+lib_py_gel.graph_incremental_add_node.restype = ct.c_size_t
+lib_py_gel.graph_incremental_remove_node.argtypes = (ct.c_void_p, ct.c_size_t)
+lib_py_gel.graph_incremental_connect_nodes.argtypes = (ct.c_void_p, ct.c_size_t, ct.c_size_t)
+lib_py_gel.graph_incremental_disconnect_nodes.argtypes = (ct.c_void_p, ct.c_size_t, ct.c_size_t)
+lib_py_gel.graph_incremental_update.argtypes = (ct.c_void_p,)
+lib_py_gel.graph_incremental_update.restype = ct.c_size_t
+lib_py_gel.graph_incremental_skeleton.argtypes = (ct.c_void_p, ct.c_void_p, ct.c_void_p)
+lib_py_gel.graph_tiled_skeleton.argtypes = (ct.c_void_p, ct.POINTER(ct.c_double), ct.c_size_t, ct.c_double, ct.c_int, ct.c_double, ct.c_double, ct.c_bool, ct.c_int, ct.c_int)
+lib_py_gel.graph_tiled_skeleton_file.argtypes = (ct.c_void_p, ct.c_char_p, ct.c_double, ct.c_int, ct.c_double, ct.c_double, ct.c_bool, ct.c_int, ct.c_int)
+lib_py_gel.graph_tiled_skeleton_file.restype = ct.c_bool
 lib_py_gel.graph_color_detached_parts.argtypes = (ct.c_void_p,)
+lib_py_gel.graph_reattach_detached_parts.argtypes = (ct.c_void_p, ct.c_double, ct.c_double, ct.c_uint)
+lib_py_gel.graph_reattach_detached_parts.restype = ct.c_size_t
+lib_py_gel.graph_rooted_tree.argtypes = (ct.c_void_p, ct.c_size_t, ct.POINTER(ct.c_size_t), ct.POINTER(ct.c_int), ct.POINTER(ct.c_double), ct.POINTER(ct.c_size_t), ct.POINTER(ct.c_int), ct.POINTER(ct.c_int))
+lib_py_gel.graph_rooted_tree.restype = ct.c_size_t
+lib_py_gel.graph_set_thread_count.argtypes = (ct.c_int,)
+lib_py_gel.graph_get_thread_count.restype = ct.c_int
+lib_py_gel.graph_set_skeletonization_logging.argtypes = (ct.c_bool,)
+lib_py_gel.graph_set_skeletonization_seed.argtypes = (ct.c_uint64,)
+lib_py_gel.graph_skeletonization_stats.argtypes = (ct.POINTER(ct.c_size_t), ct.POINTER(ct.c_double), ct.POINTER(ct.c_double), ct.c_int)
+lib_py_gel.graph_skeletonization_stats.restype = ct.c_int
+lib_py_gel.graph_skeletonization_level_times.argtypes = (ct.POINTER(ct.c_double), ct.c_int)
+lib_py_gel.graph_skeletonization_level_times.restype = ct.c_int
 
 
 class IntVector:
@@ -286,6 +350,12 @@ class IntVector:
         n = lib_py_gel.IntVector_size(self.obj)
         for i in range(0,n):
             yield lib_py_gel.IntVector_get(self.obj, i)
+    def array(self):
+        """ Returns a copy of the vector as a numpy array. """
+        n = len(self)
+        if n == 0:
+            return np.zeros(0, dtype=np.uint64)
+        return np.ctypeslib.as_array(lib_py_gel.IntVector_data(self.obj), shape=(n,)).copy()
 
 class Vec3dVector:
     """ Vector of 3D vectors.
@@ -306,3 +376,9 @@ class Vec3dVector:
         for i in range(0,n):
             data = lib_py_gel.Vec3dVector_get(self.obj, i)
             yield [data[0], data[1], data[2]]
+    def array(self):
+        """ Returns a copy of the vector as an (N,3) numpy array. """
+        n = len(self)
+        if n == 0:
+            return np.zeros((0,3))
+        return np.ctypeslib.as_array(lib_py_gel.Vec3dVector_data(self.obj), shape=(n,3)).copy()
@@ -40,6 +40,14 @@ class Graph:
         pos = ct.POINTER(ct.c_double)()
         n = lib_py_gel.Graph_positions(self.obj, ct.byref(pos))
         return np.ctypeslib.as_array(pos,(n,3))
+    def node_radius(self):
+        """ Get the node radii by reference. You can assign to the radii. Skeletonization
+        stores the estimated radius of the shape at each skeletal node here. """
+        rad = ct.POINTER(ct.c_double)()
+        n = lib_py_gel.Graph_node_radius(self.obj, ct.byref(rad))
+        if n == 0:
+            return np.zeros(0)
+        return np.ctypeslib.as_array(rad,(n,))
     def average_edge_length(self):
         """ Returns the average edge length. """
         ael = lib_py_gel.Graph_average_edge_length(self.obj)
@@ -67,8 +75,47 @@ class Graph:
     def merge_nodes(self, n0, n1, avg_pos):
         """ Merge nodes n0 and n1. avg_pos indicates if you want the position to be the average. """
         lib_py_gel.Graph_merge_nodes(self.obj, n0, n1, avg_pos)
+    def add_nodes(self, pts):
+        """ Adds a node for each row of the (N,3) array pts in a single call and returns
+        the array of indices of the new nodes. """
+        pts_flat = np.ascontiguousarray(pts, dtype=np.float64).reshape(-1,3)
+        first = lib_py_gel.Graph_add_nodes(self.obj, pts_flat.ctypes.data_as(ct.POINTER(ct.c_double)), pts_flat.shape[0])
+        return np.arange(first, first + pts_flat.shape[0])
+    def connect_node_pairs(self, pairs):
+        """ Connects the nodes of each row of the (M,2) integer array pairs in a single call.
+        Pairs that are already connected or refer to invalid nodes are skipped. The set returned
+        by scipy's KDTree.query_pairs can be passed as np.array(list(pairs)) or directly via
+        query_pairs(r, output_type='ndarray'). Returns the number of edges created. """
+        pairs_flat = np.ascontiguousarray(pairs, dtype=np.uint64).reshape(-1,2)
+        return lib_py_gel.Graph_connect_node_pairs(self.obj, pairs_flat.ctypes.data_as(ct.POINTER(ct.c_size_t)), pairs_flat.shape[0])
+    def edges(self):
+        """ Returns an (M,2) array with a row for each edge. The rows contain the two nodes
+        connected by the edge, smallest first, and are sorted. """
+        M = lib_py_gel.Graph_edge_count(self.obj)
+        pairs = np.zeros((M,2), dtype=np.uint64)
+        lib_py_gel.Graph_edges(self.obj, pairs.ctypes.data_as(ct.POINTER(ct.c_size_t)), M)
+        return pairs
+    def adjacency(self):
+        """ Returns the adjacency in compressed sparse row form as a pair of arrays (offsets, nbrs).
+        The neighbors of node n are nbrs[offsets[n]:offsets[n+1]] in increasing order. This is
+        much faster than calling neighbors for each node. """
+        M = lib_py_gel.Graph_edge_count(self.obj)
+        offsets = np.zeros(len(self.positions())+1, dtype=np.uint64)
+        nbrs = np.zeros(2*M, dtype=np.uint64)
+        lib_py_gel.Graph_adjacency(self.obj, offsets.ctypes.data_as(ct.POINTER(ct.c_size_t)), nbrs.ctypes.data_as(ct.POINTER(ct.c_size_t)), 2*M)
+        return offsets, nbrs
 
 
+def from_arrays(pts, pairs=None):
+    """ Creates a graph from an (N,3) array of node positions and, optionally, an (M,2)
+    array of pairs of node indices that are to be connected. Both are passed to the
+    library in a single call each. """
+    g = Graph()
+    g.add_nodes(pts)
+    if pairs is not None:
+        g.connect_node_pairs(pairs)
+    return g
+
 def from_mesh(m):
     """ Creates a graph from a mesh. The argument, m, is the input mesh,
     and the function returns a graph with the same vertices and edges
@@ -77,9 +124,27 @@ def from_mesh(m):
     lib_py_gel.graph_from_mesh(m.obj, g.obj)
     return g
 
+def from_points(pts, rad, N_closest):
+    """ Create a graph from a point cloud. The first argument, pts, is either an array
+    of points with three coordinates per row or the name of a .xyz, .off, or .ply file
+    containing the points. Each point is connected to at most N_closest of its nearest
+    neighbors within distance rad. The neighbor queries run in parallel, and files are
+    read in chunks, so this is practical for large scans. The function returns the
+    graph - or None if no points were loaded from a file. """
+    g = Graph()
+    if isinstance(pts, str):
+        s = ct.c_char_p(pts.encode('utf-8'))
+        if lib_py_gel.graph_from_points_file(g.obj, s, rad, N_closest):
+            return g
+        return None
+    pts_flat = np.ascontiguousarray(pts, dtype=np.float64).reshape(-1,3)
+    lib_py_gel.graph_from_points(g.obj, pts_flat.ctypes.data_as(ct.POINTER(ct.c_double)), pts_flat.shape[0], rad, N_closest)
+    return g
+
 def load(fn):
     """ Load a graph from a file. The argument, fn, is the filename which
-    is in a special format similar to Wavefront obj. The loaded graph is
+    is in a special format similar to Wavefront obj or in the binary graph format
+    which is detected automatically. The loaded graph is
     returned by the function - or None if loading failed. """
     s = ct.c_char_p(fn.encode('utf-8'))
     g = Graph()
@@ -89,7 +154,8 @@ def load(fn):
 
 def save(fn, g):
     """ Save graph to a file. The first argument, fn, is the file name,
-    and g is the graph. This function returns True if saving happened and
+    and g is the graph. If fn ends with ".bgraph" the graph is saved in the binary
+    format which is much faster to load. This function returns True if saving happened and
     False otherwise. """
     s = ct.c_char_p(fn.encode('utf-8'))
     return lib_py_gel.graph_save(g.obj, s)
@@ -167,28 +233,128 @@ def LS_skeleton_and_map(g, sampling=True):
     lib_py_gel.graph_LS_skeleton(g.obj, skel.obj, mapping.obj, sampling)
     return skel, mapping
 
-def MSLS_skeleton(g, grow_thresh=64):
+class MultiScaleGraph:
+    """ A hierarchy of successively coarser versions of a graph which is used by the
+        multi-scale local separator skeletonization. Building it once and passing it to
+        MSLS_skeleton saves time when the same graph is skeletonized many times, e.g. with
+        different parameters. The hierarchy can also be saved to and loaded from a file.
+        Without a graph the object is empty, and the methods raise a ValueError until it
+        has been filled by load_multiscale. """
+    def __init__(self, g=None, grow_thresh=64):
+        if g == None:
+            self.obj = None
+        else:
+            self.obj = lib_py_gel.graph_multiscale_new(g.obj, grow_thresh)
+    def __del__(self):
+        if self.obj:
+            lib_py_gel.graph_multiscale_delete(self.obj)
+    def _checked_obj(self):
+        if not self.obj:
+            raise ValueError("The multi-scale graph is empty")
+        return self.obj
+    def layer_sizes(self):
+        """ Returns a list with the number of nodes in each layer. Layer 0 is the original graph. """
+        max_layers = 256
+        sizes = (ct.c_size_t * max_layers)()
+        L = lib_py_gel.graph_multiscale_layer_sizes(self._checked_obj(), sizes, max_layers)
+        return list(sizes[:min(L, max_layers)])
+    def save(self, fn):
+        """ Save the multi-scale graph to the file fn. Returns True on success. """
+        return lib_py_gel.graph_multiscale_save(self._checked_obj(), ct.c_char_p(fn.encode('utf-8')))
+
+def load_multiscale(fn):
+    """ Load a multi-scale graph saved with MultiScaleGraph.save. Returns None if the
+        file could not be read. """
+    msg = MultiScaleGraph()
+    msg.obj = lib_py_gel.graph_multiscale_load(ct.c_char_p(fn.encode('utf-8')))
+    if not msg.obj:
+        return None
+    return msg
+
+def MSLS_skeleton(g, grow_thresh=64, msg=None):
     """ Skeletonize a graph using the multi-scale local separators approach. The first argument,
         g, is the graph, and, sampling indicates whether we try to use all vertices
         (False) as starting points for finding separators or just a sampling (True).
+        msg is an optional MultiScaleGraph built from g which is used instead of building
+        a new one.
         The function returns a new graph which is the skeleton of the input graph. """
     skel = Graph()
     mapping = IntVector()
-    lib_py_gel.graph_MSLS_skeleton(g.obj, skel.obj, mapping.obj, grow_thresh)
+    lib_py_gel.graph_MSLS_skeleton(g.obj, skel.obj, mapping.obj, grow_thresh, msg._checked_obj() if msg else None)
     return skel
     
-def MSLS_skeleton_and_map(g, grow_thresh=64):
+def MSLS_skeleton_and_map(g, grow_thresh=64, msg=None):
     """ Skeletonize a graph using the multi-scale local separators approach. The first argument,
         g, is the graph, and, sampling indicates whether we try to use all vertices
         (False) as starting points for finding separators or just a sampling (True).
+        msg is an optional MultiScaleGraph built from g which is used instead of building
+        a new one.
         The function returns a tuple containing a new graph which is the skeleton of
         the input graph and a map from the graph nodes to the skeletal nodes. """
     skel = Graph()
     mapping = IntVector()
-    lib_py_gel.graph_MSLS_skeleton(g.obj, skel.obj, mapping.obj, grow_thresh)
+    lib_py_gel.graph_MSLS_skeleton(g.obj, skel.obj, mapping.obj, grow_thresh, msg._checked_obj() if msg else None)
     return skel, mapping
 
 
+class IncrementalSkeleton:
+    """ Local separator skeletonization of a graph which can be updated cheaply after small
+        edits. The separators of g are computed as by LS_skeleton without sampling. The graph
+        is not copied: edit it only with add_node, remove_node, connect_nodes and
+        disconnect_nodes, and call update to regrow only the separators whose search read
+        the edited nodes. Edits of node indices that are out of range or refer to removed
+        nodes are ignored. """
+    def __init__(self, g):
+        self.g = g
+        self.obj = lib_py_gel.graph_incremental_new(g.obj)
+    def __del__(self):
+        if self.obj:
+            lib_py_gel.graph_incremental_delete(self.obj)
+    def add_node(self, p):
+        """ Add a node at position p and return its index. """
+        return lib_py_gel.graph_incremental_add_node(self.obj, np.array(p, dtype=np.float64))
+    def remove_node(self, n):
+        lib_py_gel.graph_incremental_remove_node(self.obj, n)
+    def connect_nodes(self, n0, n1):
+        lib_py_gel.graph_incremental_connect_nodes(self.obj, n0, n1)
+    def disconnect_nodes(self, n0, n1):
+        lib_py_gel.graph_incremental_disconnect_nodes(self.obj, n0, n1)
+    def update(self):
+        """ Regrow the separators affected by the edits since the last update and repack them.
+            Returns the number of separators regrown. """
+        return lib_py_gel.graph_incremental_update(self.obj)
+    def graph(self):
+        """ Returns the graph in its current state. This is the graph passed to the constructor. """
+        return self.g
+    def skeleton_and_map(self):
+        """ Returns the skeleton of the current graph and a map from graph nodes to skeletal nodes.
+            This takes time proportional to the size of the graph. """
+        skel = Graph()
+        mapping = IntVector()
+        lib_py_gel.graph_incremental_skeleton(self.obj, skel.obj, mapping.obj)
+        return skel, mapping
+
+def tiled_skeleton(pts, rad, N_closest, tile_size, overlap, multiscale=True, grow_thresh=64, max_tiles=0):
+    """ Skeletonize a point cloud that is too big to be turned into one graph. pts is either
+        an array of points or the name of a point file as for from_points, and rad and N_closest
+        are also used as in from_points. The xy plane is divided into square tiles of side
+        tile_size, and each tile is turned into a graph together with the points within overlap
+        of it. The graph is skeletonized with MSLS_skeleton (multiscale=True) or LS_skeleton,
+        and the tile skeletons are stitched together. At most max_tiles tiles are processed
+        at once, and 0 means one per thread. overlap must be positive since the tiles are
+        stitched within this distance. The function returns the skeleton - or None if no points
+        were loaded from a file. The skeleton is empty if tile_size or overlap is not positive
+        or if there would be more tiles than points. """
+    skel = Graph()
+    if isinstance(pts, str):
+        s = ct.c_char_p(pts.encode('utf-8'))
+        if lib_py_gel.graph_tiled_skeleton_file(skel.obj, s, rad, N_closest, tile_size, overlap, multiscale, grow_thresh, max_tiles):
+            return skel
+        return None
+    pts_flat = np.ascontiguousarray(pts, dtype=np.float64).reshape(-1,3)
+    lib_py_gel.graph_tiled_skeleton(skel.obj, pts_flat.ctypes.data_as(ct.POINTER(ct.c_double)), pts_flat.shape[0], rad, N_closest, tile_size, overlap, multiscale, grow_thresh, max_tiles)
+    return skel
+
 def front_skeleton_and_map(g, colors):
     """ Skeletonize a graph using the front separators approach. The first argument,
         g, is the graph, and, colors is a 2D array where each row contains a sequence
@@ -206,4 +372,97 @@ def front_skeleton_and_map(g, colors):
     return skel, mapping
 
 def color_detached_parts(g):
-    lib_py_gel.graph_color_detached_parts(g.obj)
\ No newline at end of file
+    """ Color the nodes of the tree skeleton g black if they are connected to the root
+        and red if they are not. The root is the node rooted_tree would choose. The function
+        returns g such that it can be passed directly to a viewer. """
+    lib_py_gel.graph_color_detached_parts(g.obj)
+    return g
+
+def reattach_detached_parts(g, max_gap=float('inf'), max_angle=180.0, candidates=8):
+    """ Connect the parts of the tree skeleton g that color_detached_parts would color red
+        to the rest of the tree. Each part is attached by a single new edge, the shortest edge
+        from one of its nodes to a nearby node of the tree. max_gap is the longest edge that may
+        be added, and max_angle (in degrees) is the largest angle between the new edge and the
+        direction of the tree at the node it attaches to. candidates is the number of nearest
+        tree nodes considered for each node of a part. Parts that cannot be attached are left
+        as they are. The function returns the number of parts that were attached. """
+    return lib_py_gel.graph_reattach_detached_parts(g.obj, max_gap, max_angle, max(int(candidates), 1))
+
+def rooted_tree(g, root=None):
+    """ Analyse the skeleton g as a tree. If root is None, the root is the lowest node which
+        has an edge going upwards within 45 degrees of the z axis. The function returns a
+        dictionary with the root and, for each node, its parent (-1 for the root and for nodes
+        not connected to the root), depth in edges (-1 if not connected), path length to the
+        root, subtree size, Strahler order, and branch segment (-1 if not connected). A branch
+        segment is a chain of nodes between branch points. All per node values are NumPy arrays. """
+    N = len(g.nodes())
+    parent = np.zeros(N, dtype=np.uint64)
+    depth = np.zeros(N, dtype=np.int32)
+    path_length = np.zeros(N, dtype=np.float64)
+    subtree_size = np.zeros(N, dtype=np.uint64)
+    strahler = np.zeros(N, dtype=np.int32)
+    segment = np.zeros(N, dtype=np.int32)
+    r = lib_py_gel.graph_rooted_tree(g.obj, ct.c_size_t(-1).value if root is None else root,
+                                     parent.ctypes.data_as(ct.POINTER(ct.c_size_t)),
+                                     depth.ctypes.data_as(ct.POINTER(ct.c_int)),
+                                     path_length.ctypes.data_as(ct.POINTER(ct.c_double)),
+                                     subtree_size.ctypes.data_as(ct.POINTER(ct.c_size_t)),
+                                     strahler.ctypes.data_as(ct.POINTER(ct.c_int)),
+                                     segment.ctypes.data_as(ct.POINTER(ct.c_int)))
+    return {
+        "root": None if r == ct.c_size_t(-1).value else r,
+        "parent": parent.view(np.int64),
+        "depth": depth,
+        "path_length": path_length,
+        "subtree_size": subtree_size,
+        "strahler": strahler,
+        "segment": segment,
+    }
+
+def set_thread_count(n=0):
+    """ Set the number of threads used by the skeletonization functions. The default, n=0,
+        means that all hardware threads are used. """
+    lib_py_gel.graph_set_thread_count(n)
+
+def get_thread_count():
+    """ Returns the number of threads used by the skeletonization functions. """
+    return lib_py_gel.graph_get_thread_count()
+
+def set_skeletonization_logging(on=True):
+    """ Turn printing of progress and statistics from the skeletonization functions on or off.
+        It is off by default. """
+    lib_py_gel.graph_set_skeletonization_logging(on)
+
+def set_skeletonization_seed(seed=1):
+    """ Set the seed used when the skeletonization functions sample the nodes that separators
+        are grown from. The same graph and seed give the same skeleton regardless of the
+        number of threads. """
+    lib_py_gel.graph_set_skeletonization_seed(seed)
+
+def skeletonization_stats():
+    """ Returns a dictionary with the statistics of the most recent call of LS_skeleton or
+        MSLS_skeleton (or their _and_map variants): the number of separators computed, found,
+        and packed, the wall clock time in seconds of each phase, the time spent expanding
+        separators from each level of the multi-scale graph (coarsest first), the time each
+        thread was busy, and the peak memory use of the process in bytes. """
+    counts = (ct.c_size_t * 4)()
+    times = (ct.c_double * 6)()
+    max_threads = 1024
+    busy = (ct.c_double * max_threads)()
+    T = lib_py_gel.graph_skeletonization_stats(counts, times, busy, max_threads)
+    max_levels = 256
+    level_times = (ct.c_double * max_levels)()
+    L = lib_py_gel.graph_skeletonization_level_times(level_times, max_levels)
+    return {
+        "separators_computed": counts[0],
+        "separators_found": counts[1],
+        "separators_packed": counts[2],
+        "peak_memory": counts[3],
+        "time_sampling": times[0],
+        "time_multiscale": times[1],
+        "time_searching": times[2],
+        "time_filtering": times[3],
+        "time_packing": times[4],
+        "time_expanding": times[5],
+        "time_expanding_per_level": list(level_times[:min(L, max_levels)]),
+        "thread_busy_time": list(busy[:min(T, max_threads)]) }
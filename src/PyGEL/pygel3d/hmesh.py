@@ -566,10 +566,9 @@ def triangulate(m, clip_ear=True):
 def skeleton_to_feq(g, node_radii = None, symmetrize=True):
     """ Turn a skeleton graph g into a Face Extrusion Quad Mesh m with given node_radii for each graph node.
     If symmetrize is True (default) the graph is made symmetrical. If node_radii are supplied then they
-    are used in the reconstruction. Otherwise, the radii are obtained from the skeleton. They are stored in 
-    the green channel of the vertex color during skeletonization, so for a skeletonized shape that is how the
-    radius of each node is obtained. This is a questionable design decision and will probably change 
-    in the future. """
+    are used in the reconstruction. Otherwise, the radii are obtained from the skeleton. Skeletonization
+    stores the estimated radius of each node as its node radius (see Graph.node_radius), and that is
+    the radius used. """
     m = Manifold()
     r = 0.25 * g.average_edge_length()
     if node_radii is None:
@@ -2,6 +2,7 @@
 
 from pygel3d import lib_py_gel, Vec3dVector, IntVector
 import ctypes as ct
+import numpy as np
 
 class I3DTree:
     """ kD tree specialized for 3D keys and integer values.
@@ -17,6 +18,14 @@ class I3DTree:
         """ Insert v at 3D point given by p. Insert should be called before
         calling build. """
         lib_py_gel.I3DTree_insert(self.obj, p[0],p[1],p[2],v)
+    def insert_points(self, pts, vals=None):
+        """ Insert the points in the (N,3) array pts. The values are given by the array vals
+        or, if vals is None, by the row indices of the points. """
+        pts_flat = np.ascontiguousarray(pts, dtype=np.float64).reshape(-1,3)
+        if vals is None:
+            vals = np.arange(pts_flat.shape[0])
+        vals_flat = np.ascontiguousarray(vals, dtype=np.uint64).reshape(-1)
+        lib_py_gel.I3DTree_insert_points(self.obj, pts_flat.shape[0], pts_flat.ctypes.data_as(ct.POINTER(ct.c_double)), vals_flat.ctypes.data_as(ct.POINTER(ct.c_size_t)))
     def build(self):
         """ Build the tree. This function call makes the tree searchable. It is
         assumed that all calls to insert come before calling this function."""
@@ -37,3 +46,35 @@ class I3DTree:
         vals = IntVector()
         n = lib_py_gel.I3DTree_in_sphere(self.obj, p[0],p[1],p[2],r,keys.obj,vals.obj)
         return (keys,vals)
+    def m_closest_points(self, p, r, m):
+        """ Retrieve the m points closest to p within a radius r, ordered by distance.
+        This function should only be called after build. """
+        keys = Vec3dVector()
+        vals = IntVector()
+        n = lib_py_gel.I3DTree_m_closest_points(self.obj, p[0],p[1],p[2],r,m,keys.obj,vals.obj)
+        return (keys,vals)
+    def _batch(self, query, pts, *args):
+        pts_flat = np.ascontiguousarray(pts, dtype=np.float64).reshape(-1,3)
+        offsets = np.zeros(pts_flat.shape[0]+1, dtype=np.uint64)
+        keys = Vec3dVector()
+        vals = IntVector()
+        query(self.obj, pts_flat.shape[0], pts_flat.ctypes.data_as(ct.POINTER(ct.c_double)), *args,
+              offsets.ctypes.data_as(ct.POINTER(ct.c_size_t)), keys.obj, vals.obj)
+        return (offsets, keys.array(), vals.array())
+    def closest_point_array(self, pts, r):
+        """ Search for the point closest to each row of the (N,3) array pts within a max radius r.
+        The queries run in parallel. Returns a tuple (offsets, keys, vals) where the result for
+        row i, if any, is found in keys and vals from offsets[i] up to offsets[i+1].
+        This function should only be called after build. """
+        return self._batch(lib_py_gel.I3DTree_closest_point_batch, pts, r)
+    def in_sphere_array(self, pts, r):
+        """ Retrieve all points within a radius r of each row of the (N,3) array pts. The queries
+        run in parallel, and the result is returned as for closest_point_array.
+        This function should only be called after build. """
+        return self._batch(lib_py_gel.I3DTree_in_sphere_batch, pts, r)
+    def m_closest_points_array(self, pts, r, m):
+        """ Retrieve the m points closest to each row of the (N,3) array pts within a radius r.
+        The queries run in parallel, and the result is returned as for closest_point_array with
+        the points of each row ordered by distance.
+        This function should only be called after build. """
+        return self._batch(lib_py_gel.I3DTree_m_closest_points_batch, pts, r, m)
@@ -0,0 +1,133 @@
+/**
+ Test program for the BVH. The signed distances and ray intersections computed with a BVH are compared to those
+ computed with an AABBTree built from the same mesh. Both the single point and the batch queries are tested.
+
+ Usage: bvh_test mesh_file
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <GEL/CGLA/CGLA.h>
+#include <GEL/HMesh/HMesh.h>
+#include <GEL/Geometry/build_bbtree.h>
+
+using namespace Geometry;
+using namespace HMesh;
+using namespace CGLA;
+using namespace std;
+
+namespace {
+    float rand_unit() {
+        return gel_rand() / float(GEL_RAND_MAX);
+    }
+
+    bool check(const char* what, size_t failures, size_t total) {
+        if(failures == 0)
+            return true;
+        cout << what << ": " << failures << " of " << total << " queries differ" << endl;
+        return false;
+    }
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        cout << "Usage: bvh_test mesh_file" << endl;
+        return 1;
+    }
+    Manifold m;
+    if(!load(argv[1], m)) {
+        cout << "Could not load " << argv[1] << endl;
+        return 1;
+    }
+    triangulate(m);
+
+    AABBTree tree;
+    build_AABBTree(m, tree);
+    BVH bvh;
+    build_BVH(m, bvh);
+
+    // Query points are drawn from a box somewhat larger than the bounding box of the mesh, and the
+    // ray directions are not normalized, since that is how the inside test of PyGEL uses them.
+    Manifold::Vec pmin, pmax;
+    bbox(m, pmin, pmax);
+    const Vec3f lo(pmin - 0.2 * (pmax - pmin));
+    const Vec3f diag(1.4 * (pmax - pmin));
+    const float tol = 1e-4f * length(diag);
+    gel_srand(0);
+    const size_t N = 2000;
+    vector<Vec3f> pts(N), dirs(N);
+    for(size_t i = 0; i < N; ++i) {
+        pts[i] = lo + Vec3f(rand_unit(), rand_unit(), rand_unit()) * diag;
+        dirs[i] = Vec3f(rand_unit(), rand_unit(), rand_unit()) - Vec3f(0.5f);
+    }
+
+    bool ok = true;
+
+    size_t failures = 0;
+    auto batch_dist = bvh.compute_signed_distance(pts);
+    for(size_t i = 0; i < N; ++i) {
+        const float d = tree.compute_signed_distance(pts[i]);
+        if(abs(d - bvh.compute_signed_distance(pts[i])) > tol || abs(d - batch_dist[i]) > tol)
+            ++failures;
+    }
+    ok &= check("compute_signed_distance", failures, N);
+
+    // With an upper bound, points that are farther away get the bound itself. The bound of the AABBTree is a
+    // squared distance which it cannot handle if no triangle is within it, so we compare to the unbounded distance.
+    failures = 0;
+    const float upper = 0.05f * length(diag);
+    batch_dist = bvh.compute_signed_distance(pts, upper);
+    for(size_t i = 0; i < N; ++i) {
+        const float d = tree.compute_signed_distance(pts[i]);
+        if(abs(d) < upper - tol ? abs(d - batch_dist[i]) > tol : abs(upper - batch_dist[i]) > tol)
+            ++failures;
+    }
+    ok &= check("compute_signed_distance with upper bound", failures, N);
+
+    // The AABBTree also reports intersections behind the origin while the BVH only reports those in front. Rays
+    // for which the closest intersection found by the tree is behind the origin are therefore not compared.
+    failures = 0;
+    vector<Ray> rays;
+    for(size_t i = 0; i < N; ++i) {
+        float t_tree = 0, t_bvh = 0;
+        const bool hit_tree = tree.intersect(pts[i], dirs[i], t_tree);
+        const bool hit_bvh = bvh.intersect(pts[i], dirs[i], t_bvh);
+        if(hit_tree && t_tree <= 0)
+            continue;
+        if(hit_tree != hit_bvh || (hit_tree && abs(t_tree - t_bvh) > tol))
+            ++failures;
+        rays.push_back(Ray(pts[i], normalize(dirs[i])));
+    }
+    ok &= check("intersect", failures, N);
+
+    failures = 0;
+    vector<Ray> batch_rays = rays;
+    bvh.intersect(batch_rays);
+    for(size_t i = 0; i < rays.size(); ++i) {
+        Ray r_tree = rays[i], r_bvh = rays[i];
+        tree.intersect(r_tree);
+        bvh.intersect(r_bvh);
+        if(r_tree.has_hit && r_tree.dist <= 0)
+            continue;
+        if(r_tree.has_hit != r_bvh.has_hit || r_tree.has_hit != batch_rays[i].has_hit ||
+           (r_tree.has_hit && (abs(r_tree.dist - r_bvh.dist) > tol || abs(r_tree.dist - batch_rays[i].dist) > tol)))
+            ++failures;
+    }
+    ok &= check("intersect with rays", failures, rays.size());
+
+    failures = 0;
+    const auto batch_cnt = bvh.intersect_cnt(pts, dirs);
+    for(size_t i = 0; i < N; ++i) {
+        const int cnt = tree.intersect_cnt(pts[i], dirs[i]);
+        if(cnt != bvh.intersect_cnt(pts[i], dirs[i]) || cnt != batch_cnt[i])
+            ++failures;
+    }
+    ok &= check("intersect_cnt", failures, N);
+
+    if(!ok)
+        return 1;
+    cout << "Test passed" << endl;
+    return 0;
+}
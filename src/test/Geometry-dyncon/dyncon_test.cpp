@@ -0,0 +1,120 @@
+/**
+ Test program for DynCon. Vertices are removed from random graphs in the way local separators are grown, and
+ the sizes of the connected components that DynCon reports through front_size_ratio are compared to those
+ found by a breadth first search.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <set>
+#include <vector>
+#include <GEL/Geometry/DynCon.h>
+
+using namespace Geometry;
+using namespace std;
+
+namespace {
+    using Adjacency = vector<vector<size_t>>;
+
+    /// Ratio of the smallest to the largest component of the vertices that are not removed.
+    double bfs_front_size_ratio(const Adjacency& adj, const vector<bool>& removed) {
+        multiset<size_t> sizes;
+        vector<bool> visited(adj.size(), false);
+        for(size_t s = 0; s < adj.size(); ++s)
+            if(!removed[s] && !visited[s]) {
+                size_t size = 0;
+                queue<size_t> Q;
+                Q.push(s);
+                visited[s] = true;
+                while(!Q.empty()) {
+                    size_t v = Q.front();
+                    Q.pop();
+                    ++size;
+                    for(auto w: adj[v])
+                        if(!removed[w] && !visited[w]) {
+                            visited[w] = true;
+                            Q.push(w);
+                        }
+                }
+                sizes.insert(size);
+            }
+        if(sizes.size() < 2)
+            return 0.0;
+        return double(*sizes.begin()) / *sizes.rbegin();
+    }
+
+    /** Insert the edges of adj in order and then remove the vertices in the given order. Returns the number of
+     removals after which DynCon disagrees with the breadth first search. */
+    int check(const Adjacency& adj, const vector<pair<size_t,size_t>>& edges, const vector<size_t>& removal_order) {
+        DynCon<size_t, Treap> con;
+        for(size_t v = 0; v < adj.size(); ++v)
+            con.insert(v);
+        for(auto [v, w]: edges)
+            con.insert(v, w);
+
+        vector<bool> removed(adj.size(), false);
+        int failures = 0;
+        for(auto v: removal_order) {
+            vector<size_t> nbrs;
+            for(auto w: adj[v])
+                if(!removed[w])
+                    nbrs.push_back(w);
+            con.remove(v, nbrs);
+            removed[v] = true;
+            if(con.front_size_ratio() != bfs_front_size_ratio(adj, removed))
+                ++failures;
+        }
+        return failures;
+    }
+
+    Adjacency make_adjacency(size_t N, const vector<pair<size_t,size_t>>& edges) {
+        Adjacency adj(N);
+        for(auto [v, w]: edges) {
+            adj[v].push_back(w);
+            adj[w].push_back(v);
+        }
+        return adj;
+    }
+}
+
+int main()
+{
+    cout << "Test 1: Removing a vertex whose neighbors are only connected through a later neighbor" << endl;
+    {
+        // The tree edges are those from 0. When 0 is removed, 1 can only be reconnected to 2 through 3.
+        vector<pair<size_t,size_t>> edges = {{0,1}, {0,2}, {0,3}, {0,4}, {1,3}, {2,3}, {4,5}};
+        if(check(make_adjacency(6, edges), edges, {0}) != 0) {
+            cout << "Test failed" << endl;
+            exit(1);
+        }
+    }
+
+    cout << "Test 2: Removing the vertices of random graphs" << endl;
+    mt19937 rng(0);
+    for(int t = 0; t < 500; ++t) {
+        const size_t N = 5 + rng() % 40;
+        const size_t M = N + rng() % (2*N);
+        vector<pair<size_t,size_t>> edges;
+        set<pair<size_t,size_t>> edge_set;
+        for(size_t i = 0; i < M; ++i) {
+            size_t v = rng() % N, w = rng() % N;
+            if(v != w && edge_set.insert(minmax(v, w)).second)
+                edges.push_back({v, w});
+        }
+        vector<size_t> order(N);
+        for(size_t v = 0; v < N; ++v)
+            order[v] = v;
+        shuffle(order.begin(), order.end(), rng);
+        order.resize(N/2);
+        if(check(make_adjacency(N, edges), edges, order) != 0) {
+            cout << "Test failed for random graph " << t << endl;
+            exit(1);
+        }
+    }
+
+    cout << "Test passed" << endl;
+    return 0;
+}
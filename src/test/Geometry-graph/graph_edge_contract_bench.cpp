@@ -0,0 +1,111 @@
+/**
+ Benchmark of graph_edge_contract. The function is compared to the previous implementation which
+ rebuilt a priority queue of all edges in every pass and merged each node at most once per pass.
+
+ Usage: graph_edge_contract_bench [graph files ...]
+ Without arguments the graphs in data/Graphs are used. Each graph is optionally saturated, and
+ edges are contracted with thresholds given as fractions of the average edge length.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <vector>
+#include <GEL/Geometry/Graph.h>
+#include <GEL/Geometry/graph_io.h>
+#include <GEL/Geometry/graph_util.h>
+
+using namespace Geometry;
+using namespace CGLA;
+using namespace std;
+
+namespace {
+    /// The multi-pass algorithm that graph_edge_contract used to implement.
+    int graph_edge_contract_multipass(AMGraph3D& g, double dist_thresh) {
+        using NodeID = AMGraph::NodeID;
+        auto priority = [&](NodeID a, NodeID b) { return -g.sqr_dist(a,b); };
+        priority_queue<SkeletonPQElem> Q;
+
+        int cntr, total_work = 0;
+        do {
+            Util::AttribVec<AMGraph::NodeID, int> touched(g.no_nodes(),0);
+            cntr = 0;
+            for(auto n0 : g.node_ids())
+                for(auto n1: g.neighbors(n0)) {
+                    double pri = priority(n0,n1);
+                    if(pri>-sqr(dist_thresh))
+                        Q.push(SkeletonPQElem(pri, n0, n1));
+                }
+
+            while(!Q.empty()) {
+                auto skel_rec = Q.top();
+                Q.pop();
+                if(touched[skel_rec.n0]==0 && touched[skel_rec.n1]==0) {
+                    auto e = g.find_edge(skel_rec.n0, skel_rec.n1);
+                    if( e != AMGraph::InvalidEdgeID) {
+                        g.merge_nodes(skel_rec.n0,skel_rec.n1, true);
+                        touched[skel_rec.n0] = 1;
+                        touched[skel_rec.n1] = 1;
+                        ++cntr;
+                    }
+                }
+            }
+            total_work += cntr;
+        } while(cntr);
+
+        g.cleanup();
+        return total_work;
+    }
+
+    double average_edge_length(const AMGraph3D& g) {
+        double sum = 0;
+        size_t cnt = 0;
+        for(auto n: g.node_ids())
+            for(auto m: g.neighbors(n))
+                if(size_t(n) < m) {
+                    sum += sqrt(g.sqr_dist(n, m));
+                    ++cnt;
+                }
+        return cnt > 0 ? sum / cnt : 0.0;
+    }
+
+    template<typename Func>
+    double time_contraction(Func&& f, AMGraph3D& g, double thresh, int& merges) {
+        auto t0 = chrono::high_resolution_clock::now();
+        merges = f(g, thresh);
+        auto t1 = chrono::high_resolution_clock::now();
+        return chrono::duration<double>(t1 - t0).count();
+    }
+}
+
+int main(int argc, char** argv) {
+    vector<string> files;
+    for(int i = 1; i < argc; ++i)
+        files.push_back(argv[i]);
+    if(files.empty())
+        for(auto name: {"armadillo_symmetric", "bunny", "feline", "fertility", "hand", "warrior", "wolf"})
+            files.push_back(string("data/Graphs/") + name + ".graph");
+
+    for(const auto& fn: files) {
+        AMGraph3D g0 = graph_load(fn);
+        if(g0.no_nodes() == 0) {
+            cout << "Could not load " << fn << endl;
+            continue;
+        }
+        // The bundled graphs are sparse skeletons, saturating them gives something closer to a scan graph.
+        if(g0.no_nodes() < 10000)
+            saturate_graph(g0, 3);
+        const double ael = average_edge_length(g0);
+        for(double frac: {0.5, 1.0, 2.0}) {
+            AMGraph3D g_old = g0, g_new = g0;
+            int merges_old, merges_new;
+            double t_old = time_contraction(graph_edge_contract_multipass, g_old, frac * ael, merges_old);
+            double t_new = time_contraction(graph_edge_contract, g_new, frac * ael, merges_new);
+            cout << fn << " nodes " << g0.no_nodes() << " edges " << g0.no_edges() << " thresh " << frac << "*ael"
+                 << " | multipass: " << t_old << "s merges " << merges_old << " nodes " << g_old.no_nodes()
+                 << " | single pass: " << t_new << "s merges " << merges_new << " nodes " << g_new.no_nodes() << endl;
+        }
+    }
+    return 0;
+}
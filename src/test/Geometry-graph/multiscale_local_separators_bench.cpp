@@ -0,0 +1,71 @@
+/**
+ Benchmark of the expand/shrink phase of multiscale_local_separators. Each graph is skeletonized with
+ one thread and with all threads, and the time spent expanding and shrinking separators from each level
+ of the multi-scale graph to the next is reported together with the speedup.
+
+ Usage: multiscale_local_separators_bench [graph files ...]
+ Without arguments the graphs in data/Graphs are used. Graphs with fewer than 10000 nodes are saturated
+ first, since the bundled graphs are sparse skeletons.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <GEL/Geometry/Graph.h>
+#include <GEL/Geometry/graph_io.h>
+#include <GEL/Geometry/graph_util.h>
+#include <GEL/Geometry/graph_skeletonize.h>
+#include <GEL/Util/Parallel.h>
+
+using namespace Geometry;
+using namespace std;
+
+namespace {
+    SkeletonizationStats run(const AMGraph3D& g0, unsigned int threads) {
+        AMGraph3D g = g0;
+        SkeletonizationStats stats;
+        Util::set_thread_count(threads);
+        multiscale_local_separators(g, SamplingType::None, 64, 0.09, 0, &stats);
+        return stats;
+    }
+}
+
+int main(int argc, char** argv) {
+    vector<string> files;
+    for(int i = 1; i < argc; ++i)
+        files.push_back(argv[i]);
+    if(files.empty())
+        for(auto name: {"armadillo_symmetric", "bunny", "feline", "fertility", "hand", "warrior", "wolf"})
+            files.push_back(string("data/Graphs/") + name + ".graph");
+
+    Util::set_thread_count(0);
+    const unsigned int T = Util::thread_count();
+
+    for(const auto& fn: files) {
+        AMGraph3D g = graph_load(fn);
+        if(g.no_nodes() == 0) {
+            cout << "Could not load " << fn << endl;
+            continue;
+        }
+        if(g.no_nodes() < 10000)
+            saturate_graph(g, 3);
+
+        auto serial = run(g, 1);
+        auto parallel = run(g, T);
+        cout << fn << " nodes " << g.no_nodes() << " edges " << g.no_edges()
+             << " packed " << serial.separators_packed << "/" << parallel.separators_packed << endl;
+        const size_t L = min(serial.time_expanding_per_level.size(), parallel.time_expanding_per_level.size());
+        for(size_t l = 0; l < L; ++l) {
+            const double t1 = serial.time_expanding_per_level[l];
+            const double tT = parallel.time_expanding_per_level[l];
+            cout << "  level " << L - l << " -> " << L - l - 1
+                 << " | 1 thread: " << t1 << "s | " << T << " threads: " << tT << "s | speedup "
+                 << (tT > 0 ? t1 / tT : 0.0) << endl;
+        }
+        cout << "  total expand/shrink | 1 thread: " << serial.time_expanding << "s | " << T << " threads: "
+             << parallel.time_expanding << "s | speedup "
+             << (parallel.time_expanding > 0 ? serial.time_expanding / parallel.time_expanding : 0.0) << endl;
+    }
+    return 0;
+}
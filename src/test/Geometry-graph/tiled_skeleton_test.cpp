@@ -0,0 +1,90 @@
+/**
+ Test program for tiled_skeleton. Points are sampled on a tube which winds through a row of tiles and a tube which
+ crosses the corner where four tiles meet. Each tube must give a single connected skeleton, and no two nodes may be
+ connected by more than one edge.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <GEL/Geometry/Graph.h>
+#include <GEL/Geometry/graph_tiling.h>
+#include <GEL/Geometry/graph_util.h>
+
+using namespace Geometry;
+using namespace CGLA;
+using namespace std;
+
+namespace {
+    /// Sample points on the surface of a tube of radius r around the curve c(s) for s in [0,1].
+    template<typename Curve>
+    vector<Vec3d> tube_points(Curve&& c, double length, double r, mt19937& rng) {
+        uniform_real_distribution<double> U(0.0, 1.0);
+        vector<Vec3d> pts;
+        const size_t N = size_t(length * 200);
+        for (size_t i = 0; i < N; ++i) {
+            const double s = U(rng);
+            const double phi = 2 * M_PI * U(rng);
+            const Vec3d p = c(s);
+            const Vec3d t = normalize(c(min(s + 1e-3, 1.0)) - c(max(s - 1e-3, 0.0)));
+            Vec3d u, v;
+            orthogonal(t, u, v);
+            pts.push_back(p + r * (cos(phi) * u + sin(phi) * v));
+        }
+        return pts;
+    }
+
+    bool check(const char* name, const AMGraph3D& skel, size_t min_tiles_crossed, double tile_size) {
+        NodeSetUnordered all;
+        size_t edges = 0;
+        double x_min = DBL_MAX, x_max = -DBL_MAX;
+        for (auto n: skel.node_ids()) {
+            all.insert(n);
+            edges += skel.valence(n);
+            x_min = min(x_min, skel.pos[n][0]);
+            x_max = max(x_max, skel.pos[n][0]);
+        }
+        edges /= 2;
+        const size_t components = connected_components(skel, all).size();
+        cout << name << ": " << skel.no_nodes() << " nodes, " << edges << " edges, " << components
+             << " components" << endl;
+        if (skel.no_nodes() == 0 || components != 1) {
+            cout << name << " failed: the skeleton should have one component" << endl;
+            return false;
+        }
+        if (edges != skel.no_edges()) {
+            cout << name << " failed: nodes are connected by more than one edge" << endl;
+            return false;
+        }
+        if ((x_max - x_min) / tile_size < min_tiles_crossed - 1) {
+            cout << name << " failed: the skeleton does not span the tiles" << endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+int main() {
+    mt19937 rng(0);
+    bool ok = true;
+
+    // Wavy tubes along x through rows of tiles of different sizes.
+    for (double tile_size: {2.5, 3.0, 4.0}) {
+        auto wave = [](double s) { return Vec3d(20.0 * s, 5.0 + 3.0 * sin(5 * s + 1), 1.0 + sin(2 * s)); };
+        auto pts = tube_points(wave, 20.0, 0.4, rng);
+        ok &= check("row of tiles", tiled_skeleton(pts, 0.3, 12, tile_size, 0.7, false),
+                    size_t(20.0 / tile_size), tile_size);
+    }
+
+    // A diagonal tube through the corners shared by four tiles.
+    const double tile_size = 4.0;
+    auto diagonal = [](double s) { return Vec3d(16.0 * s, 16.0 * s, 1.0); };
+    auto pts = tube_points(diagonal, 22.6, 0.4, rng);
+    ok &= check("tile corners", tiled_skeleton(pts, 0.3, 12, tile_size, 0.7, false), 4, tile_size);
+
+    if (!ok)
+        return 1;
+    cout << "Test passed" << endl;
+    return 0;
+}
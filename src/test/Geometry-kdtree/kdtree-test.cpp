@@ -9,6 +9,7 @@
 #include <cstdlib>
 #include <GEL/Geometry/KDTree.h>
 #include <GEL/CGLA/Vec3f.h>
+#include <GEL/Util/Parallel.h>
 
 using namespace GEO;
 using namespace std;
@@ -21,6 +22,72 @@ void make_ran_point(Vec3f& p0)
 					 10.0f*gel_rand()/GEL_RAND_MAX);
 }
 
+void check(bool ok, const char* what)
+{
+	if(!ok)
+		{
+			cout << " test failed: " << what << endl;
+			exit(1);
+		}
+}
+
+bool same_records(const KDTreeRecord<Vec3f,int>* a, const KDTreeRecord<Vec3f,int>* b, size_t n)
+{
+	for(size_t j=0;j<n;++j)
+		if(a[j].v != b[j].v || a[j].k != b[j].k || a[j].d != b[j].d)
+			return false;
+	return true;
+}
+
+/// Compare the batch queries of tree against the single point queries for the points in pts.
+void check_batch_queries(const KDTree<Vec3f,int>& tree, const vector<Vec3f>& pts)
+{
+	const float range = 0.7f;
+	const unsigned m = 7;
+	vector<size_t> offsets;
+	vector<KDTreeRecord<Vec3f,int>> records;
+
+	tree.closest_point(pts, range, offsets, records);
+	check(offsets.size() == pts.size()+1, "batch closest_point offsets");
+	for(size_t i=0;i<pts.size();++i)
+		{
+			Vec3f k;
+			int v;
+			float d = range;
+			const bool found = tree.closest_point(pts[i], d, k, v);
+			check(offsets[i+1]-offsets[i] == (found ? 1u : 0u), "batch closest_point count");
+			if(found)
+				check(records[offsets[i]].v == v && records[offsets[i]].k == k && records[offsets[i]].d == d*d,
+					  "batch closest_point result");
+		}
+
+	tree.in_sphere(pts, range, offsets, records);
+	for(size_t i=0;i<pts.size();++i)
+		{
+			vector<Vec3f> keys;
+			vector<int> vals;
+			const size_t n = tree.in_sphere(pts[i], range, keys, vals);
+			check(offsets[i+1]-offsets[i] == n, "batch in_sphere count");
+			for(size_t j=0;j<n;++j)
+				check(records[offsets[i]+j].v == vals[j] && records[offsets[i]+j].k == keys[j],
+					  "batch in_sphere result and order");
+		}
+
+	tree.m_closest(m, pts, range, offsets, records);
+	vector<size_t> value_offsets;
+	vector<int> values;
+	tree.m_closest_values(m, pts, range, value_offsets, values);
+	check(value_offsets == offsets, "m_closest_values offsets");
+	for(size_t i=0;i<pts.size();++i)
+		{
+			auto nv = tree.m_closest(m, pts[i], range);
+			check(offsets[i+1]-offsets[i] == nv.size(), "batch m_closest count");
+			check(same_records(&records[offsets[i]], nv.data(), nv.size()), "batch m_closest result and order");
+			for(size_t j=0;j<nv.size();++j)
+				check(values[offsets[i]+j] == nv[j].v, "m_closest_values result and order");
+		}
+}
+
 int main()
 {
 	cout << "\n\nTest 1: Insert and find " << endl;
@@ -97,4 +164,38 @@ int main()
         cout << sqrt(e.d) << e.k << ", " << e.v << endl;
     }
 
+	// The tree is large enough that its subtrees are built in parallel when more than one thread is used.
+	cout << "\n\nTest 3: Batch queries and parallel build " << endl;
+	const int L = 40000;
+	gel_srand(1);
+	vector<Vec3f> pts(L);
+	for(auto& p: pts)
+		make_ran_point(p);
+	vector<Vec3f> queries(2000);
+	for(auto& q: queries)
+		make_ran_point(q);
+	for(int i=0;i<100;++i)
+		queries.push_back(pts[i]);
+
+	KDTree<Vec3f,int> serial_tree, parallel_tree;
+	for(int i=0;i<L;++i)
+		{
+			serial_tree.insert(pts[i], i);
+			parallel_tree.insert(pts[i], i);
+		}
+	Util::set_thread_count(1);
+	serial_tree.build();
+	check_batch_queries(serial_tree, queries);
+	Util::set_thread_count(4);
+	parallel_tree.build();
+	check_batch_queries(parallel_tree, queries);
+	for(const auto& q: queries)
+		{
+			auto a = serial_tree.m_closest(7, q, 0.7f);
+			auto b = parallel_tree.m_closest(7, q, 0.7f);
+			check(a.size() == b.size() && same_records(a.data(), b.data(), a.size()), "parallel build");
+		}
+	Util::set_thread_count(0);
+	cout << "Test passed " << endl;
+	return 0;
 }
@@ -0,0 +1,61 @@
+/**
+ Test program for the merging of cliques in skeleton_from_node_set_vec. Every node of the test graphs is its own
+ node set, so the skeleton has the connectivity of the graph, and the triangles are replaced by branch nodes.
+ Triangles that share an edge are reduced to the same branch node, and so are groups of triangles that share two
+ nodes which do not lie on a common triangle edge.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <GEL/Geometry/Graph.h>
+#include <GEL/Geometry/graph_skeletonize.h>
+
+using namespace Geometry;
+using namespace CGLA;
+using namespace std;
+
+namespace {
+    /// Returns the number of branch nodes in the skeleton of a graph with the given edges.
+    size_t no_branch_nodes(size_t no_nodes, const vector<pair<int, int>>& edges) {
+        AMGraph3D g;
+        NodeSetVec node_set_vec;
+        for(size_t n = 0; n < no_nodes; ++n) {
+            g.add_node(Vec3d(double(n), double(n * n % 5), 0.0));
+            node_set_vec.push_back({1.0, {AMGraph::NodeID(n)}});
+        }
+        for(auto [a, b]: edges)
+            g.connect_nodes(a, b);
+        auto [skel, _] = skeleton_from_node_set_vec(g, node_set_vec, true, 0);
+        return skel.no_nodes() - no_nodes;
+    }
+
+    bool check(const char* name, size_t found, size_t expected) {
+        if(found == expected)
+            return true;
+        cout << name << ": " << found << " branch nodes, expected " << expected << endl;
+        return false;
+    }
+}
+
+int main() {
+    bool ok = true;
+
+    // Two triangles sharing a single node are kept apart.
+    ok &= check("bowtie", no_branch_nodes(5, {{0, 1}, {1, 2}, {2, 0}, {2, 3}, {3, 4}, {4, 2}}), 2);
+
+    // A strip of triangles where each shares an edge with the next is reduced to one branch node.
+    vector<pair<int, int>> strip = {{0, 1}, {0, 2}, {1, 2}, {1, 3}, {2, 3}, {2, 4}, {3, 4}, {3, 5}, {4, 5}};
+    ok &= check("strip", no_branch_nodes(6, strip), 1);
+
+    // A triangle on the two end nodes of the strip shares no edge with any triangle of the strip,
+    // but it shares two nodes with the strip as a whole, so it is merged with the strip.
+    auto closed_strip = strip;
+    closed_strip.insert(closed_strip.end(), {{0, 5}, {0, 6}, {5, 6}});
+    ok &= check("closed strip", no_branch_nodes(7, closed_strip), 1);
+
+    if(!ok)
+        return EXIT_FAILURE;
+    cout << "clique merge test passed" << endl;
+    return EXIT_SUCCESS;
+}
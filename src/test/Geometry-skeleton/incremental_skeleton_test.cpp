@@ -0,0 +1,175 @@
+/**
+ Test program for IncrementalSkeleton. A graph is edited at random, and after each update, the separator kept for
+ every node is compared to the separator grown from scratch on the edited graph. The packing must consist of disjoint
+ candidates, and every candidate left out must overlap a packed one. Initially, the packing must be the same as that
+ of local_separators. Edits that refer to nodes which do not exist must leave the graph unchanged.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <GEL/Geometry/Graph.h>
+#include <GEL/Geometry/graph_io.h>
+#include <GEL/Geometry/graph_util.h>
+#include <GEL/Geometry/graph_skeletonize.h>
+
+using namespace Geometry;
+using namespace CGLA;
+using namespace std;
+
+namespace {
+    using NodeID = AMGraph::NodeID;
+
+    /// A graph on points sampled on the surface of a Y shaped set of tubes.
+    AMGraph3D branching_tubes() {
+        mt19937 rng(2);
+        uniform_real_distribution<double> U(0.0, 1.0);
+        const Vec3d fork(0, 0, 4);
+        const vector<pair<Vec3d, Vec3d>> segments = {{Vec3d(0, 0, 0), fork},
+                                                     {fork, Vec3d(2.5, 0, 7)},
+                                                     {fork, Vec3d(-2, 1.5, 8)}};
+        vector<Vec3d> pts;
+        for (const auto& [a, b]: segments) {
+            const Vec3d t = normalize(b - a);
+            Vec3d u, v;
+            orthogonal(t, u, v);
+            for (int i = 0; i < int(100 * length(b - a)); ++i) {
+                const double phi = 2 * M_PI * U(rng);
+                pts.push_back(a + U(rng) * (b - a) + 0.5 * (cos(phi) * u + sin(phi) * v));
+            }
+        }
+        return graph_from_points(pts, 0.35, 10);
+    }
+
+    bool in_use(const AMGraph3D& g, NodeID n) {
+        return !std::isnan(g.pos[n][0]);
+    }
+
+    /// Remove, add, connect and disconnect a few random nodes.
+    void random_edits(IncrementalSkeleton& inc, const AMGraph3D& g, mt19937& rng) {
+        auto random_node = [&]() {
+            NodeID n;
+            do n = uniform_int_distribution<NodeID>(0, g.no_nodes() - 1)(rng);
+            while (!in_use(g, n));
+            return n;
+        };
+        for (int i = 0; i < 3; ++i)
+            inc.remove_node(random_node());
+        for (int i = 0; i < 3; ++i) {
+            const NodeID m = random_node();
+            const auto nbrs = g.neighbors(m);
+            const NodeID n = inc.add_node(g.pos[m] + Vec3d(0.01, 0.02, 0.03));
+            inc.connect_nodes(n, m);
+            for (auto k: nbrs)
+                if (k % 2 == 0)
+                    inc.connect_nodes(n, k);
+        }
+        for (int i = 0; i < 4; ++i) {
+            const NodeID n = random_node();
+            const auto nbrs = g.neighbors(n);
+            if (nbrs.empty())
+                continue;
+            const NodeID m = nbrs[rng() % nbrs.size()];
+            const auto nbrs_m = g.neighbors(m);
+            inc.connect_nodes(n, nbrs_m[rng() % nbrs_m.size()]);
+            if (nbrs.size() > 2)
+                inc.disconnect_nodes(n, nbrs[rng() % nbrs.size()]);
+        }
+    }
+
+    /// Edits of nodes that are out of range or removed must be ignored.
+    bool check_invalid_edits(IncrementalSkeleton& inc, const AMGraph3D& g) {
+        NodeID removed = AMGraph::InvalidNodeID;
+        for (auto n: g.node_ids())
+            if (!in_use(g, n))
+                removed = n;
+        const size_t N = g.no_nodes();
+        const size_t E = g.no_edges();
+        for (NodeID bad: {NodeID(N), NodeID(N + 100), AMGraph::InvalidNodeID, removed}) {
+            inc.remove_node(bad);
+            inc.connect_nodes(bad, 0);
+            inc.connect_nodes(0, bad);
+            inc.disconnect_nodes(bad, 0);
+        }
+        inc.connect_nodes(0, 0);
+        return g.no_nodes() == N && g.no_edges() == E && inc.update() == 0;
+    }
+
+    /// The separator kept for each node must be the one grown from scratch.
+    bool check_candidates(const IncrementalSkeleton& inc, const AMGraph3D& g, double qnl, int opt_steps) {
+        size_t wrong = 0;
+        for (auto n: g.node_ids()) {
+            auto sep = local_separator(g, n, qnl, opt_steps);
+            if (inc.candidate_separator(n) != make_pair(sep.quality, order(sep.sigma)))
+                ++wrong;
+        }
+        if (wrong > 0)
+            cout << "  " << wrong << " separators differ from those grown from scratch" << endl;
+        return wrong == 0;
+    }
+
+    /// The packed separators must be disjoint candidates, and all other candidates must overlap one of them.
+    bool check_packing(const IncrementalSkeleton& inc, const AMGraph3D& g) {
+        const NodeSetVec packed = inc.separators();
+        vector<int> used(g.no_nodes(), 0);
+        for (const auto& [w, ns]: packed)
+            for (auto n: ns)
+                if (used[n]++ > 0) {
+                    cout << "  packed separators overlap" << endl;
+                    return false;
+                }
+        for (auto n: g.node_ids()) {
+            const auto& ns = inc.candidate_separator(n).second;
+            if (!ns.empty() && none_of(ns.begin(), ns.end(), [&](NodeID m) { return used[m] > 0; })) {
+                cout << "  the separator of node " << n << " fits but is not packed" << endl;
+                return false;
+            }
+        }
+        return !packed.empty();
+    }
+
+    bool check(const char* name, const AMGraph3D& g0, double qnl, int opt_steps, int rounds) {
+        AMGraph3D g = g0;
+        IncrementalSkeleton inc(g, qnl, opt_steps);
+        bool ok = check_candidates(inc, g, qnl, opt_steps) && check_packing(inc, g);
+
+        // Initially, the packing is that of local_separators without sampling.
+        AMGraph3D g_ls = g0;
+        NodeSetVec expected = local_separators(g_ls, SamplingType::None, qnl, opt_steps);
+        NodeSetVec packed = inc.separators();
+        sort(expected.begin(), expected.end());
+        sort(packed.begin(), packed.end());
+        if (packed != expected) {
+            cout << "  the initial packing differs from that of local_separators" << endl;
+            ok = false;
+        }
+
+        mt19937 rng(7);
+        size_t regrown = 0;
+        for (int r = 0; r < rounds && ok; ++r) {
+            random_edits(inc, g, rng);
+            regrown += inc.update();
+            ok = check_candidates(inc, g, qnl, opt_steps) && check_packing(inc, g);
+        }
+        ok = ok && check_invalid_edits(inc, g);
+        cout << name << ": " << g.no_nodes() << " nodes, " << regrown << " separators regrown in " << rounds
+             << " rounds" << (ok ? "" : ", failed") << endl;
+        return ok;
+    }
+}
+
+int main() {
+    const AMGraph3D g = branching_tubes();
+
+    bool ok = true;
+    ok &= check("no optimization", g, 0.09, 0, 6);
+    ok &= check("one optimization step", g, 0.09, 1, 3);
+
+    if (!ok)
+        return EXIT_FAILURE;
+    cout << "incremental skeleton test passed" << endl;
+    return EXIT_SUCCESS;
+}
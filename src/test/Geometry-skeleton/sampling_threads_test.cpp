@@ -0,0 +1,82 @@
+/**
+ Test program for the sampling in local_separators and multiscale_local_separators. The nodes that separators are
+ grown from are sampled randomly, but the result must only depend on the seed. The separators found with one thread
+ are compared to those found with several threads for each kind of sampling.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <GEL/Util/Parallel.h>
+#include <GEL/Geometry/Graph.h>
+#include <GEL/Geometry/graph_io.h>
+#include <GEL/Geometry/graph_skeletonize.h>
+
+using namespace Geometry;
+using namespace CGLA;
+using namespace std;
+
+namespace {
+    /// A graph on points sampled on the surface of a Y shaped set of tubes.
+    AMGraph3D branching_tubes() {
+        mt19937 rng(1);
+        uniform_real_distribution<double> U(0.0, 1.0);
+        const Vec3d fork(0, 0, 4);
+        const vector<pair<Vec3d, Vec3d>> segments = {{Vec3d(0, 0, 0), fork},
+                                                     {fork, Vec3d(2.5, 0, 7)},
+                                                     {fork, Vec3d(-2, 1.5, 8)}};
+        vector<Vec3d> pts;
+        for (const auto& [a, b]: segments) {
+            const Vec3d t = normalize(b - a);
+            Vec3d u, v;
+            orthogonal(t, u, v);
+            for (int i = 0; i < int(160 * length(b - a)); ++i) {
+                const double phi = 2 * M_PI * U(rng);
+                pts.push_back(a + U(rng) * (b - a) + 0.5 * (cos(phi) * u + sin(phi) * v));
+            }
+        }
+        return graph_from_points(pts, 0.3, 10);
+    }
+
+    using SeparatorFunction = NodeSetVec (*)(AMGraph3D&, SamplingType);
+
+    bool check(const char* name, AMGraph3D g, SeparatorFunction f, SamplingType sampling) {
+        Util::set_thread_count(1);
+        const NodeSetVec serial = f(g, sampling);
+        bool ok = !serial.empty();
+        for (unsigned int threads: {2u, 4u}) {
+            Util::set_thread_count(threads);
+            if (f(g, sampling) != serial)
+                ok = false;
+        }
+        Util::set_thread_count(0);
+        cout << name << ": " << serial.size() << " separators" << (ok ? "" : ", but they differ") << endl;
+        return ok;
+    }
+
+    NodeSetVec ls(AMGraph3D& g, SamplingType sampling) {
+        return local_separators(g, sampling);
+    }
+
+    NodeSetVec msls(AMGraph3D& g, SamplingType sampling) {
+        return multiscale_local_separators(g, sampling, 32);
+    }
+}
+
+int main() {
+    const AMGraph3D g = branching_tubes();
+    cout << "graph with " << g.no_nodes() << " nodes" << endl;
+
+    bool ok = true;
+    ok &= check("local_separators basic", g, ls, SamplingType::Basic);
+    ok &= check("local_separators advanced", g, ls, SamplingType::Advanced);
+    ok &= check("multiscale_local_separators basic", g, msls, SamplingType::Basic);
+    ok &= check("multiscale_local_separators advanced", g, msls, SamplingType::Advanced);
+
+    if (!ok)
+        return EXIT_FAILURE;
+    cout << "sampling threads test passed" << endl;
+    return EXIT_SUCCESS;
+}